@@ -0,0 +1,234 @@
+#include "batch.h"
+
+#include "bounded_queue.h"
+#include "controller.h"
+#include "exceptions.h"
+#include "io.h"
+#include "memory_planner.h"
+#include "optimizer.h"
+
+#include <fstream>
+#include <functional>
+#include <future>
+#include <unordered_map>
+
+bool operator==(const BatchJob& a, const BatchJob& b) {
+    return a.input_path == b.input_path && a.output_path == b.output_path && a.filters == b.filters;
+}
+
+std::vector<FilterInput> ParseJsonFilters(const JsonValue& filters) {
+    if (filters.IsString()) {
+        return ParseFilters(SplitBySpaces(filters.GetString()));
+    }
+    std::vector<std::string> args;
+    for (const JsonValue& arg : filters.GetArray()) {
+        args.push_back(arg.GetString());
+    }
+    return ParseFilters(args);
+}
+
+BatchJob ParseJsonManifestLine(const std::string& line) {
+    const JsonValue value = ParseJson(line);
+    const JsonValue* input = value.Find("input");
+    const JsonValue* output = value.Find("output");
+    if (input == nullptr || output == nullptr) {
+        throw UsageException("both input and output must be given");
+    }
+
+    BatchJob job{input->GetString(), output->GetString(), std::nullopt};
+    if (const JsonValue* filters = value.Find("filters")) {
+        job.filters = ParseJsonFilters(*filters);
+    }
+    return job;
+}
+
+BatchJob ParsePlainManifestLine(const std::string& line) {
+    const std::vector<std::string> words = SplitBySpaces(line);
+    if (words.size() < 2) {
+        throw UsageException("both input and output must be given");
+    }
+    BatchJob job{words[0], words[1], std::nullopt};
+    if (words.size() > 2) {
+        job.filters = ParseFilters(std::vector<std::string>(words.begin() + 2, words.end()));
+    }
+    return job;
+}
+
+std::vector<BatchJob> ReadManifest(std::istream& in) {
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (size_t line_number = 1; std::getline(in, line); ++line_number) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        try {
+            if (line[first] == '{') {
+                jobs.push_back(ParseJsonManifestLine(line));
+            } else {
+                jobs.push_back(ParsePlainManifestLine(line));
+            }
+        } catch (const ImageProcessorException& exc) {
+            throw UsageException("manifest line " + std::to_string(line_number) + ": " + exc.what());
+        }
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> ReadManifest(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        throw ReadException("could not open manifest " + filename);
+    }
+    return ReadManifest(in);
+}
+
+std::string GetChainKey(const std::vector<FilterInput>& filters) {
+    std::string key;
+    for (const FilterInput& filter : filters) {
+        key += "-" + filter.name;
+        for (const std::string& param : filter.params) {
+            key += " " + param;
+        }
+        key += "\n";
+    }
+    return key;
+}
+
+size_t RunBatch(const std::vector<BatchJob>& jobs, const std::vector<FilterInput>& default_filters,
+                const size_t max_in_flight, std::ostream& errors, ResultCache* cache,
+                const std::optional<std::chrono::milliseconds> file_deadline, MemoryBudget* budget) {
+    struct Chain {
+        std::vector<FilterInput> inputs;
+        std::vector<std::shared_ptr<BaseFilter>> filters;
+    };
+    const auto create_chain = [](const std::vector<FilterInput>& filters) {
+        std::vector<FilterInput> inputs = OptimizeFilters(filters).filters;
+        std::vector<std::shared_ptr<BaseFilter>> created = CreateFilters(inputs);
+        return Chain{std::move(inputs), std::move(created)};
+    };
+    // Chains are created on first use, so an incorrect default chain only fails the files which use it.
+    std::unordered_map<std::string, Chain> chains;
+
+    std::vector<std::string> failures(jobs.size());
+    std::vector<const Chain*> job_chains(jobs.size(), nullptr);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const std::vector<FilterInput>& filters = jobs[i].filters.value_or(default_filters);
+        const std::string key = GetChainKey(filters);
+        auto chain = chains.find(key);
+        if (chain == chains.end()) {
+            try {
+                chain = chains.emplace(key, create_chain(filters)).first;
+            } catch (const ImageProcessorException& exc) {
+                failures[i] = exc.what();
+                continue;
+            }
+        }
+        job_chains[i] = &chain->second;
+    }
+
+    // Returns false if the step failed, the error is saved for the file.
+    const auto run_step = [&failures](const size_t i, const std::function<void()>& step) {
+        try {
+            step();
+            return true;
+        } catch (const ImageProcessorException& exc) {
+            failures[i] = exc.what();
+        } catch (const std::exception& exc) {
+            failures[i] = std::string("Unknown exception: ") + exc.what();
+        }
+        return false;
+    };
+
+    // Files go through three stages connected by bounded queues: a reader decodes the next files while lanes apply
+    // filters, and a writer encodes finished images, so disk I/O overlaps with computation. Every lane filters one
+    // file at a time and the queues hold at most as many files as there are lanes. An empty item tells the next stage
+    // that there are no more files.
+    struct Item {
+        size_t job;
+        Image image;
+        // Estimated peak memory of the file, held until it is written.
+        MemoryReservation reservation;
+    };
+    const size_t lanes = std::max<size_t>(1, std::min(max_in_flight, jobs.size()));
+    BlockingQueue<std::optional<Item>> decoded(lanes);
+    BlockingQueue<std::optional<Item>> filtered(lanes);
+
+    std::future<void> reader = std::async(std::launch::async, [&] {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (job_chains[i] == nullptr) {
+                continue;
+            }
+            Item item{i, Image(), MemoryReservation()};
+            const bool read = run_step(i, [&] {
+                if (budget != nullptr) {
+                    const MemoryPlan plan = EstimateMemory(ReadImageShape(jobs[i].input_path), job_chains[i]->filters);
+                    item.reservation = MemoryReservation(budget, plan.peak_bytes);
+                }
+                // With the cache, files are read by the lanes, which look up cached images by the file contents.
+                if (cache == nullptr) {
+                    item.image = ReadImage(jobs[i].input_path);
+                }
+            });
+            if (read) {
+                decoded.Push(std::move(item));
+            }
+        }
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            decoded.Push(std::nullopt);
+        }
+    });
+
+    std::future<void> writer = std::async(std::launch::async, [&] {
+        for (std::optional<Item> item = filtered.Pop(); item.has_value(); item = filtered.Pop()) {
+            run_step(item->job, [&] { WriteImage(item->image, jobs[item->job].output_path); });
+            // The reservation is returned before waiting for the next file, the reader may be waiting for it.
+            item.reset();
+        }
+    });
+
+    // Lanes run on their own threads and only the tiles go to the pool. As pool tasks, a lane waiting for the tiles
+    // of its file could pick up another lane, which blocks on the queue and keeps the file and its reservation.
+    const auto run_lane = [&] {
+        for (std::optional<Item> item = decoded.Pop(); item.has_value(); item = decoded.Pop()) {
+            const size_t i = item->job;
+            const Chain& chain = *job_chains[i];
+            const bool applied = run_step(i, [&] {
+                const CancellationToken token = CreateCancellationToken(file_deadline);
+                const CancellationScope scope(&token);
+                if (cache != nullptr) {
+                    item->image = ReadAndApplyFilters(jobs[i].input_path, chain.inputs, chain.filters, *cache);
+                } else {
+                    ApplyFilters(item->image, chain.filters);
+                }
+            });
+            if (applied) {
+                filtered.Push(std::move(item));
+            }
+            item.reset();
+        }
+    };
+    std::vector<std::future<void>> lane_threads;
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        lane_threads.push_back(std::async(std::launch::async, run_lane));
+    }
+    for (std::future<void>& lane : lane_threads) {
+        lane.get();
+    }
+    filtered.Push(std::nullopt);
+    reader.get();
+    writer.get();
+
+    size_t failed_count = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!failures[i].empty()) {
+            errors << jobs[i].input_path << ": " << failures[i] << std::endl;
+            ++failed_count;
+        }
+    }
+    return failed_count;
+}
+
+size_t GetMaxInFlight(const std::unordered_map<std::string, std::string>& options) {
+    return GetPositiveOption(options, "in-flight").value_or(GetThreadPool().GetThreadsCount());
+}
\ No newline at end of file
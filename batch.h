@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cache.h"
+#include "json.h"
+#include "memory_planner.h"
+#include "parser.h"
+
+#include <chrono>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct BatchJob {
+    std::string input_path;
+    std::string output_path;
+    // If given, replaces the filters from the command line for this file.
+    std::optional<std::vector<FilterInput>> filters;
+};
+
+bool operator==(const BatchJob& a, const BatchJob& b);
+
+// Filters of a JSON job are given either as a string of arguments separated by spaces or as an array of arguments.
+std::vector<FilterInput> ParseJsonFilters(const JsonValue& filters);
+
+// Key identifying the chain of filters, equal chains have equal keys.
+std::string GetChainKey(const std::vector<FilterInput>& filters);
+
+// Every non-empty line of the manifest describes one file. It is either a JSON object
+// {"input": ..., "output": ..., "filters": "-gs -blur 2"} (filters can also be given as an array of arguments) or a
+// plain list of arguments: input output [-filter_name [<params>]]. Lines starting with # are skipped.
+std::vector<BatchJob> ReadManifest(std::istream& in);
+
+std::vector<BatchJob> ReadManifest(const std::string& filename);
+
+// Processes files on the thread pool, at most max_in_flight of them are filtered at the same time, while a reader
+// decodes the next ones and a writer encodes the finished ones. Every distinct chain of filters is created once before
+// processing starts. Errors in separate files do not stop the batch, they are
+// written to errors, and the number of failed files is returned. If the cache is given, files are processed through it.
+// Filters of a file are cancelled if they take longer than file_deadline. If the budget is given, every file reserves
+// its estimated peak memory before it is read, so files wait while the budget is taken and larger ones are refused.
+size_t RunBatch(const std::vector<BatchJob>& jobs, const std::vector<FilterInput>& default_filters,
+                size_t max_in_flight, std::ostream& errors, ResultCache* cache = nullptr,
+                std::optional<std::chrono::milliseconds> file_deadline = std::nullopt, MemoryBudget* budget = nullptr);
+
+// Number of files loaded at the same time in batch mode, by default equal to the number of threads.
+size_t GetMaxInFlight(const std::unordered_map<std::string, std::string>& options);
\ No newline at end of file
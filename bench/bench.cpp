@@ -0,0 +1,353 @@
+#include "../controller.h"
+#include "../exceptions.h"
+#include "../fft.h"
+#include "../io.h"
+#include "../json.h"
+#include "../parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const std::string HELP = R"(DESCRIPTION
+    Benchmarks filters, BMP reading and writing and the 2D FFT on deterministic
+    synthetic images.
+
+USAGE
+    image_processor_bench [--option <value>]
+
+OPTIONS
+    --sizes list               Comma-separated sides of square images, from 256 to
+                               16384. 256,512,1024,2048 by default.
+    --patterns list            Comma-separated patterns: noise, gradient, checkerboard.
+                               All of them by default.
+    --only list                Comma-separated names of benchmarks to run, for example
+                               blur,read,fft,lut. All of them by default.
+    --repetitions count        Measured runs of every benchmark, 5 by default.
+    --warmup count             Runs before measuring, 1 by default.
+    --threads count            Number of threads, all hardware threads by default.
+    --csv path                 Writes results as CSV.
+    --json path                Writes results as JSON.
+
+EXAMPLES
+    $ image_processor_bench --sizes 1024 --only blur,sharp --json before.json
+    $ image_processor_bench --sizes 256,16384 --patterns noise --repetitions 3 --csv big.csv)";
+
+struct BenchmarkConfig {
+    std::vector<size_t> sizes = {256, 512, 1024, 2048};
+    std::vector<std::string> patterns = {"noise", "gradient", "checkerboard"};
+    std::vector<std::string> only;
+    size_t repetitions = 5;
+    size_t warmup = 1;
+    std::string csv_path;
+    std::string json_path;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string pattern;
+    size_t size = 0;
+    // Milliseconds of every measured run.
+    std::vector<double> runs;
+};
+
+std::vector<std::string> SplitByCommas(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+size_t ConvertToCount(const std::string& value, const std::string& option) {
+    try {
+        size_t pos = 0;
+        const unsigned long long count = std::stoull(value, &pos);
+        if (pos == value.size() && value[0] != '-') {
+            return static_cast<size_t>(count);
+        }
+    } catch (const std::exception&) {
+    }
+    throw UsageException("option --" + option + " requires a non-negative integer");
+}
+
+BenchmarkConfig ParseConfig(int argc, char** argv) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg.size() <= 2 || arg.substr(0, 2) != "--") {
+            throw UsageException("unexpected argument " + arg);
+        }
+        if (i + 1 == argc) {
+            throw UsageException("option " + arg + " requires a value");
+        }
+        const std::string name = arg.substr(2);
+        const std::string value = argv[i + 1];
+        if (name == "sizes") {
+            config.sizes.clear();
+            for (const std::string& size : SplitByCommas(value)) {
+                config.sizes.push_back(ConvertToCount(size, name));
+            }
+        } else if (name == "patterns") {
+            config.patterns = SplitByCommas(value);
+        } else if (name == "only") {
+            config.only = SplitByCommas(value);
+        } else if (name == "repetitions") {
+            config.repetitions = std::max<size_t>(1, ConvertToCount(value, name));
+        } else if (name == "warmup") {
+            config.warmup = ConvertToCount(value, name);
+        } else if (name == "threads") {
+            SetThreadsCount(std::max<size_t>(1, ConvertToCount(value, name)));
+        } else if (name == "csv") {
+            config.csv_path = value;
+        } else if (name == "json") {
+            config.json_path = value;
+        } else {
+            throw UsageException("unknown option " + arg);
+        }
+    }
+    constexpr size_t MinSize = 256;
+    constexpr size_t MaxSize = 16384;
+    for (const size_t size : config.sizes) {
+        if (size < MinSize || MaxSize < size) {
+            throw UsageException("image sizes must be from 256 to 16384");
+        }
+    }
+    for (const std::string& pattern : config.patterns) {
+        if (pattern != "noise" && pattern != "gradient" && pattern != "checkerboard") {
+            throw UsageException("unknown pattern " + pattern);
+        }
+    }
+    return config;
+}
+
+// Images depend only on the pattern and the size, so results of different commits are comparable.
+Image GenerateImage(const std::string& pattern, const size_t size) {
+    Image image(size, size);
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ size;
+    constexpr size_t CheckerboardCell = 32;
+    for (size_t i = 0; i < size; ++i) {
+        double* row = image.GetMutableRow(i);
+        for (size_t j = 0; j < size; ++j) {
+            for (size_t c = 0; c < RGB_CHANNELS; ++c) {
+                double value = 0;
+                if (pattern == "noise") {
+                    // xorshift64*
+                    state ^= state >> 12;
+                    state ^= state << 25;
+                    state ^= state >> 27;
+                    constexpr uint64_t Multiplier = 0x2545F4914F6CDD1DULL;
+                    constexpr double ByteMax = 255.0;
+                    value = static_cast<double>((state * Multiplier) >> 56) / ByteMax;
+                } else if (pattern == "gradient") {
+                    value = static_cast<double>(c == 0 ? i : c == 1 ? j : i + j) /
+                            static_cast<double>(c == 2 ? 2 * size : size);
+                } else {
+                    value = (i / CheckerboardCell + j / CheckerboardCell + c) % 2 == 0 ? 1.0 : 0.0;
+                }
+                row[j * RGB_CHANNELS + c] = value;
+            }
+        }
+    }
+    return image;
+}
+
+struct Benchmark {
+    std::string name;
+    // Prepares the state of one run, it is not measured.
+    std::function<void(const Image&)> prepare;
+    std::function<void()> run;
+};
+
+std::vector<Benchmark> CreateBenchmarks(const std::string& temporary_path) {
+    std::vector<Benchmark> benchmarks;
+    auto work = std::make_shared<Image>();
+    auto spectrum = std::make_shared<ImageFrequencyDomainRepresentation>();
+
+    const std::vector<std::pair<std::string, std::vector<std::string>>> filters = {
+        {"crop", {"128", "128"}},
+        {"gs", {}},
+        {"neg", {}},
+        {"sharp", {}},
+        {"edge", {"0.1"}},
+        {"blur", {"2"}},
+        {"blur", {"7.3"}},
+        {"box", {"50"}},
+        {"median", {"1"}},
+        {"median", {"10"}},
+        {"resize", {"512", "512", "box"}},
+        {"resize", {"700", "500", "lanczos"}},
+        {"fft-magnitude", {"1000"}},
+        {"fft-lowpass", {"0.1"}},
+        {"fft-highpass", {"0.1"}},
+        {"fft-peaks", {"0.001"}}};
+    for (const auto& [name, params] : filters) {
+        const std::vector<FilterInput> inputs = {FilterInput(name, params)};
+        auto chain = std::make_shared<std::vector<std::shared_ptr<BaseFilter>>>(CreateFilters(inputs));
+        std::string benchmark_name = name;
+        for (const std::string& param : params) {
+            benchmark_name += " " + param;
+        }
+        benchmarks.push_back(Benchmark{benchmark_name, [work](const Image& image) { *work = image; },
+                                       [work, chain] { ApplyFilters(*work, *chain); }});
+    }
+
+    benchmarks.push_back(Benchmark{"write", [work](const Image& image) { *work = image; },
+                                   [work, temporary_path] { WriteImage(*work, temporary_path); }});
+    benchmarks.push_back(Benchmark{"read", [temporary_path](const Image& image) { WriteImage(image, temporary_path); },
+                                   [work, temporary_path] { *work = ReadImage(temporary_path); }});
+    // Reading, applying -neg and writing as lookup tables, compare with read + neg + write.
+    const auto luts = std::make_shared<std::vector<ChannelLut>>(*ComposeLuts(CreateFilters({FilterInput("neg", {})})));
+    benchmarks.push_back(
+        Benchmark{"lut neg", [temporary_path](const Image& image) { WriteImage(image, temporary_path); },
+                  [temporary_path, luts] { ApplyLutsToBmp(temporary_path, temporary_path + ".out", *luts); }});
+    benchmarks.push_back(
+        Benchmark{"fft", [work](const Image& image) { *work = image; }, [work, spectrum] { *spectrum = FFT(*work); }});
+    benchmarks.push_back(Benchmark{"inverse-fft", [spectrum](const Image& image) { *spectrum = FFT(image); },
+                                   [work, spectrum] { *work = InverseFFT(*spectrum); }});
+    return benchmarks;
+}
+
+bool IsSelected(const BenchmarkConfig& config, const std::string& name) {
+    if (config.only.empty()) {
+        return true;
+    }
+    const std::string filter_name = name.substr(0, name.find(' '));
+    return std::find(config.only.begin(), config.only.end(), filter_name) != config.only.end();
+}
+
+struct Statistics {
+    double min = 0;
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+    double max = 0;
+};
+
+Statistics GetStatistics(std::vector<double> runs) {
+    std::sort(runs.begin(), runs.end());
+    Statistics statistics;
+    statistics.min = runs.front();
+    statistics.max = runs.back();
+    statistics.median = runs.size() % 2 == 1 ? runs[runs.size() / 2]
+                                             : (runs[runs.size() / 2 - 1] + runs[runs.size() / 2]) / 2;
+    statistics.mean = std::accumulate(runs.begin(), runs.end(), 0.0) / static_cast<double>(runs.size());
+    double squares = 0;
+    for (const double run : runs) {
+        squares += (run - statistics.mean) * (run - statistics.mean);
+    }
+    statistics.stddev = runs.size() > 1 ? std::sqrt(squares / static_cast<double>(runs.size() - 1)) : 0.0;
+    return statistics;
+}
+
+void WriteCsv(const std::vector<BenchmarkResult>& results, const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw WriteException("could not open " + path);
+    }
+    out << "benchmark,pattern,size,repetitions,min_ms,median_ms,mean_ms,stddev_ms,max_ms\n";
+    for (const BenchmarkResult& result : results) {
+        const Statistics statistics = GetStatistics(result.runs);
+        out << "\"" << result.name << "\"," << result.pattern << "," << result.size << "," << result.runs.size()
+            << "," << statistics.min << "," << statistics.median << "," << statistics.mean << ","
+            << statistics.stddev << "," << statistics.max << "\n";
+    }
+}
+
+void WriteJsonResults(const std::vector<BenchmarkResult>& results, const BenchmarkConfig& config,
+                      const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw WriteException("could not open " + path);
+    }
+    JsonValue::Array items;
+    for (const BenchmarkResult& result : results) {
+        const Statistics statistics = GetStatistics(result.runs);
+        items.emplace_back(JsonValue::Object{{"benchmark", result.name},
+                                             {"pattern", result.pattern},
+                                             {"size", static_cast<double>(result.size)},
+                                             {"min_ms", statistics.min},
+                                             {"median_ms", statistics.median},
+                                             {"mean_ms", statistics.mean},
+                                             {"stddev_ms", statistics.stddev},
+                                             {"max_ms", statistics.max},
+                                             {"runs_ms", JsonValue::Array(result.runs.begin(), result.runs.end())}});
+    }
+    out << WriteJson(JsonValue::Object{{"threads", static_cast<double>(GetThreadPool().GetThreadsCount())},
+                                       {"repetitions", static_cast<double>(config.repetitions)},
+                                       {"warmup", static_cast<double>(config.warmup)},
+                                       {"results", std::move(items)}})
+        << "\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc == 2 && std::string(argv[1]) == "--help") {
+            std::cout << HELP << std::endl;
+            return 0;
+        }
+        const BenchmarkConfig config = ParseConfig(argc, argv);
+        const std::string temporary_path =
+            (std::filesystem::temp_directory_path() / "image_processor_bench.bmp").string();
+        std::vector<Benchmark> benchmarks = CreateBenchmarks(temporary_path);
+
+        std::vector<BenchmarkResult> results;
+        std::cout << std::left << std::setw(24) << "benchmark" << std::setw(14) << "pattern" << std::setw(8) << "size"
+                  << std::right << std::setw(12) << "median ms" << std::setw(12) << "min ms" << std::setw(12)
+                  << "stddev ms" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        for (const size_t size : config.sizes) {
+            for (const std::string& pattern : config.patterns) {
+                const Image image = GenerateImage(pattern, size);
+                for (const Benchmark& benchmark : benchmarks) {
+                    if (!IsSelected(config, benchmark.name)) {
+                        continue;
+                    }
+                    BenchmarkResult result{benchmark.name, pattern, size, {}};
+                    for (size_t run = 0; run < config.warmup + config.repetitions; ++run) {
+                        benchmark.prepare(image);
+                        const auto started = std::chrono::steady_clock::now();
+                        benchmark.run();
+                        const auto finished = std::chrono::steady_clock::now();
+                        if (run >= config.warmup) {
+                            result.runs.push_back(
+                                std::chrono::duration<double, std::milli>(finished - started).count());
+                        }
+                    }
+                    const Statistics statistics = GetStatistics(result.runs);
+                    std::cout << std::left << std::setw(24) << result.name << std::setw(14) << pattern << std::setw(8)
+                              << size << std::right << std::setw(12) << statistics.median << std::setw(12)
+                              << statistics.min << std::setw(12) << statistics.stddev << std::endl;
+                    results.push_back(std::move(result));
+                }
+            }
+        }
+        std::filesystem::remove(temporary_path);
+        std::filesystem::remove(temporary_path + ".out");
+
+        if (!config.csv_path.empty()) {
+            WriteCsv(results, config.csv_path);
+        }
+        if (!config.json_path.empty()) {
+            WriteJsonResults(results, config, config.json_path);
+        }
+    } catch (const ImageProcessorException& exc) {
+        std::cerr << exc.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "exceptions.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <semaphore>
+#include <thread>
+
+// Lock-free multi-producer multi-consumer queue of fixed capacity. Every cell has a sequence number telling whether
+// it is ready to be written or read on the current lap, so producers and consumers only contend on their own index.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(const size_t capacity) : capacity_(capacity), cells_(new Cell[capacity]) {
+        if (capacity == 0) {
+            throw InternalException("queue capacity must be positive");
+        }
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    // Returns false if the queue is full.
+    bool TryPush(T value) {
+        return TryPushFrom(value);
+    }
+
+    // Moves from the value only if it was pushed, so that the caller can retry with it.
+    bool TryPushFrom(T& value) {
+        size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[position % capacity_];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position) {
+                return false;
+            } else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns nullopt if the queue is empty.
+    std::optional<T> TryPop() {
+        size_t position = dequeue_position_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[position % capacity_];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position + 1) {
+                if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    std::optional<T> value = std::move(cell.value);
+                    cell.value.reset();
+                    cell.sequence.store(position + capacity_, std::memory_order_release);
+                    return value;
+                }
+            } else if (sequence < position + 1) {
+                return std::nullopt;
+            } else {
+                position = dequeue_position_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of elements, exact when there are no concurrent operations.
+    size_t GetSize() const {
+        const size_t enqueued = enqueue_position_.load(std::memory_order_relaxed);
+        const size_t dequeued = dequeue_position_.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+    const size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_position_ = 0;
+    alignas(64) std::atomic<size_t> dequeue_position_ = 0;
+};
+
+// Bounded queue blocking producers while it is full and consumers while it is empty. Semaphores count free and filled
+// cells. A cell counted as free may still be claimed by a consumer which has not published it yet, and the same holds
+// for filled cells and producers, so the lock-free operations are retried until that consumer or producer finishes.
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(const size_t capacity)
+        : queue_(capacity), free_slots_(static_cast<ptrdiff_t>(capacity)), filled_slots_(0) {
+    }
+
+    void Push(T value) {
+        free_slots_.acquire();
+        while (!queue_.TryPushFrom(value)) {
+            std::this_thread::yield();
+        }
+        filled_slots_.release();
+    }
+
+    T Pop() {
+        filled_slots_.acquire();
+        std::optional<T> value = queue_.TryPop();
+        while (!value.has_value()) {
+            std::this_thread::yield();
+            value = queue_.TryPop();
+        }
+        free_slots_.release();
+        return std::move(*value);
+    }
+
+    size_t GetSize() const {
+        return queue_.GetSize();
+    }
+
+private:
+    BoundedQueue<T> queue_;
+    std::counting_semaphore<> free_slots_;
+    std::counting_semaphore<> filled_slots_;
+};
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "cache.h"
+
+#include "controller.h"
+#include "exceptions.h"
+#include "factories/base_factory.h"
+#include "io.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+uint64_t GetFnvHash(const std::string_view data, uint64_t hash) {
+    for (const char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t GetMurmurHash(const std::string_view data, const uint64_t seed) {
+    constexpr uint64_t Multiplier = 0xc6a4a7935bd1e995ULL;
+    constexpr int Shift = 47;
+    uint64_t hash = seed ^ (data.size() * Multiplier);
+    const size_t blocks = data.size() / sizeof(uint64_t);
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t block = 0;
+        std::memcpy(&block, data.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+        block *= Multiplier;
+        block ^= block >> Shift;
+        block *= Multiplier;
+        hash ^= block;
+        hash *= Multiplier;
+    }
+    const std::string_view tail = data.substr(blocks * sizeof(uint64_t));
+    if (!tail.empty()) {
+        for (size_t i = 0; i < tail.size(); ++i) {
+            hash ^= static_cast<uint64_t>(static_cast<unsigned char>(tail[i])) << (8 * i);
+        }
+        hash *= Multiplier;
+    }
+    hash ^= hash >> Shift;
+    hash *= Multiplier;
+    hash ^= hash >> Shift;
+    return hash;
+}
+
+InputKey GetInputKey(const std::string_view data) {
+    return InputKey{GetFnvHash(data), data.size(), GetMurmurHash(data)};
+}
+
+std::string GetCanonicalFilter(const FilterInput& filter) {
+    std::string result = "-" + filter.name;
+    for (const std::string& param : filter.params) {
+        result += " ";
+        try {
+            char buffer[32];
+            const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), ConvertToDouble(param));
+            result.append(buffer, end);
+        } catch (const InternalException&) {
+            result += param;
+        }
+    }
+    return result;
+}
+
+const std::string CACHE_MAGIC = "IPCACHE2";
+const std::string CACHE_EXTENSION = ".cache";
+
+template <typename T>
+void WriteRaw(std::ostream& out, const T* data, const size_t count) {
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+template <typename T>
+bool ReadRaw(std::istream& in, T* data, const size_t count) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(count * sizeof(T))));
+}
+
+ResultCache::ResultCache(std::string directory, const uint64_t max_bytes)
+    : directory_(std::move(directory)), max_bytes_(max_bytes) {
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    if (!std::filesystem::is_directory(directory_, error)) {
+        throw UsageException("could not create cache directory " + directory_);
+    }
+}
+
+std::string ResultCache::GetPath(const InputKey& input, const std::string& prefix) const {
+    std::ostringstream name;
+    name << std::hex << input.hash << "-" << GetFnvHash(prefix) << CACHE_EXTENSION;
+    return (std::filesystem::path(directory_) / name.str()).string();
+}
+
+std::optional<Image> ResultCache::Load(const InputKey& input, const std::string& prefix) {
+    const std::string path = GetPath(input, prefix);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return std::nullopt;
+    }
+    std::string magic(CACHE_MAGIC.size(), '\0');
+    uint64_t stored_input[2] = {};
+    uint64_t prefix_size = 0;
+    if (!ReadRaw(in, magic.data(), magic.size()) || magic != CACHE_MAGIC || !ReadRaw(in, stored_input, 2) ||
+        stored_input[0] != input.size || stored_input[1] != input.check || !ReadRaw(in, &prefix_size, 1) ||
+        prefix_size != prefix.size()) {
+        return std::nullopt;
+    }
+    // Hashes of different prefixes may collide, so the prefix itself is kept in the file.
+    std::string stored_prefix(prefix_size, '\0');
+    uint64_t header[4] = {};
+    if (!ReadRaw(in, stored_prefix.data(), stored_prefix.size()) || stored_prefix != prefix ||
+        !ReadRaw(in, header, std::size(header))) {
+        return std::nullopt;
+    }
+    const auto [height, width, channels, is_mask] = header;
+    if (channels != GRAYSCALE_CHANNELS && channels != RGB_CHANNELS) {
+        return std::nullopt;
+    }
+    // Sizes from a corrupt or truncated file must not reach the allocations, so they are checked against the rest of
+    // the file first.
+    const std::streampos position = in.tellg();
+    const std::streampos end = in.seekg(0, std::ios::end).tellg();
+    if (!in.seekg(position) || end < position || height == 0 || width == 0) {
+        return std::nullopt;
+    }
+    const auto remaining = static_cast<uint64_t>(end - position);
+    // Every row takes at least one bit per pixel.
+    constexpr uint64_t BitsInByte = 8;
+    if (width / BitsInByte > remaining) {
+        return std::nullopt;
+    }
+    const uint64_t row_size =
+        is_mask != 0 ? GetMaskStride(width) * sizeof(uint64_t) : width * channels * sizeof(double);
+    if (remaining % row_size != 0 || height != remaining / row_size) {
+        return std::nullopt;
+    }
+
+    Image image;
+    if (is_mask != 0) {
+        std::vector<uint64_t> mask(height * GetMaskStride(width));
+        if (!ReadRaw(in, mask.data(), mask.size())) {
+            return std::nullopt;
+        }
+        image.SetMask(height, width, std::move(mask));
+    } else {
+        image = Image(height, width, channels);
+        for (size_t i = 0; i < height; ++i) {
+            if (!ReadRaw(in, image.GetMutableRow(i), width * channels)) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return image;
+}
+
+void ResultCache::Store(const InputKey& input, const std::string& prefix, const Image& image) {
+    const std::string path = GetPath(input, prefix);
+    // Readers never see partially written files, because the file is renamed after it is complete. The temporary name
+    // is unique among the threads of all processes sharing the directory.
+    const std::string temporary_path = path + ".tmp" + std::to_string(getpid()) + "-" +
+                                       std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(temporary_path, std::ios::binary);
+        if (!out.is_open()) {
+            return;
+        }
+        const uint64_t stored_input[2] = {input.size, input.check};
+        const uint64_t prefix_size = prefix.size();
+        const uint64_t header[4] = {image.GetHeight(), image.GetWidth(), image.GetChannels(), image.IsMask()};
+        WriteRaw(out, CACHE_MAGIC.data(), CACHE_MAGIC.size());
+        WriteRaw(out, stored_input, std::size(stored_input));
+        WriteRaw(out, &prefix_size, 1);
+        WriteRaw(out, prefix.data(), prefix.size());
+        WriteRaw(out, header, std::size(header));
+        if (image.IsMask()) {
+            constexpr size_t WordSize = 64;
+            std::vector<uint64_t> row(GetMaskStride(image.GetWidth()));
+            for (size_t i = 0; i < image.GetHeight(); ++i) {
+                std::fill(row.begin(), row.end(), 0);
+                for (size_t j = 0; j < image.GetWidth(); ++j) {
+                    row[j / WordSize] |= static_cast<uint64_t>(image.GetMaskBit(i, j)) << (j % WordSize);
+                }
+                WriteRaw(out, row.data(), row.size());
+            }
+        } else {
+            for (size_t i = 0; i < image.GetHeight(); ++i) {
+                WriteRaw(out, image.GetRow(i), image.GetWidth() * image.GetChannels());
+            }
+        }
+        if (!out) {
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temporary_path, error);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    Evict();
+}
+
+void ResultCache::Evict() {
+    std::lock_guard lock(evict_mutex_);
+    struct Entry {
+        std::filesystem::file_time_type last_used;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total_size = 0;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(directory_, error)) {
+        if (file.path().extension() != CACHE_EXTENSION) {
+            continue;
+        }
+        std::error_code file_error;
+        const uint64_t size = file.file_size(file_error);
+        const auto last_used = file.last_write_time(file_error);
+        if (!file_error) {
+            entries.push_back(Entry{last_used, size, file.path()});
+            total_size += size;
+        }
+    }
+    if (total_size <= max_bytes_) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+    for (const Entry& entry : entries) {
+        if (total_size <= max_bytes_) {
+            break;
+        }
+        std::filesystem::remove(entry.path, error);
+        total_size -= entry.size;
+    }
+}
+
+Image ReadAndApplyFilters(const std::string& input_path, const std::vector<FilterInput>& inputs,
+                          const std::vector<std::shared_ptr<BaseFilter>>& filters, ResultCache& cache) {
+    std::ifstream file;
+    if (input_path != STDIO_PATH) {
+        file.open(input_path, std::ios::binary);
+        if (!file.is_open()) {
+            throw ReadException("could not open " + input_path);
+        }
+    }
+    std::istream& source = input_path == STDIO_PATH ? std::cin : file;
+    const std::string data((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    const InputKey input = GetInputKey(data);
+
+    std::vector<std::string> prefixes(inputs.size() + 1);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        prefixes[i + 1] = prefixes[i] + GetCanonicalFilter(inputs[i]) + "\n";
+    }
+
+    Image image;
+    size_t applied = 0;
+    for (size_t i = inputs.size(); i > 0; --i) {
+        if (std::optional<Image> cached = cache.Load(input, prefixes[i])) {
+            image = std::move(*cached);
+            applied = i;
+            break;
+        }
+    }
+    if (applied == 0) {
+        std::istringstream in(data);
+        image = ReadImage(in);
+    }
+
+    // Stored images must not depend on the rest of the chain, so regions of interest are not propagated here.
+    for (size_t i = applied; i < filters.size(); ++i) {
+        ApplyFilters(image, {filters[i]});
+        cache.Store(input, prefixes[i + 1], image);
+    }
+    return image;
+}
+
+std::unique_ptr<ResultCache> CreateResultCache(const std::unordered_map<std::string, std::string>& options) {
+    if (!options.contains("cache-dir")) {
+        return nullptr;
+    }
+    constexpr uint64_t DefaultCacheMegabytes = 1024;
+    constexpr uint64_t BytesInMegabyte = 1 << 20;
+    const uint64_t megabytes = GetPositiveOption(options, "cache-size").value_or(DefaultCacheMegabytes);
+    return std::make_unique<ResultCache>(options.at("cache-dir"), megabytes * BytesInMegabyte);
+}
\ No newline at end of file
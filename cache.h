@@ -0,0 +1,65 @@
+#pragma once
+
+#include "filters/base_filter.h"
+#include "image.h"
+#include "parser.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+// 64-bit FNV-1a hash, continues from the given hash.
+uint64_t GetFnvHash(std::string_view data, uint64_t hash = FNV_OFFSET_BASIS);
+
+// 64-bit MurmurHash64A, independent of FNV-1a.
+uint64_t GetMurmurHash(std::string_view data, uint64_t seed = 0);
+
+// Content address of an input. The FNV-1a hash names the cache files, the size and the second hash are kept in them,
+// so that inputs with colliding names do not share results.
+struct InputKey {
+    uint64_t hash = 0;
+    uint64_t size = 0;
+    uint64_t check = 0;
+};
+
+InputKey GetInputKey(std::string_view data);
+
+// Filter with numeric parameters written in the shortest form, so that "-blur 2.0" and "-blur 2" are the same filter.
+std::string GetCanonicalFilter(const FilterInput& filter);
+
+// Images after prefixes of filter chains are stored in the directory, one file per input and prefix. Files are exact
+// copies of the intermediate images, so resuming from them gives the same result as applying the whole chain. When the
+// directory grows over the size limit, least recently used files are removed. The cache can be shared by several
+// threads and processes, failures to read or write it only make it miss.
+class ResultCache {
+public:
+    ResultCache(std::string directory, uint64_t max_bytes);
+
+    // prefix is the canonical chain of filters applied to the input with the given key.
+    std::optional<Image> Load(const InputKey& input, const std::string& prefix);
+    void Store(const InputKey& input, const std::string& prefix, const Image& image);
+
+private:
+    std::string GetPath(const InputKey& input, const std::string& prefix) const;
+    void Evict();
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    std::mutex evict_mutex_;
+};
+
+// Reads the input and applies the filters, resuming from the longest prefix of the chain cached for this input. Images
+// after every applied filter are stored in the cache. inputs describe filters and must have the same length.
+Image ReadAndApplyFilters(const std::string& input_path, const std::vector<FilterInput>& inputs,
+                          const std::vector<std::shared_ptr<BaseFilter>>& filters, ResultCache& cache);
+
+// Cache from the --cache-dir and --cache-size options, or nullptr if the cache is not enabled.
+std::unique_ptr<ResultCache> CreateResultCache(const std::unordered_map<std::string, std::string>& options);
\ No newline at end of file
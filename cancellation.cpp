@@ -0,0 +1,65 @@
+#include "cancellation.h"
+
+#include "exceptions.h"
+
+namespace {
+thread_local const CancellationToken* current_token = nullptr;
+}  // namespace
+
+CancellationToken::CancellationToken() : cancelled_(std::make_shared<std::atomic<bool>>(false)) {
+}
+
+CancellationToken::CancellationToken(const std::chrono::steady_clock::time_point deadline)
+    : cancelled_(std::make_shared<std::atomic<bool>>(false)), deadline_(deadline) {
+}
+
+void CancellationToken::Cancel() const {
+    cancelled_->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::IsCancelled() const {
+    if (cancelled_->load(std::memory_order_relaxed)) {
+        return true;
+    }
+    if (deadline_.has_value() && std::chrono::steady_clock::now() >= *deadline_) {
+        // Later checks do not need the clock.
+        Cancel();
+        return true;
+    }
+    return false;
+}
+
+void CancellationToken::ThrowIfCancelled() const {
+    if (!IsCancelled()) {
+        return;
+    }
+    if (deadline_.has_value() && std::chrono::steady_clock::now() >= *deadline_) {
+        throw CancelledException("deadline exceeded");
+    }
+    throw CancelledException("job was cancelled");
+}
+
+CancellationToken CreateCancellationToken(const std::optional<std::chrono::milliseconds> time_limit) {
+    if (!time_limit.has_value()) {
+        return CancellationToken();
+    }
+    return CancellationToken(std::chrono::steady_clock::now() + *time_limit);
+}
+
+const CancellationToken* GetCurrentCancellationToken() {
+    return current_token;
+}
+
+void CheckCancellation() {
+    if (current_token != nullptr) {
+        current_token->ThrowIfCancelled();
+    }
+}
+
+CancellationScope::CancellationScope(const CancellationToken* token) : previous_(current_token) {
+    current_token = token;
+}
+
+CancellationScope::~CancellationScope() {
+    current_token = previous_;
+}
\ No newline at end of file
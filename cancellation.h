@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+
+// Shared flag telling a job to stop, optionally raised automatically at the deadline. Copies of the token refer to
+// the same flag, so the job can be cancelled from another thread.
+class CancellationToken {
+public:
+    CancellationToken();
+    explicit CancellationToken(std::chrono::steady_clock::time_point deadline);
+
+    void Cancel() const;
+    bool IsCancelled() const;
+    // Throws CancelledException if the token is cancelled or the deadline has passed.
+    void ThrowIfCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+};
+
+// Token with the deadline time_limit from now, or without a deadline.
+CancellationToken CreateCancellationToken(std::optional<std::chrono::milliseconds> time_limit);
+
+// Every thread has a current token, the one of the job it is working on. Long loops of filters and the FFT call
+// CheckCancellation at row or tile granularity. ParallelFor passes the current token of the caller to the tasks.
+const CancellationToken* GetCurrentCancellationToken();
+
+// Throws CancelledException if the current token is cancelled, does nothing if there is no current token.
+void CheckCancellation();
+
+// Makes the token current on this thread until the scope ends.
+class CancellationScope {
+public:
+    explicit CancellationScope(const CancellationToken* token);
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+    ~CancellationScope();
+
+private:
+    const CancellationToken* previous_;
+};
\ No newline at end of file
@@ -1,6 +1,12 @@
 #include "controller.h"
 
 #include "exceptions.h"
+#include "filters/fft_filters.h"
+#include "io.h"
+#include "spectrum_file.h"
+
+#include <algorithm>
+#include <cstdint>
 
 std::vector<std::shared_ptr<BaseFilter>> CreateFilters(const std::vector<FilterInput>& filters_input) {
     std::vector<std::shared_ptr<BaseFilter>> filters;
@@ -14,8 +20,220 @@ std::vector<std::shared_ptr<BaseFilter>> CreateFilters(const std::vector<FilterI
     return filters;
 }
 
+std::vector<Rect> GetRegionsOfInterest(const std::vector<std::shared_ptr<BaseFilter>>& filters) {
+    const Rect whole_image{0, 0, SIZE_MAX, SIZE_MAX};
+    std::vector<Rect> regions(filters.size(), whole_image);
+    Rect region = whole_image;
+    for (size_t i = filters.size(); i-- > 0;) {
+        region = filters[i]->GetRequiredRegion(region).value_or(whole_image);
+        regions[i] = region;
+    }
+    return regions;
+}
+
+std::optional<size_t> GetPositiveOption(const std::unordered_map<std::string, std::string>& options,
+                                        const std::string& name) {
+    auto option = options.find(name);
+    if (option == options.end()) {
+        return std::nullopt;
+    }
+    size_t value = 0;
+    try {
+        value = ConvertToSizeT(option->second);
+    } catch (const InternalException&) {
+        throw UsageException("could not parse value of --" + name + " into non-negative integer");
+    }
+    if (value == 0) {
+        throw UsageException("value of --" + name + " must be positive");
+    }
+    return value;
+}
+
+std::optional<std::chrono::milliseconds> GetDeadline(const std::unordered_map<std::string, std::string>& options) {
+    if (const std::optional<size_t> milliseconds = GetPositiveOption(options, "deadline")) {
+        return std::chrono::milliseconds(*milliseconds);
+    }
+    return std::nullopt;
+}
+
+std::optional<uint16_t> GetBitCount(const std::unordered_map<std::string, std::string>& options) {
+    if (const std::optional<size_t> bit_count = GetPositiveOption(options, "bits")) {
+        if (*bit_count != PALETTE4_BITS && *bit_count != PALETTE8_BITS && *bit_count != RGB_BITS &&
+            *bit_count != RGBX_BITS) {
+            throw UsageException("--bits must be 4, 8, 24 or 32");
+        }
+        return static_cast<uint16_t>(*bit_count);
+    }
+    return std::nullopt;
+}
+
+std::optional<ImageFormat> GetOutputFormat(const std::unordered_map<std::string, std::string>& options) {
+    if (const auto option = options.find("format"); option != options.end()) {
+        return ParseImageFormat(option->second);
+    }
+    return std::nullopt;
+}
+
+JsonValue InspectImage(const std::string& filename) {
+    JsonValue::Object report{{"path", filename}};
+    ImageHeader header;
+    try {
+        header = ReadImageHeader(filename);
+    } catch (const ImageProcessorException& exc) {
+        report.emplace_back("valid", false);
+        report.emplace_back("error", exc.what());
+        return report;
+    }
+    const std::unordered_map<ImageFormat, std::string> format_names = {
+        {ImageFormat::Bmp, "bmp"}, {ImageFormat::Ppm, "ppm"}, {ImageFormat::Pgm, "pgm"}, {ImageFormat::Raw, "raw"}};
+    std::string compression = "none";
+    if (header.rle) {
+        compression = header.bit_count == PALETTE4_BITS ? "rle4" : "rle8";
+    }
+    report.emplace_back("valid", true);
+    report.emplace_back("format", format_names.at(header.format));
+    report.emplace_back("width", static_cast<double>(header.shape.width));
+    report.emplace_back("height", static_cast<double>(header.shape.height));
+    report.emplace_back("channels", static_cast<double>(header.shape.channels));
+    report.emplace_back("bits", static_cast<double>(header.bit_count));
+    report.emplace_back("compression", compression);
+    return report;
+}
+
+std::optional<ImageShape> GetRawShape(const std::unordered_map<std::string, std::string>& options) {
+    const auto option = options.find("raw-size");
+    if (option == options.end()) {
+        return std::nullopt;
+    }
+    std::vector<size_t> values;
+    try {
+        size_t begin = 0;
+        while (begin <= option->second.size()) {
+            const size_t end = std::min(option->second.find('x', begin), option->second.size());
+            values.push_back(ConvertToSizeT(option->second.substr(begin, end - begin)));
+            begin = end + 1;
+        }
+    } catch (const InternalException&) {
+        values.clear();
+    }
+    if (values.size() < 2 || values.size() > 3 || values[0] == 0 || values[1] == 0) {
+        throw UsageException("--raw-size must be given as WIDTHxHEIGHT or WIDTHxHEIGHTxCHANNELS");
+    }
+    const size_t channels = values.size() == 3 ? values[2] : RGB_CHANNELS;
+    if (channels != GRAYSCALE_CHANNELS && channels != RGB_CHANNELS) {
+        throw UsageException("raw images must have 1 or 3 channels");
+    }
+    return ImageShape{values[1], values[0], channels, false};
+}
+
+void ConfigureThreads(const std::unordered_map<std::string, std::string>& options) {
+    if (const std::optional<size_t> threads_count = GetPositiveOption(options, "threads")) {
+        SetThreadsCount(*threads_count);
+    }
+}
+
+void CropToRegion(Image& image, const Rect& region) {
+    // Only the bottom and the right sides are cut off, so that coordinates of the remaining pixels do not change.
+    const size_t height = std::min(image.GetHeight(), SaturatingAdd(region.top, region.height));
+    const size_t width = std::min(image.GetWidth(), SaturatingAdd(region.left, region.width));
+    if (height < image.GetHeight() || width < image.GetWidth()) {
+        image.Crop(Rect{0, 0, height, width});
+    }
+}
+
 void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters) {
-    for (const auto& filter : filters) {
-        filter->Apply(image);
+    const std::vector<Rect> regions = GetRegionsOfInterest(filters);
+    for (size_t i = 0; i < filters.size(); ++i) {
+        CheckCancellation();
+        CropToRegion(image, regions[i]);
+        filters[i]->Apply(image);
+    }
+}
+
+void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters,
+                  const std::vector<FilterInput>& inputs, Profiler* profiler) {
+    if (inputs.size() != filters.size()) {
+        throw InternalException("every filter must have its input");
+    }
+    const std::vector<Rect> regions = GetRegionsOfInterest(filters);
+    for (size_t i = 0; i < filters.size(); ++i) {
+        MeasureStage(profiler, inputs[i].name, "filter", [&] {
+            CheckCancellation();
+            CropToRegion(image, regions[i]);
+            filters[i]->Apply(image);
+        });
+    }
+}
+
+std::optional<std::vector<ChannelLut>> ComposeLuts(const std::vector<std::shared_ptr<BaseFilter>>& filters) {
+    std::vector<TransferFunction> functions;
+    for (const std::shared_ptr<BaseFilter>& filter : filters) {
+        std::optional<TransferFunction> function = filter->GetTransferFunction();
+        if (!function.has_value()) {
+            return std::nullopt;
+        }
+        functions.push_back(std::move(*function));
+    }
+    std::vector<ChannelLut> luts(RGB_CHANNELS);
+    for (size_t channel = 0; channel < RGB_CHANNELS; ++channel) {
+        for (size_t value = 0; value <= COLOR_MAX_VALUE; ++value) {
+            double result = static_cast<double>(value) / COLOR_MAX_VALUE;
+            for (const TransferFunction& function : functions) {
+                result = function(result, channel);
+            }
+            luts[channel][value] = static_cast<uint8_t>(result * COLOR_MAX_VALUE);
+        }
+    }
+    return luts;
+}
+
+size_t FindFirstFFTFilter(const std::vector<std::shared_ptr<BaseFilter>>& filters) {
+    for (size_t i = 0; i < filters.size(); ++i) {
+        if (dynamic_cast<const FFTFilter*>(filters[i].get()) != nullptr) {
+            return i;
+        }
     }
+    return filters.size();
 }
+
+void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters,
+                  const std::vector<FilterInput>& inputs, Profiler* profiler, const SpectrumFiles& spectrum_files) {
+    if (inputs.size() != filters.size()) {
+        throw InternalException("every filter must have its input");
+    }
+    const size_t fft_index = FindFirstFFTFilter(filters);
+    if (fft_index == filters.size()) {
+        throw UsageException("spectrum files can be used only with an -fft-* filter in the chain");
+    }
+    if (spectrum_files.input_path.has_value() && fft_index != 0) {
+        throw UsageException("the chain started from a spectrum must begin with an -fft-* filter");
+    }
+    const auto split = [](const auto& chain, const size_t begin, const size_t end) {
+        return std::vector(chain.begin() + static_cast<std::ptrdiff_t>(begin),
+                           chain.begin() + static_cast<std::ptrdiff_t>(end));
+    };
+    ApplyFilters(image, split(filters, 0, fft_index), split(inputs, 0, fft_index), profiler);
+
+    const auto& fft_filter = dynamic_cast<const FFTFilter&>(*filters[fft_index]);
+    MeasureStage(profiler, inputs[fft_index].name, "filter", [&] {
+        CheckCancellation();
+        if (spectrum_files.input_path.has_value()) {
+            const MappedSpectrum mapped(*spectrum_files.input_path);
+            const ImageShape shape = mapped.GetImageShape();
+            const ImageFrequencyDomainRepresentation spectrum = mapped.GetRepresentation();
+            if (spectrum_files.output_path.has_value()) {
+                WriteSpectrum(*spectrum_files.output_path, spectrum, shape);
+            }
+            // Only the shape of the image is used by FFT filters given the spectrum.
+            image = Image(shape.height, shape.width, shape.channels);
+            fft_filter.ApplyToSpectrum(spectrum, image);
+            return;
+        }
+        const ImageFrequencyDomainRepresentation spectrum = FFT(image);
+        WriteSpectrum(*spectrum_files.output_path, spectrum, image.GetShape());
+        fft_filter.ApplyToSpectrum(spectrum, image);
+    });
+
+    ApplyFilters(image, split(filters, fft_index + 1, filters.size()), split(inputs, fft_index + 1, inputs.size()),
+                 profiler);
+}
\ No newline at end of file
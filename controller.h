@@ -1,18 +1,29 @@
 #pragma once
 
+#include "cancellation.h"
 #include "factories/base_factory.h"
+#include "factories/box_factory.h"
 #include "factories/crop_factory.h"
 #include "factories/edge_factory.h"
 #include "factories/fft_factories.h"
 #include "factories/gaussian_blur_factory.h"
 #include "factories/grayscale_factory.h"
+#include "factories/median_factory.h"
 #include "factories/negative_factory.h"
+#include "factories/resize_factory.h"
 #include "factories/sharpening_factory.h"
 #include "fft.h"
 #include "filters/base_filter.h"
+#include "io.h"
+#include "json.h"
 #include "parser.h"
+#include "profiler.h"
+#include "thread_pool.h"
 
+#include <chrono>
+#include <cstdint>
 #include <future>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -24,6 +35,10 @@ const std::unordered_map<std::string, std::shared_ptr<BaseFactory>> FACTORIES =
     {"gs", std::make_shared<GrayscaleFactory>()},
     {"neg", std::make_shared<NegativeFactory>()},
     {"sharp", std::make_shared<SharpeningFactory>()},
+    {"box", std::make_shared<BoxFactory>(REPLICATE_BORDER)},
+    {"localmean", std::make_shared<BoxFactory>(EXCLUDE_BORDER)},
+    {"median", std::make_shared<MedianFactory>()},
+    {"resize", std::make_shared<ResizeFactory>()},
     {"fft-real", std::make_shared<FFTComponentFactory>(REAL_PART)},
     {"fft-imag", std::make_shared<FFTComponentFactory>(IMAGINARY_PART)},
     {"fft-magnitude", std::make_shared<FFTComponentFactory>(MAGNITUDE)},
@@ -34,4 +49,61 @@ const std::unordered_map<std::string, std::shared_ptr<BaseFactory>> FACTORIES =
 
 std::vector<std::shared_ptr<BaseFilter>> CreateFilters(const std::vector<FilterInput>& filters_input);
 
-void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters);
\ No newline at end of file
+// For every filter returns the part of its input that affects the final result. Crops are propagated backwards,
+// extended by halos of bounded-support filters, and reset by filters depending on the whole image.
+std::vector<Rect> GetRegionsOfInterest(const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// Returns the value of the option, which must be a positive integer, or nullopt if the option is not given.
+std::optional<size_t> GetPositiveOption(const std::unordered_map<std::string, std::string>& options,
+                                        const std::string& name);
+
+// Time limit of a job from the --deadline option in milliseconds, nullopt if the option is not given.
+std::optional<std::chrono::milliseconds> GetDeadline(const std::unordered_map<std::string, std::string>& options);
+
+// Bits per pixel of written files from the --bits option, nullopt if they are chosen by the image.
+std::optional<uint16_t> GetBitCount(const std::unordered_map<std::string, std::string>& options);
+
+// Format of written files from the --format option, nullopt if it is chosen by the extension.
+std::optional<ImageFormat> GetOutputFormat(const std::unordered_map<std::string, std::string>& options);
+
+// Report of --info and --validate for the file: its path, "valid", and either the format, width, height, channels,
+// bits per pixel and compression from the headers or the error.
+JsonValue InspectImage(const std::string& filename);
+
+// Shape of a raw input from the --raw-size option given as WIDTHxHEIGHT or WIDTHxHEIGHTxCHANNELS, 3 channels by
+// default. Nullopt if the input is not raw.
+std::optional<ImageShape> GetRawShape(const std::unordered_map<std::string, std::string>& options);
+
+// Sets the number of threads from the --threads option, by default all hardware threads are used.
+void ConfigureThreads(const std::unordered_map<std::string, std::string>& options);
+
+// Cuts off the part of the image below and to the right of the region.
+void CropToRegion(Image& image, const Rect& region);
+
+// Filters stop with CancelledException when the current cancellation token of the thread is cancelled.
+void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// If the profiler is given, every filter is recorded under the name from its input.
+void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters,
+                  const std::vector<FilterInput>& inputs, Profiler* profiler);
+
+// Lookup tables of the red, green and blue channels if every filter of the chain is pointwise, std::nullopt otherwise.
+// Values go through the transfer functions as doubles and are rounded to bytes only at the end, as in ApplyFilters, so
+// the tables give the same bytes as filtering the decoded image.
+std::optional<std::vector<ChannelLut>> ComposeLuts(const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// Index of the first filter working on the spectrum of the image, the size of the chain if there is none.
+size_t FindFirstFFTFilter(const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// Spectrum files of the first FFT filter of the chain, from --from-spectrum and --save-spectrum.
+struct SpectrumFiles {
+    // The chain starts from this spectrum instead of the image and its first filter must be an FFT filter.
+    std::optional<std::string> input_path;
+    // The spectrum used by the first FFT filter is saved here.
+    std::optional<std::string> output_path;
+};
+
+// Filters before the first FFT filter are applied to the image as usual. Since FFT filters depend on the whole image,
+// splitting the chain there does not change the regions of interest.
+void ApplyFilters(Image& image, const std::vector<std::shared_ptr<BaseFilter>>& filters,
+                  const std::vector<FilterInput>& inputs, Profiler* profiler, const SpectrumFiles& spectrum_files);
\ No newline at end of file
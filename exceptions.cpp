@@ -24,6 +24,18 @@ WriteException::WriteException(const std::string& message) {
     message_ = "could not write to file: " + message;
 }
 
+JsonException::JsonException(const std::string& message) {
+    message_ = "invalid JSON: " + message;
+}
+
+CancelledException::CancelledException(const std::string& message) {
+    message_ = "cancelled: " + message;
+}
+
+MemoryLimitException::MemoryLimitException(const std::string& message) {
+    message_ = "memory limit exceeded: " + message;
+}
+
 InternalException::InternalException(const std::string& message) {
     message_ = "internal exception: " + message;
 }
\ No newline at end of file
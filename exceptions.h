@@ -36,6 +36,23 @@ public:
     explicit WriteException(const std::string& message);
 };
 
+class JsonException : public ImageProcessorException {
+public:
+    explicit JsonException(const std::string& message);
+};
+
+// The job was cancelled or did not finish before its deadline.
+class CancelledException : public ImageProcessorException {
+public:
+    explicit CancelledException(const std::string& message);
+};
+
+// The estimated memory of a job is above the limit, the job is refused before decoding.
+class MemoryLimitException : public ImageProcessorException {
+public:
+    explicit MemoryLimitException(const std::string& message);
+};
+
 class InternalException : public ImageProcessorException {
 public:
     explicit InternalException(const std::string& message);
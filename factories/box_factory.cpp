@@ -0,0 +1,26 @@
+#include "box_factory.h"
+
+#include "../exceptions.h"
+
+BoxFactory::BoxFactory(const BoxBorder border) : border_(border) {
+}
+
+std::shared_ptr<BaseFilter> BoxFactory::Create(const std::vector<std::string>& params) {
+    if (params.size() != 1) {
+        throw UsageException("box filter has exactly 1 parameter");
+    }
+
+    size_t radius = 0;
+    try {
+        radius = ConvertToSizeT(params[0]);
+    } catch (InternalException) {
+        throw UsageException("could not parse box filter parameter into non-negative integer");
+    }
+    // Larger windows cover any image anyway, the limit keeps the window side within int64_t.
+    constexpr size_t MaxRadius = 1 << 30;
+    if (radius > MaxRadius) {
+        throw UsageException("radius of box filter must be at most " + std::to_string(MaxRadius));
+    }
+
+    return std::make_shared<BoxFilter>(radius, border_);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "base_factory.h"
+#include "../filters/box_filter.h"
+
+class BoxFactory : public BaseFactory {
+public:
+    explicit BoxFactory(BoxBorder border);
+
+    std::shared_ptr<BaseFilter> Create(const std::vector<std::string>& params) override;
+
+private:
+    BoxBorder border_;
+};
\ No newline at end of file
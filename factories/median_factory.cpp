@@ -0,0 +1,24 @@
+#include "median_factory.h"
+
+#include "../exceptions.h"
+#include "../filters/median_filter.h"
+
+std::shared_ptr<BaseFilter> MedianFactory::Create(const std::vector<std::string>& params) {
+    if (params.size() != 1) {
+        throw UsageException("median filter has exactly 1 parameter");
+    }
+
+    size_t radius = 0;
+    try {
+        radius = ConvertToSizeT(params[0]);
+    } catch (InternalException) {
+        throw UsageException("could not parse median filter parameter into non-negative integer");
+    }
+    // Every worker keeps the histograms of 2 * radius columns around its strip.
+    constexpr size_t MaxRadius = 1000;
+    if (radius > MaxRadius) {
+        throw UsageException("radius of median filter must be at most " + std::to_string(MaxRadius));
+    }
+
+    return std::make_shared<MedianFilter>(radius);
+}
\ No newline at end of file
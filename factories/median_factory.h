@@ -0,0 +1,8 @@
+#pragma once
+
+#include "base_factory.h"
+
+class MedianFactory : public BaseFactory {
+public:
+    std::shared_ptr<BaseFilter> Create(const std::vector<std::string>& params) override;
+};
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "resize_factory.h"
+
+#include "../exceptions.h"
+#include "../filters/resize_filter.h"
+
+#include <unordered_map>
+
+const std::unordered_map<std::string, ResampleMode> RESAMPLE_MODES = {
+    {"box", BOX_RESAMPLE},
+    {"bilinear", BILINEAR_RESAMPLE},
+    {"bicubic", BICUBIC_RESAMPLE},
+    {"lanczos", LANCZOS_RESAMPLE},
+};
+
+std::shared_ptr<BaseFilter> ResizeFactory::Create(const std::vector<std::string>& params) {
+    if (params.size() != 2 && params.size() != 3) {
+        throw UsageException("resize filter has 2 or 3 parameters");
+    }
+
+    size_t height = 0;
+    size_t width = 0;
+    try {
+        height = ConvertToSizeT(params[0]);
+        width = ConvertToSizeT(params[1]);
+    } catch (InternalException) {
+        throw UsageException("could not parse resize filter parameters into non-negative integers");
+    }
+    if (height == 0 || width == 0) {
+        throw UsageException("image after resize filter must not be empty");
+    }
+    if (static_cast<double>(width) > static_cast<double>(SIZE_MAX) / static_cast<double>(height)) {
+        throw UsageException("image after resize filter is too large");
+    }
+
+    ResampleMode mode = BICUBIC_RESAMPLE;
+    if (params.size() == 3) {
+        const auto found = RESAMPLE_MODES.find(params[2]);
+        if (found == RESAMPLE_MODES.end()) {
+            throw UsageException("resize filter mode must be box, bilinear, bicubic or lanczos");
+        }
+        mode = found->second;
+    }
+
+    return std::make_shared<ResizeFilter>(height, width, mode);
+}
\ No newline at end of file
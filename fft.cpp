@@ -1,5 +1,7 @@
 #include "fft.h"
 
+#include "cancellation.h"
+
 #include <algorithm>
 #include <iostream>
 
@@ -9,13 +11,17 @@ ImageFrequencyDomainRepresentation::ImageFrequencyDomainRepresentation() {
 }
 
 ImageFrequencyDomainRepresentation::ImageFrequencyDomainRepresentation(
-    const std::array<std::vector<std::vector<std::complex<double>>>, 3>& matrix) {
+    const std::vector<std::vector<std::vector<std::complex<double>>>>& matrix) {
     SetElements(matrix);
 }
 
 ImageFrequencyDomainRepresentation::ImageFrequencyDomainRepresentation(
-    std::array<std::vector<std::vector<std::complex<double>>>, 3>&& matrix) {
-    SetElements(matrix);
+    std::vector<std::vector<std::vector<std::complex<double>>>>&& matrix) {
+    SetElements(std::move(matrix));
+}
+
+size_t ImageFrequencyDomainRepresentation::GetChannels() const {
+    return matrix_.size();
 }
 
 size_t ImageFrequencyDomainRepresentation::GetHeight() const {
@@ -26,20 +32,31 @@ size_t ImageFrequencyDomainRepresentation::GetWidth() const {
     return width_;
 }
 
-std::array<std::complex<double>, 3> ImageFrequencyDomainRepresentation::GetElement(size_t i, size_t j) const {
+std::vector<std::complex<double>> ImageFrequencyDomainRepresentation::GetElement(size_t i, size_t j) const {
     if (i > GetHeight() || j > GetWidth()) {
         throw InternalException("GetElement coordinates are out of bounds");
     }
-    return {matrix_[0][i][j], matrix_[1][i][j], matrix_[2][i][j]};
+    std::vector<std::complex<double>> element(GetChannels());
+    for (size_t color = 0; color < GetChannels(); ++color) {
+        element[color] = matrix_[color][i][j];
+    }
+    return element;
 }
 
-std::array<std::vector<std::vector<std::complex<double>>>, 3> ImageFrequencyDomainRepresentation::GetElements() const {
+std::vector<std::vector<std::vector<std::complex<double>>>> ImageFrequencyDomainRepresentation::GetElements() const {
     return matrix_;
 }
 
+const std::vector<std::complex<double>>& ImageFrequencyDomainRepresentation::GetRow(size_t color, size_t i) const {
+    if (color >= GetChannels() || i >= GetHeight()) {
+        throw InternalException("GetRow coordinates are out of bounds");
+    }
+    return matrix_[color][i];
+}
+
 void ImageFrequencyDomainRepresentation::SetElements(
-    const std::array<std::vector<std::vector<std::complex<double>>>, 3>& matrix) {
-    for (size_t color = 0; color < 3; ++color) {
+    const std::vector<std::vector<std::vector<std::complex<double>>>>& matrix) {
+    for (size_t color = 0; color < matrix.size(); ++color) {
         const size_t height = matrix[color].size();
         if (color > 0 && matrix[color - 1].size() != height) {
             throw InternalException(
@@ -62,7 +79,7 @@ void ImageFrequencyDomainRepresentation::SetElements(
     }
 
     matrix_ = matrix;
-    height_ = matrix[0].size();
+    height_ = matrix.empty() ? 0 : matrix[0].size();
     if (height_ == 0) {
         width_ = 0;
     } else {
@@ -71,8 +88,8 @@ void ImageFrequencyDomainRepresentation::SetElements(
 }
 
 void ImageFrequencyDomainRepresentation::SetElements(
-    std::array<std::vector<std::vector<std::complex<double>>>, 3>&& matrix) {
-    for (size_t color = 0; color < 3; ++color) {
+    std::vector<std::vector<std::vector<std::complex<double>>>>&& matrix) {
+    for (size_t color = 0; color < matrix.size(); ++color) {
         const size_t height = matrix[color].size();
         if (color > 0 && matrix[color - 1].size() != height) {
             throw InternalException(
@@ -95,7 +112,7 @@ void ImageFrequencyDomainRepresentation::SetElements(
     }
 
     matrix_ = std::move(matrix);
-    height_ = matrix_[0].size();
+    height_ = matrix_.empty() ? 0 : matrix_[0].size();
     if (height_ == 0) {
         width_ = 0;
     } else {
@@ -104,15 +121,18 @@ void ImageFrequencyDomainRepresentation::SetElements(
 }
 
 ImageFrequencyDomainRepresentation ConvertToFrequencyDomainRepresentation(const Image& image) {
-    std::array<std::vector<std::vector<std::complex<double>>>, 3> result;
-    std::fill(result.begin(), result.end(),
-              std::vector(image.GetHeight(), std::vector<std::complex<double>>(image.GetWidth())));
+    Image expanded = image;
+    expanded.ExpandMask();
+    const size_t channels = expanded.GetChannels();
+    std::vector<std::vector<std::vector<std::complex<double>>>> result(
+        channels, std::vector(image.GetHeight(), std::vector<std::complex<double>>(image.GetWidth())));
 
     for (size_t i = 0; i < image.GetHeight(); ++i) {
+        const double* row = expanded.GetRow(i);
         for (size_t j = 0; j < image.GetWidth(); ++j) {
-            result[0][i][j] = image.GetPixel(i, j).r;
-            result[1][i][j] = image.GetPixel(i, j).g;
-            result[2][i][j] = image.GetPixel(i, j).b;
+            for (size_t color = 0; color < channels; ++color) {
+                result[color][i][j] = row[j * channels + color];
+            }
         }
     }
 
@@ -126,39 +146,37 @@ Image ConvertToImage(const ImageFrequencyDomainRepresentation& fd, FFTComponent
         return Image();
     }
 
-    std::vector result(height, std::vector<Color>(width));
+    const size_t channels = fd.GetChannels();
+    Image result(height, width, channels);
     for (size_t i = 0; i < height; ++i) {
+        double* row = result.GetMutableRow(i);
         for (size_t j = 0; j < width; ++j) {
-            std::array<std::complex<double>, 3> element;
+            std::vector<std::complex<double>> element;
             if (rearrange) {
                 element = fd.GetElement((i + height / 2) % height, (j + width / 2) % width);
             } else {
                 element = fd.GetElement(i, j);
             }
 
-            if (component == REAL_PART) {
-                result[i][j].r = std::abs(element[0].real());
-                result[i][j].g = std::abs(element[1].real());
-                result[i][j].b = std::abs(element[2].real());
-            } else if (component == IMAGINARY_PART) {
-                result[i][j].r = std::abs(element[0].imag());
-                result[i][j].g = std::abs(element[1].imag());
-                result[i][j].b = std::abs(element[2].imag());
-            } else if (component == MAGNITUDE) {
-                result[i][j].r = std::abs(element[0]);
-                result[i][j].g = std::abs(element[1]);
-                result[i][j].b = std::abs(element[2]);
-            } else if (component == PHASE) {
-                result[i][j].r = std::arg(element[0]) / (2 * M_PI) + 1.0 / 2;
-                result[i][j].g = std::arg(element[1]) / (2 * M_PI) + 1.0 / 2;
-                result[i][j].b = std::arg(element[2]) / (2 * M_PI) + 1.0 / 2;
-            } else {
-                throw InternalException("unknown component given to ConvertToImage");
+            for (size_t color = 0; color < channels; ++color) {
+                double value = 0;
+                if (component == REAL_PART) {
+                    value = std::abs(element[color].real());
+                } else if (component == IMAGINARY_PART) {
+                    value = std::abs(element[color].imag());
+                } else if (component == MAGNITUDE) {
+                    value = std::abs(element[color]);
+                } else if (component == PHASE) {
+                    value = std::arg(element[color]) / (2 * M_PI) + 1.0 / 2;
+                } else {
+                    throw InternalException("unknown component given to ConvertToImage");
+                }
+                row[j * channels + color] = NormalizeColorValue(value);
             }
         }
     }
 
-    return Image(std::move(result));
+    return result;
 }
 
 size_t RoundUpToPowerOfTwo(size_t x) {
@@ -179,31 +197,55 @@ size_t FFTReverseIndex(size_t index, size_t n) {
     return result;
 }
 
+FFTPlan::FFTPlan(const size_t n, const bool inverse) : reverse(n), roots(n == 0 ? 0 : n - 1) {
+    constexpr size_t ByteSize = 8;
+    size_t lg_n = sizeof(size_t) * ByteSize - __builtin_clzll(n) - 1;
+    for (size_t i = 0; i < n; ++i) {
+        reverse[i] = FFTReverseIndex(i, lg_n);
+    }
+
+    // Powers are accumulated by multiplication, exactly as they would be computed inside of the butterfly loop.
+    for (size_t len = 2; len <= n; len *= 2) {
+        std::complex<double> root1_len = std::polar(1.0, 2 * M_PI / static_cast<double>(len) * (inverse ? 1 : -1));
+        std::complex<double> pwr(1, 0);
+        for (size_t k = 0; k < len / 2; ++k) {
+            roots[len / 2 - 1 + k] = pwr;
+            pwr *= root1_len;
+        }
+    }
+}
+
+const FFTPlan& GetFFTPlan(const size_t n, const bool inverse) {
+    thread_local std::unordered_map<size_t, FFTPlan> plans[2];
+    auto plan = plans[inverse].find(n);
+    if (plan == plans[inverse].end()) {
+        plan = plans[inverse].emplace(n, FFTPlan(n, inverse)).first;
+    }
+    return plan->second;
+}
+
 void FFT(std::vector<std::complex<double>>& a, bool inverse) {
     size_t n = a.size();
     if (RoundUpToPowerOfTwo(n) != n) {
         throw InternalException("FFT argument must has length equal to power of 2");
     }
-    constexpr size_t ByteSize = 8;
-    size_t lg_n = sizeof(size_t) * ByteSize - __builtin_clzll(n) - 1;
+    const FFTPlan& plan = GetFFTPlan(n, inverse);
 
     for (size_t i = 0; i < n; ++i) {
-        size_t pair = FFTReverseIndex(i, lg_n);
+        size_t pair = plan.reverse[i];
         if (i < pair) {
             std::swap(a[i], a[pair]);
         }
     }
 
     for (size_t len = 2; len <= n; len *= 2) {
-        std::complex<double> root1_len = std::polar(1.0, 2 * M_PI / static_cast<double>(len) * (inverse ? 1 : -1));
+        const std::complex<double>* roots = plan.roots.data() + len / 2 - 1;
         for (size_t i = 0; i < n; i += len) {
-            std::complex<double> pwr(1, 0);
             for (size_t j = i; j < i + len / 2; ++j) {
                 std::complex<double> x = a[j];
-                std::complex<double> y = pwr * a[j + len / 2];
+                std::complex<double> y = roots[j - i] * a[j + len / 2];
                 a[j] = x + y;
                 a[j + len / 2] = x - y;
-                pwr *= root1_len;
             }
         }
     }
@@ -224,21 +266,23 @@ ImageFrequencyDomainRepresentation FFT(const Image& image) {
 
     height = RoundUpToPowerOfTwo(height);
     width = RoundUpToPowerOfTwo(width);
-    std::array<std::vector<std::vector<std::complex<double>>>, 3> result =
+    std::vector<std::vector<std::vector<std::complex<double>>>> result =
         ConvertToFrequencyDomainRepresentation(image).GetElements();
-    for (size_t color = 0; color < 3; ++color) {
+    for (size_t color = 0; color < result.size(); ++color) {
         result[color].resize(height);
         for (size_t i = 0; i < height; ++i) {
             result[color][i].resize(width);
         }
     }
 
-    for (size_t color = 0; color < 3; ++color) {
+    std::vector<std::complex<double>> values(height);
+    for (size_t color = 0; color < result.size(); ++color) {
         for (size_t i = 0; i < height; ++i) {
+            CheckCancellation();
             FFT(result[color][i], false);
         }
         for (size_t j = 0; j < width; ++j) {
-            std::vector<std::complex<double>> values(height);
+            CheckCancellation();
             for (size_t i = 0; i < height; ++i) {
                 values[i] = result[color][i][j];
             }
@@ -262,20 +306,22 @@ Image InverseFFT(const ImageFrequencyDomainRepresentation& fd) {
     height = RoundUpToPowerOfTwo(height);
     width = RoundUpToPowerOfTwo(width);
 
-    std::array<std::vector<std::vector<std::complex<double>>>, 3> result = fd.GetElements();
-    for (size_t color = 0; color < 3; ++color) {
+    std::vector<std::vector<std::vector<std::complex<double>>>> result = fd.GetElements();
+    for (size_t color = 0; color < result.size(); ++color) {
         result[color].resize(height);
         for (size_t i = 0; i < height; ++i) {
             result[color][i].resize(width);
         }
     }
 
-    for (size_t color = 0; color < 3; ++color) {
+    std::vector<std::complex<double>> values(height);
+    for (size_t color = 0; color < result.size(); ++color) {
         for (size_t i = 0; i < height; ++i) {
+            CheckCancellation();
             FFT(result[color][i], true);
         }
         for (size_t j = 0; j < width; ++j) {
-            std::vector<std::complex<double>> values(height);
+            CheckCancellation();
             for (size_t i = 0; i < height; ++i) {
                 values[i] = result[color][i][j];
             }
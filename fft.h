@@ -8,25 +8,29 @@
 #include <unordered_map>
 #include <vector>
 
+// Every channel of the image is transformed separately, so the representation keeps one matrix per channel.
 class ImageFrequencyDomainRepresentation {
 public:
     ImageFrequencyDomainRepresentation();
 
     explicit ImageFrequencyDomainRepresentation(
-        const std::array<std::vector<std::vector<std::complex<double>>>, 3>& matrix);
-    explicit ImageFrequencyDomainRepresentation(std::array<std::vector<std::vector<std::complex<double>>>, 3>&& matrix);
+        const std::vector<std::vector<std::vector<std::complex<double>>>>& matrix);
+    explicit ImageFrequencyDomainRepresentation(std::vector<std::vector<std::vector<std::complex<double>>>>&& matrix);
 
+    size_t GetChannels() const;
     size_t GetHeight() const;
     size_t GetWidth() const;
 
-    std::array<std::complex<double>, 3> GetElement(size_t i, size_t j) const;
-    std::array<std::vector<std::vector<std::complex<double>>>, 3> GetElements() const;
+    std::vector<std::complex<double>> GetElement(size_t i, size_t j) const;
+    std::vector<std::vector<std::vector<std::complex<double>>>> GetElements() const;
+    // Row of one channel without copying the whole matrix.
+    const std::vector<std::complex<double>>& GetRow(size_t color, size_t i) const;
 
-    void SetElements(const std::array<std::vector<std::vector<std::complex<double>>>, 3>& matrix);
-    void SetElements(std::array<std::vector<std::vector<std::complex<double>>>, 3>&& matrix);
+    void SetElements(const std::vector<std::vector<std::vector<std::complex<double>>>>& matrix);
+    void SetElements(std::vector<std::vector<std::vector<std::complex<double>>>>&& matrix);
 
 private:
-    std::array<std::vector<std::vector<std::complex<double>>>, 3> matrix_;
+    std::vector<std::vector<std::vector<std::complex<double>>>> matrix_;
     size_t height_ = 0, width_ = 0;
 };
 
@@ -35,6 +39,20 @@ enum FFTComponent { REAL_PART, IMAGINARY_PART, MAGNITUDE, PHASE };
 const std::unordered_map<FFTComponent, std::string> COMPONENT_NAMES = {
     {REAL_PART, "real part"}, {IMAGINARY_PART, "imaginary part"}, {MAGNITUDE, "magnitude"}, {PHASE, "phase"}};
 
+size_t RoundUpToPowerOfTwo(size_t x);
+
+// Bit reversal permutation and powers of the roots of unity for the transform of length n. Powers used on the stage
+// with blocks of length len are stored from index len / 2 - 1.
+struct FFTPlan {
+    FFTPlan(size_t n, bool inverse);
+
+    std::vector<size_t> reverse;
+    std::vector<std::complex<double>> roots;
+};
+
+// Plans are computed once per thread and reused by all following transforms of the same length.
+const FFTPlan& GetFFTPlan(size_t n, bool inverse);
+
 ImageFrequencyDomainRepresentation ConvertToFrequencyDomainRepresentation(const Image& image);
 
 Image ConvertToImage(const ImageFrequencyDomainRepresentation& fd, FFTComponent component, bool rearrange = false);
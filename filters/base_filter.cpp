@@ -2,5 +2,36 @@
 
 #include "../exceptions.h"
 
+#include <algorithm>
+#include <cstdint>
+
+std::optional<size_t> BaseFilter::GetHalo() const {
+    return std::nullopt;
+}
+
+std::optional<Rect> BaseFilter::GetRequiredRegion(const Rect& output) const {
+    const std::optional<size_t> halo = GetHalo();
+    if (!halo.has_value()) {
+        return std::nullopt;
+    }
+    const size_t top = output.top - std::min(output.top, *halo);
+    const size_t left = output.left - std::min(output.left, *halo);
+    return Rect{top, left, SaturatingAdd(output.top - top, SaturatingAdd(output.height, *halo)),
+                SaturatingAdd(output.left - left, SaturatingAdd(output.width, *halo))};
+}
+
+FilterMemory BaseFilter::EstimateMemory(const ImageShape& input) const {
+    const uint64_t output_bytes = GetImageBytes(input);
+    return FilterMemory{input, output_bytes, output_bytes};
+}
+
+std::optional<TransferFunction> BaseFilter::GetTransferFunction() const {
+    return std::nullopt;
+}
+
 BaseFilter::~BaseFilter() {
-}
\ No newline at end of file
+}
+
+size_t SaturatingAdd(const size_t a, const size_t b) {
+    return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
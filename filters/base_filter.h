@@ -2,9 +2,41 @@
 
 #include "../image.h"
 
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+// New value of a channel value of the given channel, 0 is the red channel and the only channel of grayscale images.
+using TransferFunction = std::function<double(double value, size_t channel)>;
+
+// Estimate of the memory a filter needs, used to admit jobs before decoding.
+struct FilterMemory {
+    ImageShape output;
+    // Bytes allocated at the peak of the filter in addition to the buffer of the input, the output included.
+    uint64_t peak_bytes = 0;
+    // Size of the buffer holding the output, std::nullopt if the output is a view of the input buffer.
+    std::optional<uint64_t> output_bytes;
+};
+
 class BaseFilter {
 public:
     virtual void Apply(Image& image) const = 0;
 
+    // Distance from the output pixel to the farthest input pixel it depends on, std::nullopt if any pixel of the
+    // output may depend on the whole image.
+    virtual std::optional<size_t> GetHalo() const;
+
+    // Part of the input needed to compute the given part of the output, std::nullopt if the whole input is needed.
+    virtual std::optional<Rect> GetRequiredRegion(const Rect& output) const;
+
+    // By default the output is written to a new buffer of the same shape.
+    virtual FilterMemory EstimateMemory(const ImageShape& input) const;
+
+    // Pointwise filters map every channel value on its own and keep the shape of the image, so chains of them can be
+    // applied to 8-bit values as lookup tables. Std::nullopt for other filters.
+    virtual std::optional<TransferFunction> GetTransferFunction() const;
+
     virtual ~BaseFilter();
-};
\ No newline at end of file
+};
+
+size_t SaturatingAdd(size_t a, size_t b);
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "box_filter.h"
+
+#include "../cancellation.h"
+#include "../thread_pool.h"
+#include "integral_image.h"
+#include "tiled_filter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+BoxFilter::BoxFilter(const size_t radius, const BoxBorder border) : radius_(radius), border_(border) {
+}
+
+void BoxFilter::Apply(Image& image) const {
+    if (radius_ == 0) {
+        return;
+    }
+    image.ExpandMask();
+    const IntegralImage table(image);
+    const size_t height = image.GetHeight();
+    const size_t width = image.GetWidth();
+    const size_t channels = image.GetChannels();
+    const size_t side = 2 * radius_ + 1;
+    const double window_normalization = 1.0 / static_cast<double>(side * side);
+    const int64_t radius = static_cast<int64_t>(radius_);
+
+    Image result(height, width, channels);
+    const std::vector<Rect> tiles = SplitIntoTiles(height, width, GetThreadPool().GetThreadsCount());
+    GetThreadPool().ParallelFor(tiles.size(), [&](const size_t index) {
+        const Rect& tile = tiles[index];
+        std::vector<double> sums(channels);
+        for (size_t i = tile.top; i < tile.top + tile.height; ++i) {
+            CheckCancellation();
+            double* dst_row = result.GetMutableRow(i);
+            const size_t top = i - std::min(i, radius_);
+            const size_t bottom = std::min(height, i + radius_ + 1);
+            for (size_t j = tile.left; j < tile.left + tile.width; ++j) {
+                double normalization = window_normalization;
+                if (border_ == REPLICATE_BORDER) {
+                    table.GetClampedSums(static_cast<int64_t>(i) - radius, static_cast<int64_t>(j) - radius, side, side,
+                                         sums.data());
+                } else {
+                    const size_t left = j - std::min(j, radius_);
+                    const size_t right = std::min(width, j + radius_ + 1);
+                    table.GetSums(Rect{top, left, bottom - top, right - left}, sums.data());
+                    normalization = 1.0 / static_cast<double>((bottom - top) * (right - left));
+                }
+                for (size_t c = 0; c < channels; ++c) {
+                    dst_row[j * channels + c] = NormalizeColorValue(sums[c] * normalization);
+                }
+            }
+        }
+    });
+    image = std::move(result);
+}
+
+std::optional<size_t> BoxFilter::GetHalo() const {
+    return radius_;
+}
+
+FilterMemory BoxFilter::EstimateMemory(const ImageShape& input) const {
+    if (radius_ == 0) {
+        return FilterMemory{input, 0, std::nullopt};
+    }
+    ImageShape src = input;
+    uint64_t expanded_bytes = 0;
+    if (input.is_mask) {
+        src = ImageShape{input.height, input.width, GRAYSCALE_CHANNELS, false};
+        expanded_bytes = GetImageBytes(src);
+    }
+    const uint64_t output_bytes = GetImageBytes(src);
+    return FilterMemory{src, expanded_bytes + GetIntegralImageBytes(src) + output_bytes, output_bytes};
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "base_filter.h"
+
+// Pixels of the window outside of the image are either taken from the nearest border, as in convolutions, or left out
+// of the mean.
+enum BoxBorder { REPLICATE_BORDER, EXCLUDE_BORDER };
+
+// Mean of the (2 * radius + 1) x (2 * radius + 1) window around every pixel, found from the integral image of the
+// input, so the cost per pixel does not depend on the radius.
+class BoxFilter : public BaseFilter {
+public:
+    BoxFilter(size_t radius, BoxBorder border);
+
+    void Apply(Image& image) const override;
+
+    std::optional<size_t> GetHalo() const override;
+
+    // The integral image is kept along with the output.
+    FilterMemory EstimateMemory(const ImageShape& input) const override;
+
+private:
+    size_t radius_;
+    BoxBorder border_;
+};
\ No newline at end of file
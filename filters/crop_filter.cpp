@@ -1,18 +1,36 @@
 #include "crop_filter.h"
 
-#include <vector>
+#include <algorithm>
 
 CropFilter::CropFilter(size_t height, size_t width) : height_(height), width_(width) {
 }
 
 void CropFilter::Apply(Image& image) const {
-    const size_t new_height = std::min(height_, image.GetHeight());
-    const size_t new_width = std::min(width_, image.GetWidth());
-    std::vector pixels(new_height, std::vector<Color>(new_width));
-    for (size_t i = 0; i < new_height; ++i) {
-        for (size_t j = 0; j < new_width; ++j) {
-            pixels[i][j] = image.GetPixel(i, j);
-        }
+    image.Crop(Rect{0, 0, std::min(height_, image.GetHeight()), std::min(width_, image.GetWidth())});
+}
+
+void CropFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    const size_t channels = src.GetChannels();
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        std::copy(src.GetRow(i) + rect.left * channels, src.GetRow(i) + (rect.left + rect.width) * channels,
+                  dst.GetMutableRow(i) + rect.left * channels);
     }
-    image.SetPixels(std::move(pixels));
 }
+
+std::optional<size_t> CropFilter::GetHalo() const {
+    return 0;
+}
+
+std::optional<Rect> CropFilter::GetRequiredRegion(const Rect& output) const {
+    const size_t top = std::min(output.top, height_);
+    const size_t left = std::min(output.left, width_);
+    return Rect{top, left, std::min(output.height, height_ - top), std::min(output.width, width_ - left)};
+}
+
+
+FilterMemory CropFilter::EstimateMemory(const ImageShape& input) const {
+    ImageShape output = input;
+    output.height = std::min(height_, input.height);
+    output.width = std::min(width_, input.width);
+    return FilterMemory{output, 0, std::nullopt};
+}
\ No newline at end of file
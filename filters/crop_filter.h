@@ -1,12 +1,18 @@
 #pragma once
 
-#include "base_filter.h"
+#include "tiled_filter.h"
 
-class CropFilter : public BaseFilter {
+// Crop only changes the view of the image; ApplyRegion copies pixels for the cases when a separate buffer is needed.
+class CropFilter : public TiledFilter {
 public:
     CropFilter(size_t height, size_t width);
 
     void Apply(Image& image) const override;
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
+    std::optional<Rect> GetRequiredRegion(const Rect& output) const override;
+    FilterMemory EstimateMemory(const ImageShape& input) const override;
 
 private:
     size_t height_;
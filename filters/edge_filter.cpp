@@ -1,19 +1,64 @@
 #include "edge_filter.h"
 
-EdgeFilter::EdgeFilter(const double threshold)
-    : threshold_(threshold), matrix_filter_({{-1.0}, {-1.0, 4.0, -1.0}, {-1.0}}) {
+#include "grayscale_filter.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+EdgeFilter::EdgeFilter(const double threshold) : threshold_(threshold) {
 }
 
-void EdgeFilter::Apply(Image& image) const {
-    grayscale_filter_.Apply(image);
-    matrix_filter_.Apply(image);
-    std::vector pixels(image.GetHeight(), std::vector<Color>(image.GetWidth()));
-    for (size_t i = 0; i < image.GetHeight(); ++i) {
-        for (size_t j = 0; j < image.GetWidth(); ++j) {
-            if (image.GetPixel(i, j).r >= threshold_) {
-                pixels[i][j] = Color(1.0, 1.0, 1.0);
+void EdgeFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    if (rect.height == 0 || rect.width == 0) {
+        return;
+    }
+    const size_t height = src.GetHeight();
+    const size_t width = src.GetWidth();
+    const size_t channels = src.GetChannels();
+    const size_t first_column = rect.left == 0 ? 0 : rect.left - 1;
+    const size_t last_column = std::min(width, rect.left + rect.width + 1);
+    const size_t ring_width = last_column - first_column;
+
+    // Luminance of rows i - 1, i and i + 1 are kept in the ring buffer in slots (i - 1) % 3, i % 3 and (i + 1) % 3.
+    constexpr size_t RingSize = 3;
+    std::vector<double> ring(RingSize * ring_width);
+    std::array<size_t, RingSize> ring_rows;
+    ring_rows.fill(SIZE_MAX);
+    auto get_luminance_row = [&](const size_t i) {
+        double* row = ring.data() + (i % RingSize) * ring_width;
+        if (ring_rows[i % RingSize] != i) {
+            const double* src_row = src.GetRow(i);
+            for (size_t j = first_column; j < last_column; ++j) {
+                row[j - first_column] = GetLuminance(src_row, j, channels);
+            }
+            ring_rows[i % RingSize] = i;
+        }
+        return row;
+    };
+
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        const double* up = get_luminance_row(i == 0 ? 0 : i - 1);
+        const double* down = get_luminance_row(i + 1 < height ? i + 1 : i);
+        const std::array<const double*, RingSize> rows = {up, get_luminance_row(i), down};
+        uint64_t* mask_row = dst.GetMutableMaskRow(i);
+        for (size_t j = rect.left; j < rect.left + rect.width; ++j) {
+            const size_t left = (j == 0 ? 0 : j - 1) - first_column;
+            const size_t right = (j + 1 < width ? j + 1 : j) - first_column;
+            const double value = Convolve<LAPLACIAN_KERNEL, double>(rows, {left, j - first_column, right});
+            if (NormalizeColorValue(value) >= threshold_) {
+                constexpr size_t WordSize = 64;
+                mask_row[j / WordSize] |= static_cast<uint64_t>(1) << (j % WordSize);
             }
         }
     }
-    image.SetPixels(std::move(pixels));
+}
+
+std::optional<size_t> EdgeFilter::GetHalo() const {
+    return 1;
+}
+
+ImageShape EdgeFilter::GetOutputShape(const ImageShape& src) const {
+    return ImageShape{src.height, src.width, GRAYSCALE_CHANNELS, true};
 }
@@ -1,17 +1,18 @@
 #pragma once
 
-#include "base_filter.h"
-#include "grayscale_filter.h"
-#include "matrix_filter.h"
+#include "tiled_filter.h"
 
-class EdgeFilter : public BaseFilter {
+class EdgeFilter : public TiledFilter {
 public:
     explicit EdgeFilter(double threshold);
 
-    void Apply(Image& image) const override;
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
+
+protected:
+    ImageShape GetOutputShape(const ImageShape& src) const override;
 
 private:
     double threshold_;
-    GrayscaleFilter grayscale_filter_;
-    MatrixFilter matrix_filter_;
 };
\ No newline at end of file
@@ -5,38 +5,83 @@
 #include <algorithm>
 #include <iostream>
 
+void FFTFilter::Apply(Image& image) const {
+    ApplyToSpectrum(FFT(image), image);
+}
+
+uint64_t GetSpectrumBytes(const ImageShape& shape) {
+    return shape.height * shape.width * shape.channels * sizeof(std::complex<double>);
+}
+
+FilterMemory FFTFilter::EstimateMemory(const ImageShape& input) const {
+    if (input.height == 0 || input.width == 0) {
+        return FilterMemory{input, 0, std::nullopt};
+    }
+    const ImageShape expanded{input.height, input.width, input.is_mask ? GRAYSCALE_CHANNELS : input.channels, false};
+    const ImageShape padded{RoundUpToPowerOfTwo(input.height), RoundUpToPowerOfTwo(input.width), expanded.channels,
+                            false};
+    // The unpadded spectrum is built from the expanded image and copied once before it is padded.
+    const uint64_t unpadded_bytes = GetSpectrumBytes(expanded);
+    const uint64_t expanded_bytes = input.is_mask ? GetImageBytes(expanded) : 0;
+    const uint64_t transform_bytes =
+        std::max(expanded_bytes + 2 * unpadded_bytes, unpadded_bytes + GetSpectrumBytes(padded));
+
+    FilterMemory memory = EstimateSpectrumMemory(expanded, padded);
+    memory.peak_bytes = std::max(transform_bytes, GetSpectrumBytes(padded) + memory.peak_bytes);
+    return memory;
+}
+
+FilterMemory FFTFilter::EstimateSpectrumMemory(const ImageShape& input, const ImageShape& padded) const {
+    // The spectrum is copied to be modified and once more by the inverse transform, whose padded result is cropped to
+    // the size of the input.
+    constexpr uint64_t SpectrumCopies = 2;
+    const uint64_t output_bytes = GetImageBytes(padded);
+    return FilterMemory{input, SpectrumCopies * GetSpectrumBytes(padded) + output_bytes, output_bytes};
+}
+
 FFTComponentFilter::FFTComponentFilter(FFTComponent type, double coefficient, bool verbose)
     : type_(type), coefficient_(coefficient), verbose_(verbose) {
 }
 
-void FFTComponentFilter::Apply(Image& image) const {
-    auto pixels = ConvertToImage(FFT(image), type_, true).GetPixels();
+void FFTComponentFilter::ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const {
+    Image result = ConvertToImage(spectrum, type_, true);
+    const size_t channels = result.GetChannels();
     std::vector<double> values;
-    for (size_t i = 0; i < pixels.size(); ++i) {
-        for (size_t j = 0; j < pixels[i].size(); ++j) {
+    for (size_t i = 0; i < result.GetHeight(); ++i) {
+        double* row = result.GetMutableRow(i);
+        for (size_t k = 0; k < result.GetWidth() * channels; ++k) {
             if (verbose_) {
-                values.push_back(pixels[i][j].r);
-                values.push_back(pixels[i][j].g);
-                values.push_back(pixels[i][j].b);
+                // Every value of a grayscale image stands for three equal color values.
+                values.insert(values.end(), RGB_CHANNELS / channels, row[k]);
             }
-            pixels[i][j] = pixels[i][j] * coefficient_;
+            row[k] = NormalizeColorValue(row[k] * coefficient_);
         }
     }
 
     if (verbose_) {
-        std::cout << "maximal values: ";
+        // Written to the error stream, the output image may go to the standard output.
+        std::cerr << "maximal values: ";
         std::sort(values.rbegin(), values.rend());
         constexpr size_t VerboseLength = 50;
         for (size_t i = 0; i < std::min(VerboseLength, values.size()); ++i) {
-            std::cout << values[i] << " ";
+            std::cerr << values[i] << " ";
         }
         if (values.size() > VerboseLength) {
-            std::cout << "...";
+            std::cerr << "...";
         }
-        std::cout << std::endl;
+        std::cerr << std::endl;
     }
 
-    image.SetPixels(std::move(pixels));
+    image = std::move(result);
+}
+
+FilterMemory FFTComponentFilter::EstimateSpectrumMemory(const ImageShape&, const ImageShape& padded) const {
+    const uint64_t output_bytes = GetImageBytes(padded);
+    uint64_t peak_bytes = output_bytes;
+    if (verbose_) {
+        peak_bytes += padded.height * padded.width * RGB_CHANNELS * sizeof(double);
+    }
+    return FilterMemory{padded, peak_bytes, output_bytes};
 }
 
 size_t GetDistToOrigin(const size_t i, const size_t j, const size_t height, const size_t width) {
@@ -46,18 +91,18 @@ size_t GetDistToOrigin(const size_t i, const size_t j, const size_t height, cons
 FFTLowPassFilter::FFTLowPassFilter(const double threshold) : threshold_(threshold) {
 }
 
-void FFTLowPassFilter::Apply(Image& image) const {
+void FFTLowPassFilter::ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const {
     if (image.GetHeight() == 0 || image.GetWidth() == 0) {
         return;
     }
 
-    auto fft = FFT(image).GetElements();
+    auto fft = spectrum.GetElements();
     const size_t height = fft[0].size();
     const size_t width = fft[0][0].size();
     const size_t new_height = static_cast<size_t>(std::round(static_cast<double>(height) * threshold_));
     const size_t new_width = static_cast<size_t>(std::round(static_cast<double>(width) * threshold_));
 
-    for (size_t color = 0; color < 3; ++color) {
+    for (size_t color = 0; color < fft.size(); ++color) {
         for (size_t i = 0; i < height; ++i) {
             for (size_t j = 0; j < width; ++j) {
                 if (std::min(i, height - i - 1) > new_height || std::min(j, width - j - 1) > new_width) {
@@ -69,26 +114,26 @@ void FFTLowPassFilter::Apply(Image& image) const {
 
     const CropFilter crop(image.GetHeight(), image.GetWidth());
 
-    Image result = InverseFFT(ImageFrequencyDomainRepresentation(fft));
+    Image result = InverseFFT(ImageFrequencyDomainRepresentation(std::move(fft)));
     crop.Apply(result);
-    image.SetPixels(result.GetPixels());
+    image = std::move(result);
 }
 
 FFTHighPassFilter::FFTHighPassFilter(const double threshold) : threshold_(threshold) {
 }
 
-void FFTHighPassFilter::Apply(Image& image) const {
+void FFTHighPassFilter::ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const {
     if (image.GetHeight() == 0 || image.GetWidth() == 0) {
         return;
     }
 
-    auto fft = FFT(image).GetElements();
+    auto fft = spectrum.GetElements();
     const size_t height = fft[0].size();
     const size_t width = fft[0][0].size();
     const size_t new_height = static_cast<size_t>(std::round(static_cast<double>(height) * threshold_));
     const size_t new_width = static_cast<size_t>(std::round(static_cast<double>(width) * threshold_));
 
-    for (size_t color = 0; color < 3; ++color) {
+    for (size_t color = 0; color < fft.size(); ++color) {
         for (size_t i = 0; i < height; ++i) {
             for (size_t j = 0; j < width; ++j) {
                 if (std::min(i, height - i - 1) < new_height && std::min(j, width - j - 1) < new_width) {
@@ -100,9 +145,9 @@ void FFTHighPassFilter::Apply(Image& image) const {
 
     const CropFilter crop(image.GetHeight(), image.GetWidth());
 
-    Image result = InverseFFT(ImageFrequencyDomainRepresentation(fft));
+    Image result = InverseFFT(ImageFrequencyDomainRepresentation(std::move(fft)));
     crop.Apply(result);
-    image.SetPixels(result.GetPixels());
+    image = std::move(result);
 }
 
 FFTPeaksFilter::FFTPeaksFilter(const double threshold) : threshold_(threshold) {
@@ -112,18 +157,18 @@ FFTPeaksFilter::FFTPeaksFilter(const double threshold, const double safe_height,
     : threshold_(threshold), safe_height_(safe_height), safe_width_(safe_width) {
 }
 
-void FFTPeaksFilter::Apply(Image& image) const {
+void FFTPeaksFilter::ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const {
     if (image.GetHeight() == 0 || image.GetWidth() == 0) {
         return;
     }
 
-    auto fft = FFT(image).GetElements();
+    auto fft = spectrum.GetElements();
     const size_t height = fft[0].size();
     const size_t width = fft[0][0].size();
     const size_t safe_height = static_cast<size_t>(std::round(static_cast<double>(height) * safe_height_));
     const size_t safe_width = static_cast<size_t>(std::round(static_cast<double>(width) * safe_width_));
 
-    for (size_t color = 0; color < 3; ++color) {
+    for (size_t color = 0; color < fft.size(); ++color) {
         for (size_t i = 0; i < fft[color].size(); ++i) {
             for (size_t j = 0; j < fft[color][i].size(); ++j) {
                 if (std::min(i, height - i - 1) < safe_height && std::min(j, width - j - 1) < safe_width) {
@@ -138,7 +183,7 @@ void FFTPeaksFilter::Apply(Image& image) const {
 
     const CropFilter crop(image.GetHeight(), image.GetWidth());
 
-    Image result = InverseFFT(ImageFrequencyDomainRepresentation(fft));
+    Image result = InverseFFT(ImageFrequencyDomainRepresentation(std::move(fft)));
     crop.Apply(result);
-    image.SetPixels(result.GetPixels());
+    image = std::move(result);
 }
\ No newline at end of file
@@ -3,11 +3,30 @@
 #include "../fft.h"
 #include "base_filter.h"
 
-class FFTComponentFilter : public BaseFilter {
+// Filter working on the frequency domain representation of the image. When several filters are applied to the same
+// image, the representation can be computed once and given to all of them.
+class FFTFilter : public BaseFilter {
+public:
+    void Apply(Image& image) const final;
+
+    // Replaces the image with the result, spectrum must be the representation of the image.
+    virtual void ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const = 0;
+
+    FilterMemory EstimateMemory(const ImageShape& input) const final;
+
+protected:
+    // Memory taken by ApplyToSpectrum in addition to the input and the spectrum of the padded shape.
+    virtual FilterMemory EstimateSpectrumMemory(const ImageShape& input, const ImageShape& padded) const;
+};
+
+class FFTComponentFilter : public FFTFilter {
 public:
     explicit FFTComponentFilter(FFTComponent type, double coefficient, bool verbose);
 
-    void Apply(Image& image) const override;
+    void ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const override;
+
+protected:
+    FilterMemory EstimateSpectrumMemory(const ImageShape& input, const ImageShape& padded) const override;
 
 private:
     FFTComponent type_;
@@ -15,32 +34,32 @@ private:
     bool verbose_ = false;
 };
 
-class FFTLowPassFilter : public BaseFilter {
+class FFTLowPassFilter : public FFTFilter {
 public:
     explicit FFTLowPassFilter(double threshold);
 
-    void Apply(Image& image) const override;
+    void ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const override;
 
 private:
     double threshold_ = 1.0;
 };
 
-class FFTHighPassFilter : public BaseFilter {
+class FFTHighPassFilter : public FFTFilter {
 public:
     explicit FFTHighPassFilter(double threshold);
 
-    void Apply(Image& image) const override;
+    void ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const override;
 
 private:
     double threshold_ = 1.0;
 };
 
-class FFTPeaksFilter : public BaseFilter {
+class FFTPeaksFilter : public FFTFilter {
 public:
     explicit FFTPeaksFilter(double threshold);
     FFTPeaksFilter(double threshold, double safe_height, double safe_width);
 
-    void Apply(Image& image) const override;
+    void ApplyToSpectrum(const ImageFrequencyDomainRepresentation& spectrum, Image& image) const override;
 
 private:
     double threshold_ = 1.0;
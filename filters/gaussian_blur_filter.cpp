@@ -1,8 +1,68 @@
 #include "gaussian_blur_filter.h"
 
+#include "../cancellation.h"
+#include "kernels.h"
+
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 
+// Separable blur of the tile, for_each_tap(function) calls function(distance, weight) for every tap.
+template <typename ForEachTap>
+void BlurRegion(const Image& src, Image& dst, const Rect& rect, const size_t halo, const double normalization,
+                ForEachTap&& for_each_tap) {
+    const int64_t height = static_cast<int64_t>(src.GetHeight());
+    const int64_t width = static_cast<int64_t>(src.GetWidth());
+    const int64_t first_column = std::max<int64_t>(0, static_cast<int64_t>(rect.left) - static_cast<int64_t>(halo));
+    const int64_t last_column = std::min(width, static_cast<int64_t>(rect.left + rect.width + halo));
+    const int64_t channels = static_cast<int64_t>(src.GetChannels());
+
+    // Vertical pass is computed for the columns of the tile and its halo, then the horizontal pass uses them.
+    std::vector<double> column_sums((last_column - first_column) * channels);
+    for (int64_t i = static_cast<int64_t>(rect.top); i < static_cast<int64_t>(rect.top + rect.height); ++i) {
+        CheckCancellation();
+        std::fill(column_sums.begin(), column_sums.end(), 0.0);
+        for_each_tap([&](const int64_t k, const double weight) {
+            const double* up = src.GetRow(std::max<int64_t>(0, i - k));
+            const double* down = src.GetRow(std::min(height - 1, i + k));
+            for (int64_t index = first_column * channels; index < last_column * channels; ++index) {
+                double& sum = column_sums[index - first_column * channels];
+                sum += up[index] * weight;
+                if (k > 0) {
+                    sum += down[index] * weight;
+                }
+            }
+        });
+
+        double* dst_row = dst.GetMutableRow(i);
+        for (int64_t j = static_cast<int64_t>(rect.left); j < static_cast<int64_t>(rect.left + rect.width); ++j) {
+            for (int64_t c = 0; c < channels; ++c) {
+                double sum = 0;
+                for_each_tap([&](const int64_t k, const double weight) {
+                    sum += column_sums[(std::max<int64_t>(0, j - k) - first_column) * channels + c] * weight;
+                    if (k > 0) {
+                        sum += column_sums[(std::min(width - 1, j + k) - first_column) * channels + c] * weight;
+                    }
+                });
+                dst_row[j * channels + c] = NormalizeColorValue(sum * normalization);
+            }
+        }
+    }
+}
+
+template <size_t HalfSigmas>
+void BlurRegionWithFixedTaps(const Image& src, Image& dst, const Rect& rect, const double normalization) {
+    constexpr auto& Taps = GAUSSIAN_TAPS<HalfSigmas>;
+    BlurRegion(src, dst, rect, Taps.size() - 1, normalization, [](auto&& function) {
+        Unroll<Taps.size()>([&](auto k) { function(decltype(k)::value, Taps[decltype(k)::value]); });
+    });
+}
+
+// FIXED_BLUR_REGION_FUNCTIONS[i] blurs with sigma equal to (i + 1) / 2.
+constexpr auto FIXED_BLUR_REGION_FUNCTIONS = []<size_t... Indexes>(std::index_sequence<Indexes...>) {
+    return std::array{&BlurRegionWithFixedTaps<Indexes + 1>...};
+}(std::make_index_sequence<MAX_FIXED_GAUSSIAN_HALF_SIGMAS>{});
+
 GaussianBlurFilter::GaussianBlurFilter(double sigma) {
     if (sigma < 0) {
         sigma *= -1;
@@ -10,6 +70,12 @@ GaussianBlurFilter::GaussianBlurFilter(double sigma) {
     sigma_ = sigma;
 
     max_distance_ = std::ceil(3 * sigma_);
+    const double half_sigmas = 2 * sigma_;
+    if (half_sigmas == std::floor(half_sigmas) && 1 <= half_sigmas && half_sigmas <= MAX_FIXED_GAUSSIAN_HALF_SIGMAS) {
+        fixed_region_function_ = FIXED_BLUR_REGION_FUNCTIONS[static_cast<size_t>(half_sigmas) - 1];
+        return;
+    }
+
     coefficients_.assign(max_distance_, 0);
     for (size_t x = 0; x < max_distance_; ++x) {
         coefficients_[x] = std::exp(-static_cast<double>(x) * static_cast<double>(x) / (2 * sigma * sigma));
@@ -20,35 +86,22 @@ void GaussianBlurFilter::Apply(Image& image) const {
     if (sigma_ == 0) {
         return;
     }
+    TiledFilter::Apply(image);
+}
 
-    std::vector pixels1(image.GetHeight(), std::vector<Color>(image.GetWidth()));
-    for (int32_t i = 0; i < image.GetHeight(); ++i) {
-        for (int32_t j = 0; j < image.GetWidth(); ++j) {
-            for (int32_t k = 0; k < max_distance_; ++k) {
-                pixels1[i][j] = pixels1[i][j] + image.GetPixel(std::max(0, i - k), j) * coefficients_[k];
-                if (k > 0) {
-                    pixels1[i][j] =
-                        pixels1[i][j] + image.GetPixel(std::min(static_cast<int32_t>(image.GetWidth()) - 1, i + k), j) *
-                                            coefficients_[k];
-                }
-            }
-        }
+void GaussianBlurFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    const double normalization = 1.0 / (2 * M_PI * sigma_ * sigma_);
+    if (fixed_region_function_ != nullptr) {
+        fixed_region_function_(src, dst, rect, normalization);
+        return;
     }
-
-    std::vector pixels2(image.GetHeight(), std::vector<Color>(image.GetWidth()));
-    for (int32_t i = 0; i < image.GetHeight(); ++i) {
-        for (int32_t j = 0; j < image.GetWidth(); ++j) {
-            for (int32_t k = 0; k < max_distance_; ++k) {
-                pixels2[i][j] = pixels2[i][j] + pixels1[i][std::max(0, j - k)] * coefficients_[k];
-                if (k > 0) {
-                    pixels2[i][j] =
-                        pixels2[i][j] +
-                        pixels1[i][std::min(static_cast<int32_t>(image.GetWidth()) - 1, j + k)] * coefficients_[k];
-                }
-            }
-            pixels2[i][j] = pixels2[i][j] * (1.0 / (2 * M_PI * sigma_ * sigma_));
+    BlurRegion(src, dst, rect, GetHalo().value(), normalization, [this](auto&& function) {
+        for (size_t k = 0; k < max_distance_; ++k) {
+            function(static_cast<int64_t>(k), coefficients_[k]);
         }
-    }
+    });
+}
 
-    image.SetPixels(std::move(pixels2));
+std::optional<size_t> GaussianBlurFilter::GetHalo() const {
+    return max_distance_ == 0 ? 0 : max_distance_ - 1;
 }
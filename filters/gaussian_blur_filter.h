@@ -1,15 +1,22 @@
 #pragma once
 
-#include "base_filter.h"
+#include "tiled_filter.h"
 
-class GaussianBlurFilter : public BaseFilter {
+class GaussianBlurFilter : public TiledFilter {
 public:
     explicit GaussianBlurFilter(double sigma);
 
     void Apply(Image& image) const override;
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
 
 private:
+    using RegionFunction = void (*)(const Image& src, Image& dst, const Rect& rect, double normalization);
+
     double sigma_;
     size_t max_distance_;
     std::vector<double> coefficients_;
+    // Set for sigmas with compile-time taps tables.
+    RegionFunction fixed_region_function_ = nullptr;
 };
\ No newline at end of file
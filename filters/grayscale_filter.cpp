@@ -3,14 +3,29 @@
 GrayscaleFilter::GrayscaleFilter() {
 }
 
-void GrayscaleFilter::Apply(Image& image) const {
-    std::vector pixels(image.GetHeight(), std::vector<Color>(image.GetWidth()));
-    for (size_t i = 0; i < image.GetHeight(); ++i) {
-        for (size_t j = 0; j < image.GetWidth(); ++j) {
-            const Color old_color = image.GetPixel(i, j);
-            const double new_color_value = old_color.r * 0.299 + old_color.g * 0.587 + old_color.b * 0.114;
-            pixels[i][j] = Color(new_color_value, new_color_value, new_color_value);
+void GrayscaleFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    const size_t channels = src.GetChannels();
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        const double* src_row = src.GetRow(i);
+        double* dst_row = dst.GetMutableRow(i);
+        for (size_t j = rect.left; j < rect.left + rect.width; ++j) {
+            dst_row[j] = GetLuminance(src_row, j, channels);
         }
     }
-    image.SetPixels(std::move(pixels));
+}
+
+std::optional<size_t> GrayscaleFilter::GetHalo() const {
+    return 0;
+}
+
+ImageShape GrayscaleFilter::GetOutputShape(const ImageShape& src) const {
+    return ImageShape{src.height, src.width, GRAYSCALE_CHANNELS, false};
+}
+
+double GetLuminance(const double* row, const size_t j, const size_t channels) {
+    const double* pixel = row + j * channels;
+    if (channels == GRAYSCALE_CHANNELS) {
+        return NormalizeColorValue(pixel[0] * 0.299 + pixel[0] * 0.587 + pixel[0] * 0.114);
+    }
+    return NormalizeColorValue(pixel[0] * 0.299 + pixel[1] * 0.587 + pixel[2] * 0.114);
 }
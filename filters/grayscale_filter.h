@@ -1,10 +1,18 @@
 #pragma once
 
-#include "base_filter.h"
+#include "tiled_filter.h"
 
-class GrayscaleFilter : public BaseFilter {
+class GrayscaleFilter : public TiledFilter {
 public:
     GrayscaleFilter();
 
-    void Apply(Image& image) const override;
-};
\ No newline at end of file
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
+
+protected:
+    ImageShape GetOutputShape(const ImageShape& src) const override;
+};
+
+// Luminance of the j-th pixel of the row of an image with the given number of channels.
+double GetLuminance(const double* row, size_t j, size_t channels);
\ No newline at end of file
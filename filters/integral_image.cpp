@@ -0,0 +1,137 @@
+#include "integral_image.h"
+
+#include "../cancellation.h"
+#include "../exceptions.h"
+#include "../thread_pool.h"
+
+#include <algorithm>
+
+IntegralImage::IntegralImage(const Image& image)
+    : height_(image.GetHeight()),
+      width_(image.GetWidth()),
+      channels_(image.GetChannels()),
+      sums_((height_ + 1) * (width_ + 1) * channels_, 0.0) {
+    if (image.IsMask()) {
+        throw InternalException("masks must be expanded before building the integral image");
+    }
+    const size_t stride = (width_ + 1) * channels_;
+    const size_t bands_count = std::clamp<size_t>(GetThreadPool().GetThreadsCount(), 1, std::max<size_t>(height_, 1));
+    const size_t band_rows = (height_ + bands_count - 1) / bands_count;
+
+    // Every band sums its rows along the row and then down the band, both passes go over contiguous memory.
+    GetThreadPool().ParallelFor(bands_count, [&](const size_t band) {
+        CheckCancellation();
+        const size_t end = std::min(height_, (band + 1) * band_rows);
+        for (size_t i = band * band_rows; i < end; ++i) {
+            const double* src = image.GetRow(i);
+            double* dst = sums_.data() + (i + 1) * stride + channels_;
+            for (size_t index = 0; index < width_ * channels_; ++index) {
+                dst[index] = dst[index - channels_] + src[index];
+            }
+            if (i > band * band_rows) {
+                const double* up = dst - stride;
+                for (size_t index = 0; index < width_ * channels_; ++index) {
+                    dst[index] += up[index];
+                }
+            }
+        }
+    });
+
+    // The last row of every band gets the sums of the bands above, then the other rows of the band add the last row of
+    // the previous band.
+    for (size_t band = 1; band < bands_count && band * band_rows < height_; ++band) {
+        double* last = sums_.data() + std::min(height_, (band + 1) * band_rows) * stride;
+        const double* carry = sums_.data() + band * band_rows * stride;
+        for (size_t index = 0; index < stride; ++index) {
+            last[index] += carry[index];
+        }
+    }
+    GetThreadPool().ParallelFor(bands_count, [&](const size_t band) {
+        if (band == 0 || band * band_rows >= height_) {
+            return;
+        }
+        const double* carry = sums_.data() + band * band_rows * stride;
+        const size_t end = std::min(height_, (band + 1) * band_rows);
+        for (size_t i = band * band_rows + 1; i < end; ++i) {
+            double* dst = sums_.data() + i * stride;
+            for (size_t index = 0; index < stride; ++index) {
+                dst[index] += carry[index];
+            }
+        }
+    });
+}
+
+size_t IntegralImage::GetHeight() const {
+    return height_;
+}
+
+size_t IntegralImage::GetWidth() const {
+    return width_;
+}
+
+size_t IntegralImage::GetChannels() const {
+    return channels_;
+}
+
+double IntegralImage::GetSum(const Rect& rect, const size_t channel) const {
+    const size_t stride = (width_ + 1) * channels_;
+    const double* top = sums_.data() + rect.top * stride + channel;
+    const double* bottom = sums_.data() + (rect.top + rect.height) * stride + channel;
+    const size_t left = rect.left * channels_;
+    const size_t right = (rect.left + rect.width) * channels_;
+    return bottom[right] - bottom[left] - top[right] + top[left];
+}
+
+void IntegralImage::GetSums(const Rect& rect, double* sums) const {
+    std::fill(sums, sums + channels_, 0.0);
+    AddSums(rect, 1.0, sums);
+}
+
+void IntegralImage::GetClampedSums(const int64_t top, const int64_t left, const size_t height, const size_t width,
+                                   double* sums) const {
+    const int64_t last_row = static_cast<int64_t>(height_) - 1;
+    const int64_t last_column = static_cast<int64_t>(width_) - 1;
+    const int64_t bottom = top + static_cast<int64_t>(height) - 1;
+    const int64_t right = left + static_cast<int64_t>(width) - 1;
+    // Rows of the window above and below the image repeat the first and the last row, columns do the same.
+    const double above = static_cast<double>(std::clamp<int64_t>(-top, 0, static_cast<int64_t>(height)));
+    const double below = static_cast<double>(std::clamp<int64_t>(bottom - last_row, 0, static_cast<int64_t>(height)));
+    const double before = static_cast<double>(std::clamp<int64_t>(-left, 0, static_cast<int64_t>(width)));
+    const double after = static_cast<double>(std::clamp<int64_t>(right - last_column, 0, static_cast<int64_t>(width)));
+    const int64_t inner_top = std::max<int64_t>(top, 0);
+    const int64_t inner_left = std::max<int64_t>(left, 0);
+    const size_t inner_height = static_cast<size_t>(std::max<int64_t>(0, std::min(bottom, last_row) - inner_top + 1));
+    const size_t inner_width = static_cast<size_t>(std::max<int64_t>(0, std::min(right, last_column) - inner_left + 1));
+    const size_t rows = static_cast<size_t>(inner_top);
+    const size_t columns = static_cast<size_t>(inner_left);
+
+    std::fill(sums, sums + channels_, 0.0);
+    AddSums(Rect{rows, columns, inner_height, inner_width}, 1.0, sums);
+    if (above == 0 && below == 0 && before == 0 && after == 0) {
+        return;
+    }
+    const size_t last_i = height_ - 1;
+    const size_t last_j = width_ - 1;
+    AddSums(Rect{0, columns, 1, inner_width}, above, sums);
+    AddSums(Rect{last_i, columns, 1, inner_width}, below, sums);
+    AddSums(Rect{rows, 0, inner_height, 1}, before, sums);
+    AddSums(Rect{rows, last_j, inner_height, 1}, after, sums);
+    AddSums(Rect{0, 0, 1, 1}, above * before, sums);
+    AddSums(Rect{0, last_j, 1, 1}, above * after, sums);
+    AddSums(Rect{last_i, 0, 1, 1}, below * before, sums);
+    AddSums(Rect{last_i, last_j, 1, 1}, below * after, sums);
+}
+
+void IntegralImage::AddSums(const Rect& rect, const double weight, double* sums) const {
+    if (rect.height == 0 || rect.width == 0 || weight == 0) {
+        return;
+    }
+    for (size_t c = 0; c < channels_; ++c) {
+        sums[c] += GetSum(rect, c) * weight;
+    }
+}
+
+uint64_t GetIntegralImageBytes(const ImageShape& shape) {
+    const size_t channels = shape.is_mask ? GRAYSCALE_CHANNELS : shape.channels;
+    return (shape.height + 1) * (shape.width + 1) * channels * sizeof(double);
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../image.h"
+
+#include <cstdint>
+#include <vector>
+
+// Summed-area table of an image: the sum of a channel over any rectangle takes four lookups, so filters averaging
+// windows of any radius cost the same per pixel.
+class IntegralImage {
+public:
+    // Rows are summed in parallel bands, then the sums of the bands are carried down as a prefix scan across rows.
+    explicit IntegralImage(const Image& image);
+
+    size_t GetHeight() const;
+    size_t GetWidth() const;
+    size_t GetChannels() const;
+
+    // Sum of the channel over the rectangle, which must lie inside the image.
+    double GetSum(const Rect& rect, size_t channel) const;
+
+    // Sums of every channel over the rectangle, written to sums[0], ..., sums[channels - 1].
+    void GetSums(const Rect& rect, double* sums) const;
+
+    // Sums of every channel over the window, whose pixels outside of the image are taken from the nearest border as in
+    // convolutions. The window may cross the borders by any amount.
+    void GetClampedSums(int64_t top, int64_t left, size_t height, size_t width, double* sums) const;
+
+private:
+    // Adds the sums over the rectangle multiplied by the weight, empty rectangles add nothing.
+    void AddSums(const Rect& rect, double weight, double* sums) const;
+
+    size_t height_ = 0;
+    size_t width_ = 0;
+    size_t channels_ = 0;
+    // (height + 1) x (width + 1) cells of channel sums over the pixels above and to the left, the first row and column
+    // are zero.
+    std::vector<double> sums_;
+};
+
+// Size of the table built for an image of the given shape.
+uint64_t GetIntegralImageBytes(const ImageShape& shape);
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "kernels.h"
+#include "tiled_filter.h"
+
+#include <algorithm>
+#include <array>
+
+// Convolution with a kernel known at compile time, pixels outside of the image are taken from the nearest border.
+template <const auto& K>
+class KernelFilter : public TiledFilter {
+public:
+    using KernelType = std::decay_t<decltype(K)>;
+
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override {
+        constexpr size_t CenterI = KernelType::HEIGHT / 2;
+        constexpr size_t CenterJ = KernelType::WIDTH / 2;
+        const size_t height = src.GetHeight();
+        const size_t width = src.GetWidth();
+        const size_t channels = src.GetChannels();
+        std::array<const double*, KernelType::HEIGHT> rows;
+        std::array<const double*, KernelType::HEIGHT> channel_rows;
+        std::array<size_t, KernelType::WIDTH> columns;
+        for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+            for (size_t mi = 0; mi < KernelType::HEIGHT; ++mi) {
+                rows[mi] = src.GetRow(std::clamp<size_t>(i + mi, CenterI, height - 1 + CenterI) - CenterI);
+            }
+            double* dst_row = dst.GetMutableRow(i);
+            for (size_t j = rect.left; j < rect.left + rect.width; ++j) {
+                for (size_t mj = 0; mj < KernelType::WIDTH; ++mj) {
+                    columns[mj] = (std::clamp<size_t>(j + mj, CenterJ, width - 1 + CenterJ) - CenterJ) * channels;
+                }
+                for (size_t c = 0; c < channels; ++c) {
+                    for (size_t mi = 0; mi < KernelType::HEIGHT; ++mi) {
+                        channel_rows[mi] = rows[mi] + c;
+                    }
+                    dst_row[j * channels + c] = NormalizeColorValue(Convolve<K, double>(channel_rows, columns));
+                }
+            }
+        }
+    }
+
+    std::optional<size_t> GetHalo() const override {
+        return std::max(KernelType::HEIGHT, KernelType::WIDTH) / 2;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Convolution kernels known at compile time. Filters take them as template parameters, so that loops over taps are
+// unrolled and taps with zero weights are skipped.
+
+template <size_t Height, size_t Width>
+struct Kernel {
+    static constexpr size_t HEIGHT = Height;
+    static constexpr size_t WIDTH = Width;
+
+    std::array<std::array<double, Width>, Height> weights;
+};
+
+inline constexpr Kernel<3, 3> SHARPENING_KERNEL = {{{{0.0, -1.0, 0.0}, {-1.0, 5.0, -1.0}, {0.0, -1.0, 0.0}}}};
+
+inline constexpr Kernel<3, 3> LAPLACIAN_KERNEL = {{{{0.0, -1.0, 0.0}, {-1.0, 4.0, -1.0}, {0.0, -1.0, 0.0}}}};
+
+inline constexpr Kernel<3, 3> SOBEL_X_KERNEL = {{{{-1.0, 0.0, 1.0}, {-2.0, 0.0, 2.0}, {-1.0, 0.0, 1.0}}}};
+
+inline constexpr Kernel<3, 3> SOBEL_Y_KERNEL = {{{{-1.0, -2.0, -1.0}, {0.0, 0.0, 0.0}, {1.0, 2.0, 1.0}}}};
+
+template <size_t Radius>
+constexpr Kernel<2 * Radius + 1, 2 * Radius + 1> MakeBoxKernel() {
+    constexpr size_t Size = 2 * Radius + 1;
+    Kernel<Size, Size> kernel{};
+    for (auto& row : kernel.weights) {
+        row.fill(1.0 / static_cast<double>(Size * Size));
+    }
+    return kernel;
+}
+
+template <size_t Radius>
+inline constexpr Kernel<2 * Radius + 1, 2 * Radius + 1> BOX_KERNEL = MakeBoxKernel<Radius>();
+
+// Calls function(std::integral_constant<size_t, i>) for every i from 0 to Count - 1.
+template <size_t Count, typename Function>
+constexpr void Unroll(Function&& function) {
+    [&]<size_t... Indexes>(std::index_sequence<Indexes...>) {
+        (function(std::integral_constant<size_t, Indexes>{}), ...);
+    }(std::make_index_sequence<Count>{});
+}
+
+// Sums rows[i][columns[j]] * weights[i][j] over the kernel in row-major order.
+template <const auto& K, typename T, typename Row>
+T Convolve(const std::array<Row, std::decay_t<decltype(K)>::HEIGHT>& rows,
+           const std::array<size_t, std::decay_t<decltype(K)>::WIDTH>& columns) {
+    using KernelType = std::decay_t<decltype(K)>;
+    T sum{};
+    Unroll<KernelType::HEIGHT * KernelType::WIDTH>([&](auto tap) {
+        constexpr size_t I = decltype(tap)::value / KernelType::WIDTH;
+        constexpr size_t J = decltype(tap)::value % KernelType::WIDTH;
+        if constexpr (K.weights[I][J] != 0.0) {
+            sum = sum + rows[I][columns[J]] * K.weights[I][J];
+        }
+    });
+    return sum;
+}
+
+constexpr double ConstexprExp(const double x) {
+    // e^x = 2^n * e^r, where |r| <= ln(2) / 2, and e^r is summed as Taylor series in Horner form. Computations are
+    // done in extended precision to get the same result as std::exp after rounding.
+    constexpr long double Ln2 = 0.693147180559945309417232121458176568L;
+    const long double scaled = x / Ln2;
+    const long long n = static_cast<long long>(scaled < 0 ? scaled - 0.5L : scaled + 0.5L);
+    const long double r = x - static_cast<long double>(n) * Ln2;
+
+    constexpr int TaylorTerms = 20;
+    long double result = 1.0L;
+    for (int i = TaylorTerms; i > 0; --i) {
+        result = 1.0L + result * r / i;
+    }
+    for (long long i = 0; i < n; ++i) {
+        result *= 2.0L;
+    }
+    for (long long i = 0; i > n; --i) {
+        result /= 2.0L;
+    }
+    return static_cast<double>(result);
+}
+
+// Gaussian taps e^(-x^2 / (2 * sigma^2)) for x from 0 to ceil(3 * sigma) - 1. Sigma is given in halves to be usable
+// as a template parameter.
+constexpr size_t GetGaussianTapsCount(const size_t half_sigmas) {
+    return (3 * half_sigmas + 1) / 2;
+}
+
+template <size_t HalfSigmas>
+constexpr std::array<double, GetGaussianTapsCount(HalfSigmas)> MakeGaussianTaps() {
+    constexpr double Sigma = static_cast<double>(HalfSigmas) / 2;
+    std::array<double, GetGaussianTapsCount(HalfSigmas)> taps{};
+    for (size_t x = 0; x < taps.size(); ++x) {
+        taps[x] = ConstexprExp(-static_cast<double>(x) * static_cast<double>(x) / (2 * Sigma * Sigma));
+    }
+    return taps;
+}
+
+template <size_t HalfSigmas>
+inline constexpr std::array<double, GetGaussianTapsCount(HalfSigmas)> GAUSSIAN_TAPS = MakeGaussianTaps<HalfSigmas>();
+
+constexpr size_t MAX_FIXED_GAUSSIAN_HALF_SIGMAS = 8;
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "median_filter.h"
+
+#include "../cancellation.h"
+#include "../thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+constexpr size_t HistogramBins = 256;
+constexpr size_t CoarseBins = 16;
+constexpr size_t FineBins = HistogramBins / CoarseBins;
+constexpr double MaxLevel = HistogramBins - 1;
+
+// Median of 9 values with the exchange network of 19 comparisons.
+double GetMedianOf9(std::array<double, 9>& p) {
+    const auto sort = [&p](const size_t a, const size_t b) {
+        const double low = std::min(p[a], p[b]);
+        p[b] = std::max(p[a], p[b]);
+        p[a] = low;
+    };
+    sort(1, 2), sort(4, 5), sort(7, 8), sort(0, 1), sort(3, 4), sort(6, 7), sort(1, 2), sort(4, 5), sort(7, 8);
+    sort(0, 3), sort(5, 8), sort(4, 7), sort(3, 6), sort(1, 4), sort(2, 5), sort(4, 7), sort(4, 2), sort(6, 4);
+    sort(4, 2);
+    return p[4];
+}
+
+// Counts of every level in a part of a column, or in the whole window. Coarse bins count 16 levels each, so the median
+// is found by going through at most 16 coarse and 16 fine bins.
+struct Histogram {
+    std::array<uint32_t, HistogramBins> fine{};
+    std::array<uint32_t, CoarseBins> coarse{};
+
+    void Add(const size_t level) {
+        ++fine[level];
+        ++coarse[level / FineBins];
+    }
+
+    void Remove(const size_t level) {
+        --fine[level];
+        --coarse[level / FineBins];
+    }
+
+    void Add(const Histogram& other) {
+        for (size_t k = 0; k < HistogramBins; ++k) {
+            fine[k] += other.fine[k];
+        }
+        for (size_t k = 0; k < CoarseBins; ++k) {
+            coarse[k] += other.coarse[k];
+        }
+    }
+
+    void Subtract(const Histogram& other) {
+        for (size_t k = 0; k < HistogramBins; ++k) {
+            fine[k] -= other.fine[k];
+        }
+        for (size_t k = 0; k < CoarseBins; ++k) {
+            coarse[k] -= other.coarse[k];
+        }
+    }
+
+    // Level of the value with the given number of smaller values.
+    size_t GetLevel(uint32_t rank) const {
+        size_t bin = 0;
+        while (coarse[bin] <= rank) {
+            rank -= coarse[bin++];
+        }
+        size_t level = bin * FineBins;
+        while (fine[level] <= rank) {
+            rank -= fine[level++];
+        }
+        return level;
+    }
+};
+
+MedianFilter::MedianFilter(const size_t radius) : radius_(radius) {
+}
+
+void MedianFilter::Apply(Image& image) const {
+    if (radius_ == 0) {
+        return;
+    }
+    image.ExpandMask();
+    Image result(image.GetHeight(), image.GetWidth(), image.GetChannels());
+    const std::vector<Rect> strips =
+        SplitIntoStrips(image.GetHeight(), image.GetWidth(), GetThreadPool().GetThreadsCount());
+    GetThreadPool().ParallelFor(strips.size(), [&](const size_t index) {
+        CheckCancellation();
+        ApplyRegion(image, result, strips[index]);
+    });
+    image = std::move(result);
+}
+
+void MedianFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    if (radius_ == 1) {
+        ApplyRegionByNetwork(src, dst, rect);
+    } else {
+        ApplyRegionByHistograms(src, dst, rect);
+    }
+}
+
+std::optional<size_t> MedianFilter::GetHalo() const {
+    return radius_;
+}
+
+void MedianFilter::ApplyRegionByNetwork(const Image& src, Image& dst, const Rect& rect) const {
+    const size_t height = src.GetHeight();
+    const size_t width = src.GetWidth();
+    const size_t channels = src.GetChannels();
+    std::array<double, 9> window{};
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        CheckCancellation();
+        const std::array<const double*, 3> rows = {src.GetRow(i == 0 ? 0 : i - 1), src.GetRow(i),
+                                                   src.GetRow(std::min(height - 1, i + 1))};
+        double* dst_row = dst.GetMutableRow(i);
+        for (size_t j = rect.left; j < rect.left + rect.width; ++j) {
+            const std::array<size_t, 3> columns = {(j == 0 ? 0 : j - 1) * channels, j * channels,
+                                                   std::min(width - 1, j + 1) * channels};
+            for (size_t c = 0; c < channels; ++c) {
+                for (size_t mi = 0; mi < 3; ++mi) {
+                    for (size_t mj = 0; mj < 3; ++mj) {
+                        window[mi * 3 + mj] = rows[mi][columns[mj] + c];
+                    }
+                }
+                dst_row[j * channels + c] = GetMedianOf9(window);
+            }
+        }
+    }
+}
+
+// Every column of the region and its halo keeps the histogram of its 2 * radius + 1 rows around the current row. The
+// histogram of the window is built from the column histograms for the first pixel of the row and then moved right by
+// adding one column and removing another, so both steps cost the same for any radius.
+void MedianFilter::ApplyRegionByHistograms(const Image& src, Image& dst, const Rect& rect) const {
+    const int64_t height = static_cast<int64_t>(src.GetHeight());
+    const int64_t width = static_cast<int64_t>(src.GetWidth());
+    const size_t channels = src.GetChannels();
+    const int64_t radius = static_cast<int64_t>(radius_);
+    const size_t side = 2 * radius_ + 1;
+    const int64_t first_column = static_cast<int64_t>(rect.left) - radius;
+    const size_t columns_count = rect.width + 2 * radius_;
+    const uint32_t median_rank = static_cast<uint32_t>(side * side / 2);
+
+    std::vector<size_t> source_columns(columns_count);
+    for (size_t k = 0; k < columns_count; ++k) {
+        source_columns[k] = std::clamp<int64_t>(first_column + static_cast<int64_t>(k), 0, width - 1) * channels;
+    }
+    std::vector<Histogram> column_histograms(columns_count * channels);
+    std::vector<uint8_t> levels(columns_count * channels);
+    // Levels of the row of the image, clamped to it, for every column of the region and its halo.
+    const auto get_levels = [&](const int64_t i) {
+        const double* row = src.GetRow(std::clamp<int64_t>(i, 0, height - 1));
+        for (size_t k = 0; k < columns_count; ++k) {
+            for (size_t c = 0; c < channels; ++c) {
+                levels[k * channels + c] = static_cast<uint8_t>(std::lround(row[source_columns[k] + c] * MaxLevel));
+            }
+        }
+        return levels.data();
+    };
+    for (int64_t i = static_cast<int64_t>(rect.top) - radius; i <= static_cast<int64_t>(rect.top) + radius; ++i) {
+        const uint8_t* row_levels = get_levels(i);
+        for (size_t index = 0; index < column_histograms.size(); ++index) {
+            column_histograms[index].Add(row_levels[index]);
+        }
+    }
+
+    std::vector<Histogram> window(channels);
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        CheckCancellation();
+        if (i > rect.top) {
+            const uint8_t* removed = get_levels(static_cast<int64_t>(i) - radius - 1);
+            for (size_t index = 0; index < column_histograms.size(); ++index) {
+                column_histograms[index].Remove(removed[index]);
+            }
+            const uint8_t* added = get_levels(static_cast<int64_t>(i) + radius);
+            for (size_t index = 0; index < column_histograms.size(); ++index) {
+                column_histograms[index].Add(added[index]);
+            }
+        }
+
+        for (size_t c = 0; c < channels; ++c) {
+            window[c] = Histogram();
+            for (size_t k = 0; k < side; ++k) {
+                window[c].Add(column_histograms[k * channels + c]);
+            }
+        }
+        double* dst_row = dst.GetMutableRow(i);
+        for (size_t j = 0; j < rect.width; ++j) {
+            for (size_t c = 0; c < channels; ++c) {
+                if (j > 0) {
+                    window[c].Add(column_histograms[(j + side - 1) * channels + c]);
+                    window[c].Subtract(column_histograms[(j - 1) * channels + c]);
+                }
+                dst_row[(rect.left + j) * channels + c] =
+                    static_cast<double>(window[c].GetLevel(median_rank)) / MaxLevel;
+            }
+        }
+    }
+}
+
+std::vector<Rect> SplitIntoStrips(const size_t height, const size_t width, const size_t threads_count) {
+    constexpr size_t StripsPerThread = 4;
+    constexpr size_t MinStripWidth = 64;
+    const size_t strips_count = std::max<size_t>(1, threads_count * StripsPerThread);
+    const size_t strip_width = std::max(MinStripWidth, (width + strips_count - 1) / strips_count);
+
+    std::vector<Rect> strips;
+    for (size_t left = 0; left < width; left += strip_width) {
+        strips.push_back(Rect{0, left, height, std::min(strip_width, width - left)});
+    }
+    return strips;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "tiled_filter.h"
+
+#include <vector>
+
+// Median of the (2 * radius + 1) x (2 * radius + 1) window around every pixel, pixels outside of the image are taken
+// from the nearest border. Radius 1 selects the median of the exact values with a sorting network. Larger radii use the
+// constant-time algorithm of Perreault and Hebert on histograms of 256 levels, the levels of 8-bit files, so values
+// are rounded to them and the cost per pixel does not depend on the radius.
+class MedianFilter : public TiledFilter {
+public:
+    explicit MedianFilter(size_t radius);
+
+    // The histogram of every column is slid down the whole image once, so the image is split into column strips.
+    void Apply(Image& image) const override;
+
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
+
+private:
+    void ApplyRegionByNetwork(const Image& src, Image& dst, const Rect& rect) const;
+    void ApplyRegionByHistograms(const Image& src, Image& dst, const Rect& rect) const;
+
+    size_t radius_;
+};
+
+// Splits the image into vertical strips, so that every worker gets several of them.
+std::vector<Rect> SplitIntoStrips(size_t height, size_t width, size_t threads_count);
\ No newline at end of file
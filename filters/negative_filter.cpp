@@ -3,13 +3,21 @@
 NegativeFilter::NegativeFilter() {
 }
 
-void NegativeFilter::Apply(Image& image) const {
-    std::vector pixels(image.GetHeight(), std::vector<Color>(image.GetWidth()));
-    for (size_t i = 0; i < image.GetHeight(); ++i) {
-        for (size_t j = 0; j < image.GetWidth(); ++j) {
-            const Color old_color = image.GetPixel(i, j);
-            pixels[i][j] = Color(1.0 - old_color.r, 1.0 - old_color.g, 1.0 - old_color.b);
+void NegativeFilter::ApplyRegion(const Image& src, Image& dst, const Rect& rect) const {
+    const size_t channels = src.GetChannels();
+    for (size_t i = rect.top; i < rect.top + rect.height; ++i) {
+        const double* src_row = src.GetRow(i);
+        double* dst_row = dst.GetMutableRow(i);
+        for (size_t k = rect.left * channels; k < (rect.left + rect.width) * channels; ++k) {
+            dst_row[k] = NormalizeColorValue(1.0 - src_row[k]);
         }
     }
-    image.SetPixels(std::move(pixels));
+}
+
+std::optional<size_t> NegativeFilter::GetHalo() const {
+    return 0;
+}
+
+std::optional<TransferFunction> NegativeFilter::GetTransferFunction() const {
+    return [](const double value, size_t) { return NormalizeColorValue(1.0 - value); };
 }
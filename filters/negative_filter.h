@@ -1,10 +1,14 @@
 #pragma once
 
-#include "base_filter.h"
+#include "tiled_filter.h"
 
-class NegativeFilter : public BaseFilter {
+class NegativeFilter : public TiledFilter {
 public:
     NegativeFilter();
 
-    void Apply(Image& image) const override;
+    void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const override;
+
+    std::optional<size_t> GetHalo() const override;
+
+    std::optional<TransferFunction> GetTransferFunction() const override;
 };
\ No newline at end of file
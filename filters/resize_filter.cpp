@@ -0,0 +1,261 @@
+#include "resize_filter.h"
+
+#include "../cancellation.h"
+#include "../thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numbers>
+
+constexpr double BicubicA = -0.5;
+constexpr double LanczosLobes = 3;
+
+double GetKernelSupport(const ResampleMode mode) {
+    switch (mode) {
+        case BOX_RESAMPLE:
+            return 0.5;
+        case BILINEAR_RESAMPLE:
+            return 1;
+        case BICUBIC_RESAMPLE:
+            return 2;
+        default:
+            return LanczosLobes;
+    }
+}
+
+double GetSinc(const double x) {
+    if (x == 0) {
+        return 1;
+    }
+    return std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+}
+
+double EvaluateKernel(const ResampleMode mode, const double x) {
+    const double distance = std::abs(x);
+    switch (mode) {
+        case BOX_RESAMPLE:
+            return x > -0.5 && x <= 0.5 ? 1 : 0;
+        case BILINEAR_RESAMPLE:
+            return std::max(0.0, 1 - distance);
+        case BICUBIC_RESAMPLE:
+            if (distance < 1) {
+                return ((BicubicA + 2) * distance - (BicubicA + 3)) * distance * distance + 1;
+            }
+            if (distance < 2) {
+                return ((BicubicA * distance - 5 * BicubicA) * distance + 8 * BicubicA) * distance - 4 * BicubicA;
+            }
+            return 0;
+        default:
+            return distance < LanczosLobes ? GetSinc(x) * GetSinc(x / LanczosLobes) : 0;
+    }
+}
+
+double GetStretchedSupport(const size_t input_size, const size_t output_size, const ResampleMode mode) {
+    const double scale = static_cast<double>(input_size) / static_cast<double>(output_size);
+    return GetKernelSupport(mode) * std::max(scale, 1.0);
+}
+
+size_t GetTaps(const size_t input_size, const size_t output_size, const ResampleMode mode) {
+    if (input_size == output_size) {
+        return 1;
+    }
+    const double taps = 2 * std::ceil(GetStretchedSupport(input_size, output_size, mode)) + 1;
+    return std::min(input_size, static_cast<size_t>(taps));
+}
+
+ResampleWeights GetResampleWeights(const size_t input_size, const size_t output_size, const ResampleMode mode) {
+    const double scale = static_cast<double>(input_size) / static_cast<double>(output_size);
+    const double stretch = std::max(scale, 1.0);
+    const double support = GetStretchedSupport(input_size, output_size, mode);
+    ResampleWeights result;
+    result.taps = GetTaps(input_size, output_size, mode);
+    result.first.resize(output_size);
+    result.counts.resize(output_size);
+    result.weights.assign(output_size * result.taps, 0);
+    for (size_t k = 0; k < output_size; ++k) {
+        const double center = (static_cast<double>(k) + 0.5) * scale;
+        const size_t begin = static_cast<size_t>(std::max(0.0, center - support + 0.5));
+        const size_t end = std::min(input_size, static_cast<size_t>(center + support + 0.5));
+        const size_t count = std::min(end - begin, result.taps);
+        double* weights = result.weights.data() + k * result.taps;
+        double sum = 0;
+        for (size_t t = 0; t < count; ++t) {
+            weights[t] = EvaluateKernel(mode, (static_cast<double>(begin + t) - center + 0.5) / stretch);
+            sum += weights[t];
+        }
+        if (sum != 0) {
+            for (size_t t = 0; t < count; ++t) {
+                weights[t] /= sum;
+            }
+        }
+        result.first[k] = begin;
+        result.counts[k] = count;
+    }
+    return result;
+}
+
+// Rows of the output are split into bands, several per thread, so that faster threads take more of them.
+void ForEachRowBand(const size_t rows, const std::function<void(size_t begin, size_t end)>& process) {
+    constexpr size_t BandsPerThread = 4;
+    const size_t bands =
+        std::clamp<size_t>(GetThreadPool().GetThreadsCount() * BandsPerThread, 1, std::max<size_t>(rows, 1));
+    const size_t band_rows = (rows + bands - 1) / bands;
+    GetThreadPool().ParallelFor(bands, [&](const size_t band) {
+        const size_t begin = std::min(rows, band * band_rows);
+        process(begin, std::min(rows, begin + band_rows));
+    });
+}
+
+Image ResampleWidth(const Image& src, const ResampleWeights& weights) {
+    const size_t width = weights.first.size();
+    const size_t channels = src.GetChannels();
+    Image result(src.GetHeight(), width, channels);
+    ForEachRowBand(src.GetHeight(), [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CheckCancellation();
+            const double* src_row = src.GetRow(i);
+            double* dst_row = result.GetMutableRow(i);
+            for (size_t j = 0; j < width; ++j) {
+                const double* pixel_weights = weights.weights.data() + j * weights.taps;
+                const double* pixels = src_row + weights.first[j] * channels;
+                double sums[RGB_CHANNELS] = {};
+                for (size_t t = 0; t < weights.counts[j]; ++t) {
+                    for (size_t c = 0; c < channels; ++c) {
+                        sums[c] += pixel_weights[t] * pixels[t * channels + c];
+                    }
+                }
+                for (size_t c = 0; c < channels; ++c) {
+                    dst_row[j * channels + c] = NormalizeColorValue(sums[c]);
+                }
+            }
+        }
+    });
+    return result;
+}
+
+// Every output row is a weighted sum of whole input rows, so the inner loop runs over contiguous values and is
+// vectorized by the compiler.
+Image ResampleHeight(const Image& src, const ResampleWeights& weights) {
+    const size_t height = weights.first.size();
+    const size_t row_values = src.GetWidth() * src.GetChannels();
+    Image result(height, src.GetWidth(), src.GetChannels());
+    ForEachRowBand(height, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CheckCancellation();
+            double* dst_row = result.GetMutableRow(i);
+            const double* row_weights = weights.weights.data() + i * weights.taps;
+            for (size_t t = 0; t < weights.counts[i]; ++t) {
+                const double weight = row_weights[t];
+                const double* src_row = src.GetRow(weights.first[i] + t);
+                for (size_t x = 0; x < row_values; ++x) {
+                    dst_row[x] += weight * src_row[x];
+                }
+            }
+            for (size_t x = 0; x < row_values; ++x) {
+                dst_row[x] = NormalizeColorValue(dst_row[x]);
+            }
+        }
+    });
+    return result;
+}
+
+// Output pixels are means of factor_height x factor_width blocks: the rows of a block are summed first, then the sums
+// are reduced by groups of factor_width pixels.
+Image AverageBlocks(const Image& src, const size_t height, const size_t width) {
+    const size_t channels = src.GetChannels();
+    const size_t factor_height = src.GetHeight() / height;
+    const size_t factor_width = src.GetWidth() / width;
+    const size_t row_values = src.GetWidth() * channels;
+    const double normalization = 1.0 / static_cast<double>(factor_height * factor_width);
+    Image result(height, width, channels);
+    ForEachRowBand(height, [&](const size_t begin, const size_t end) {
+        std::vector<double> sums(row_values);
+        for (size_t i = begin; i < end; ++i) {
+            CheckCancellation();
+            std::fill(sums.begin(), sums.end(), 0);
+            for (size_t r = i * factor_height; r < (i + 1) * factor_height; ++r) {
+                const double* src_row = src.GetRow(r);
+                for (size_t x = 0; x < row_values; ++x) {
+                    sums[x] += src_row[x];
+                }
+            }
+            double* dst_row = result.GetMutableRow(i);
+            for (size_t j = 0; j < width; ++j) {
+                for (size_t c = 0; c < channels; ++c) {
+                    double sum = 0;
+                    for (size_t q = j * factor_width; q < (j + 1) * factor_width; ++q) {
+                        sum += sums[q * channels + c];
+                    }
+                    dst_row[j * channels + c] = NormalizeColorValue(sum * normalization);
+                }
+            }
+        }
+    });
+    return result;
+}
+
+bool IsBlockMean(const ImageShape& input, const size_t height, const size_t width, const ResampleMode mode) {
+    return mode == BOX_RESAMPLE && input.height % height == 0 && input.width % width == 0;
+}
+
+// The pass which shrinks the image more goes first, so that the second pass works on fewer pixels.
+bool ResamplesWidthFirst(const ImageShape& input, const size_t height, const size_t width, const ResampleMode mode) {
+    const auto cost = [&](const size_t width_pass_rows, const size_t height_pass_width) {
+        const size_t width_cost =
+            input.width == width ? 0 : width_pass_rows * width * GetTaps(input.width, width, mode);
+        const size_t height_cost =
+            input.height == height ? 0 : height * height_pass_width * GetTaps(input.height, height, mode);
+        return static_cast<double>(width_cost) + static_cast<double>(height_cost);
+    };
+    return cost(input.height, width) <= cost(height, input.width);
+}
+
+ResizeFilter::ResizeFilter(const size_t height, const size_t width, const ResampleMode mode)
+    : height_(height), width_(width), mode_(mode) {
+}
+
+void ResizeFilter::Apply(Image& image) const {
+    if (image.GetHeight() == height_ && image.GetWidth() == width_) {
+        return;
+    }
+    image.ExpandMask();
+    const ImageShape input = image.GetShape();
+    if (IsBlockMean(input, height_, width_, mode_)) {
+        image = AverageBlocks(image, height_, width_);
+        return;
+    }
+    const ResampleWeights width_weights = GetResampleWeights(input.width, width_, mode_);
+    const ResampleWeights height_weights = GetResampleWeights(input.height, height_, mode_);
+    const bool width_first = ResamplesWidthFirst(input, height_, width_, mode_);
+    if (width_first && input.width != width_) {
+        image = ResampleWidth(image, width_weights);
+    }
+    if (input.height != height_) {
+        image = ResampleHeight(image, height_weights);
+    }
+    if (!width_first && input.width != width_) {
+        image = ResampleWidth(image, width_weights);
+    }
+}
+
+FilterMemory ResizeFilter::EstimateMemory(const ImageShape& input) const {
+    if (input.height == height_ && input.width == width_) {
+        return FilterMemory{input, 0, std::nullopt};
+    }
+    ImageShape src = input;
+    uint64_t expanded_bytes = 0;
+    if (input.is_mask) {
+        src = ImageShape{input.height, input.width, GRAYSCALE_CHANNELS, false};
+        expanded_bytes = GetImageBytes(src);
+    }
+    const ImageShape output{height_, width_, src.channels, false};
+    const uint64_t output_bytes = GetImageBytes(output);
+    uint64_t intermediate_bytes = 0;
+    if (!IsBlockMean(src, height_, width_, mode_) && src.height != height_ && src.width != width_) {
+        intermediate_bytes = ResamplesWidthFirst(src, height_, width_, mode_)
+                                 ? GetImageBytes(ImageShape{src.height, width_, src.channels, false})
+                                 : GetImageBytes(ImageShape{height_, src.width, src.channels, false});
+    }
+    return FilterMemory{output, expanded_bytes + intermediate_bytes + output_bytes, output_bytes};
+}
\ No newline at end of file
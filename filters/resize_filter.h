@@ -0,0 +1,36 @@
+#pragma once
+
+#include "base_filter.h"
+
+#include <vector>
+
+enum ResampleMode { BOX_RESAMPLE, BILINEAR_RESAMPLE, BICUBIC_RESAMPLE, LANCZOS_RESAMPLE };
+
+// Weights of the input pixels of every output pixel along one axis. Output pixel k is the sum of
+// weights[k * taps + t] times input pixel first[k] + t for t < counts[k].
+struct ResampleWeights {
+    size_t taps = 0;
+    std::vector<size_t> first;
+    std::vector<size_t> counts;
+    std::vector<double> weights;
+};
+
+// When shrinking, the kernel is stretched by the scale, so that every input pixel contributes to the output.
+ResampleWeights GetResampleWeights(size_t input_size, size_t output_size, ResampleMode mode);
+
+// Scales the image to exactly [height, width]. Rows and columns are resampled in two separate passes with the weights
+// computed once per axis. Box resampling by integer factors averages blocks of pixels in a single pass.
+class ResizeFilter : public BaseFilter {
+public:
+    ResizeFilter(size_t height, size_t width, ResampleMode mode);
+
+    void Apply(Image& image) const override;
+
+    // The intermediate image of the first pass is kept along with the output.
+    FilterMemory EstimateMemory(const ImageShape& input) const override;
+
+private:
+    size_t height_;
+    size_t width_;
+    ResampleMode mode_;
+};
\ No newline at end of file
@@ -1,14 +1,8 @@
 #pragma once
 
-#include "base_filter.h"
-#include "matrix_filter.h"
+#include "kernel_filter.h"
 
-class SharpeningFilter : public BaseFilter {
+class SharpeningFilter : public KernelFilter<SHARPENING_KERNEL> {
 public:
     SharpeningFilter();
-
-    void Apply(Image& image) const override;
-
-private:
-    MatrixFilter matrix_filter_;
 };
\ No newline at end of file
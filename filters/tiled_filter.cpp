@@ -0,0 +1,57 @@
+#include "tiled_filter.h"
+
+#include "../cancellation.h"
+#include "../thread_pool.h"
+
+#include <algorithm>
+
+void TiledFilter::Apply(Image& image) const {
+    image.ExpandMask();
+    Image result = CreateOutput(image);
+    const std::vector<Rect> tiles =
+        SplitIntoTiles(image.GetHeight(), image.GetWidth(), GetThreadPool().GetThreadsCount());
+    GetThreadPool().ParallelFor(tiles.size(), [&](const size_t index) {
+        CheckCancellation();
+        ApplyRegion(image, result, tiles[index]);
+    });
+    image = std::move(result);
+}
+
+FilterMemory TiledFilter::EstimateMemory(const ImageShape& input) const {
+    ImageShape src = input;
+    uint64_t expanded_bytes = 0;
+    if (input.is_mask) {
+        src = ImageShape{input.height, input.width, GRAYSCALE_CHANNELS, false};
+        expanded_bytes = GetImageBytes(src);
+    }
+    const ImageShape output = GetOutputShape(src);
+    const uint64_t output_bytes = GetImageBytes(output);
+    return FilterMemory{output, expanded_bytes + output_bytes, output_bytes};
+}
+
+ImageShape TiledFilter::GetOutputShape(const ImageShape& src) const {
+    return src;
+}
+
+Image TiledFilter::CreateOutput(const Image& src) const {
+    const ImageShape shape = GetOutputShape(src.GetShape());
+    if (shape.is_mask) {
+        Image output;
+        output.SetMask(shape.height, shape.width, std::vector<uint64_t>(shape.height * GetMaskStride(shape.width)));
+        return output;
+    }
+    return Image(shape.height, shape.width, shape.channels);
+}
+
+std::vector<Rect> SplitIntoTiles(const size_t height, const size_t width, const size_t threads_count) {
+    constexpr size_t TilesPerThread = 4;
+    constexpr size_t MinTileHeight = 16;
+    const size_t tiles_count = std::max<size_t>(1, threads_count * TilesPerThread);
+    const size_t tile_height = std::max(MinTileHeight, (height + tiles_count - 1) / tiles_count);
+
+    std::vector<Rect> tiles;
+    for (size_t top = 0; top < height; top += tile_height) {
+        tiles.push_back(Rect{top, 0, std::min(tile_height, height - top), width});
+    }
+    return tiles;
+}
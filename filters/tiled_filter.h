@@ -0,0 +1,29 @@
+#pragma once
+
+#include "base_filter.h"
+
+#include <vector>
+
+// Filter whose output pixels depend only on the input pixels within the halo, so the image can be split into tiles
+// which are computed independently in parallel.
+class TiledFilter : public BaseFilter {
+public:
+    void Apply(Image& image) const override;
+
+    // Computes pixels of dst inside rect from src. Tiles given to the concurrent calls do not intersect.
+    virtual void ApplyRegion(const Image& src, Image& dst, const Rect& rect) const = 0;
+
+    std::optional<size_t> GetHalo() const override = 0;
+
+    FilterMemory EstimateMemory(const ImageShape& input) const override;
+
+protected:
+    // Shape of the image the tiles are written to, src is never a mask since masks are expanded first.
+    virtual ImageShape GetOutputShape(const ImageShape& src) const;
+
+private:
+    Image CreateOutput(const Image& src) const;
+};
+
+// Splits the image into horizontal bands, so that every worker gets several of them.
+std::vector<Rect> SplitIntoTiles(size_t height, size_t width, size_t threads_count);
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "graph.h"
+
+#include "controller.h"
+#include "exceptions.h"
+#include "filters/fft_filters.h"
+#include "memory_planner.h"
+#include "optimizer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <unordered_map>
+
+GraphSpec ReadGraphSpec(std::istream& in) {
+    GraphSpec spec;
+    std::unordered_map<std::string, size_t> defined;
+    std::string line;
+    for (size_t line_number = 1; std::getline(in, line); ++line_number) {
+        const std::vector<std::string> words = SplitBySpaces(line);
+        if (words.empty() || words[0][0] == '#') {
+            continue;
+        }
+        const std::string prefix = "graph line " + std::to_string(line_number) + ": ";
+        if (words[0] == "output") {
+            if (words.size() != 3) {
+                throw UsageException(prefix + "output must be given as: output name path");
+            }
+            if (words[1] != GRAPH_INPUT && !defined.contains(words[1])) {
+                throw UsageException(prefix + "image " + words[1] + " is not defined");
+            }
+            spec.outputs.push_back(GraphOutput{words[1], words[2]});
+            continue;
+        }
+
+        if (words.size() < 3 || words[1] != "=") {
+            throw UsageException(prefix + "image must be defined as: name = source [-filter_name [<params>]]");
+        }
+        if (words[0] == GRAPH_INPUT || words[0] == "output" || defined.contains(words[0])) {
+            throw UsageException(prefix + "image " + words[0] + " is already defined");
+        }
+        if (words[2] != GRAPH_INPUT && !defined.contains(words[2])) {
+            throw UsageException(prefix + "image " + words[2] + " is not defined");
+        }
+        try {
+            spec.nodes.push_back(GraphNode{
+                words[0], words[2], ParseFilters(std::vector<std::string>(words.begin() + 3, words.end()))});
+        } catch (const UsageException& exc) {
+            throw UsageException(prefix + exc.what());
+        }
+        defined.emplace(words[0], spec.nodes.size() - 1);
+    }
+    if (spec.outputs.empty()) {
+        throw UsageException("graph has no outputs");
+    }
+    return spec;
+}
+
+GraphSpec ReadGraphSpec(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        throw ReadException("could not open graph " + filename);
+    }
+    return ReadGraphSpec(in);
+}
+
+Rect GetBoundingRect(const Rect& a, const Rect& b) {
+    const size_t top = std::min(a.top, b.top);
+    const size_t left = std::min(a.left, b.left);
+    const size_t bottom = std::max(SaturatingAdd(a.top, a.height), SaturatingAdd(b.top, b.height));
+    const size_t right = std::max(SaturatingAdd(a.left, a.width), SaturatingAdd(b.left, b.width));
+    return Rect{top, left, bottom - top, right - left};
+}
+
+std::unordered_map<std::string, std::vector<FilterInput>> GetImageChains(const GraphSpec& spec) {
+    std::unordered_map<std::string, std::vector<FilterInput>> chains;
+    chains.emplace(GRAPH_INPUT, std::vector<FilterInput>());
+    for (const GraphNode& node : spec.nodes) {
+        std::vector<FilterInput> chain = chains.at(node.source);
+        chain.insert(chain.end(), node.filters.begin(), node.filters.end());
+        chains.emplace(node.name, std::move(chain));
+    }
+    return chains;
+}
+
+uint64_t EstimateGraphPeakBytes(const ImageShape& input, const GraphSpec& spec) {
+    const std::unordered_map<std::string, std::vector<FilterInput>> chains = GetImageChains(spec);
+    uint64_t peak_bytes = 0;
+    for (const GraphOutput& output : spec.outputs) {
+        const std::vector<FilterInput> inputs = OptimizeFilters(chains.at(output.name)).filters;
+        peak_bytes = std::max(peak_bytes, EstimateMemory(input, CreateFilters(inputs)).peak_bytes);
+    }
+    return peak_bytes;
+}
+
+FilterGraph::FilterGraph(const GraphSpec& spec) {
+    const std::unordered_map<std::string, std::vector<FilterInput>> chains = GetImageChains(spec);
+
+    nodes_.emplace_back();
+    for (const GraphOutput& output : spec.outputs) {
+        size_t current = 0;
+        for (const FilterInput& filter : OptimizeFilters(chains.at(output.name)).filters) {
+            auto child = std::find_if(nodes_[current].children.begin(), nodes_[current].children.end(),
+                                      [&](const size_t index) { return nodes_[index].input == filter; });
+            if (child != nodes_[current].children.end()) {
+                current = *child;
+                continue;
+            }
+            nodes_.push_back(Node{filter, CreateFilters({filter})[0], {}, {}, Rect()});
+            nodes_[current].children.push_back(nodes_.size() - 1);
+            current = nodes_.size() - 1;
+        }
+        nodes_[current].output_paths.push_back(output.path);
+    }
+
+    // Regions are propagated from the outputs to the input, a node needs the union of what its children need.
+    const Rect whole_image{0, 0, SIZE_MAX, SIZE_MAX};
+    for (size_t i = nodes_.size(); i-- > 1;) {
+        std::optional<Rect> needed;
+        if (!nodes_[i].output_paths.empty()) {
+            needed = whole_image;
+        }
+        for (const size_t child : nodes_[i].children) {
+            needed = needed.has_value() ? GetBoundingRect(*needed, nodes_[child].required_region)
+                                        : nodes_[child].required_region;
+        }
+        nodes_[i].required_region =
+            nodes_[i].filter->GetRequiredRegion(needed.value_or(whole_image)).value_or(whole_image);
+    }
+}
+
+size_t FilterGraph::GetFiltersCount() const {
+    return nodes_.size() - 1;
+}
+
+void FilterGraph::Run(Image input, const std::function<void(const std::string&, const Image&)>& write) const {
+    RunNode(0, input, write);
+}
+
+void FilterGraph::RunNode(const size_t index, const Image& image,
+                          const std::function<void(const std::string&, const Image&)>& write) const {
+    for (const std::string& path : nodes_[index].output_paths) {
+        write(path, image);
+    }
+
+    // Frequency domain filters need the whole image, so all of them get the same input and share its FFT.
+    std::optional<ImageFrequencyDomainRepresentation> spectrum;
+    for (const size_t child : nodes_[index].children) {
+        // Copies share pixels with the image until they are changed.
+        Image result = image;
+        CropToRegion(result, nodes_[child].required_region);
+        if (const auto* fft_filter = dynamic_cast<const FFTFilter*>(nodes_[child].filter.get())) {
+            if (!spectrum.has_value()) {
+                spectrum = FFT(result);
+            }
+            fft_filter->ApplyToSpectrum(*spectrum, result);
+        } else {
+            nodes_[child].filter->Apply(result);
+        }
+        RunNode(child, result, write);
+    }
+}
\ No newline at end of file
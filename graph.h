@@ -0,0 +1,76 @@
+#pragma once
+
+#include "filters/base_filter.h"
+#include "parser.h"
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GraphNode {
+    std::string name;
+    std::string source;
+    std::vector<FilterInput> filters;
+};
+
+struct GraphOutput {
+    std::string name;
+    std::string path;
+};
+
+// Name of the decoded input image in graph specs.
+const std::string GRAPH_INPUT = "input";
+
+struct GraphSpec {
+    std::vector<GraphNode> nodes;
+    std::vector<GraphOutput> outputs;
+};
+
+// Every non-empty line of the spec either defines a named image as filters applied to the input or to an image defined
+// above: "name = source [-filter_name [<params>]]", or writes an image to a file: "output name path". Lines starting
+// with # are skipped.
+GraphSpec ReadGraphSpec(std::istream& in);
+
+GraphSpec ReadGraphSpec(const std::string& filename);
+
+// For every image of the spec returns the whole chain of filters applied to the input to get it.
+std::unordered_map<std::string, std::vector<FilterInput>> GetImageChains(const GraphSpec& spec);
+
+// Largest estimated peak over the optimized output chains of the spec. Images the tree keeps for other branches are not
+// counted.
+uint64_t EstimateGraphPeakBytes(const ImageShape& input, const GraphSpec& spec);
+
+// Outputs of the spec are expanded into chains of filters applied to the input, and the chains are merged into a tree,
+// so that common prefixes are computed once. Every chain is optimized before merging. Frequency domain filters applied
+// to the same image share one FFT.
+class FilterGraph {
+public:
+    explicit FilterGraph(const GraphSpec& spec);
+
+    // Number of filters applied during a run.
+    size_t GetFiltersCount() const;
+
+    // Calls write(path, image) for every output of the spec.
+    void Run(Image input, const std::function<void(const std::string&, const Image&)>& write) const;
+
+private:
+    struct Node {
+        FilterInput input;
+        std::shared_ptr<BaseFilter> filter;
+        std::vector<size_t> children;
+        std::vector<std::string> output_paths;
+        // Part of the parent's image the filter depends on.
+        Rect required_region;
+    };
+
+    void RunNode(size_t index, const Image& image,
+                 const std::function<void(const std::string&, const Image&)>& write) const;
+
+    // The root is the input image, every other node is a filter applied to the image of its parent. Children always
+    // have greater indexes than their parents.
+    std::vector<Node> nodes_;
+};
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "exceptions.h"
 
+#include <algorithm>
+
 Color::Color(double r, double g, double b) : r(r), g(g), b(b) {
 }
 
@@ -17,6 +19,21 @@ Color operator*(const Color& a, double x) {
     return {a.r * x, a.g * x, a.b * x};
 }
 
+bool operator==(const Rect& a, const Rect& b) {
+    return a.top == b.top && a.left == b.left && a.height == b.height && a.width == b.width;
+}
+
+bool operator==(const ImageShape& a, const ImageShape& b) {
+    return a.height == b.height && a.width == b.width && a.channels == b.channels && a.is_mask == b.is_mask;
+}
+
+uint64_t GetImageBytes(const ImageShape& shape) {
+    if (shape.is_mask) {
+        return shape.height * GetMaskStride(shape.width) * sizeof(uint64_t);
+    }
+    return shape.height * shape.width * shape.channels * sizeof(double);
+}
+
 Image::Image() {
 }
 
@@ -28,6 +45,17 @@ Image::Image(std::vector<std::vector<Color>>&& pixels) {
     SetPixels(std::move(pixels));
 }
 
+Image::Image(const size_t height, const size_t width, const size_t channels)
+    : values_(std::make_shared<std::vector<double>>(height * width * channels)),
+      channels_(channels),
+      stride_(width * channels),
+      height_(height),
+      width_(width) {
+    if (channels != GRAYSCALE_CHANNELS && channels != RGB_CHANNELS) {
+        throw InternalException("image must have 1 or 3 channels");
+    }
+}
+
 size_t Image::GetHeight() const {
     return height_;
 }
@@ -36,71 +64,194 @@ size_t Image::GetWidth() const {
     return width_;
 }
 
+size_t Image::GetChannels() const {
+    return is_mask_ ? GRAYSCALE_CHANNELS : channels_;
+}
+
+ImageShape Image::GetShape() const {
+    return ImageShape{height_, width_, GetChannels(), is_mask_};
+}
+
 Color Image::GetPixel(const size_t i, const size_t j) const {
     if (this->height_ <= i || this->width_ <= j) {
         throw InternalException("GetPixel coordinates are out of bounds");
     }
-    return pixels_[i][j];
+    if (is_mask_) {
+        const double value = GetMaskBit(i, j) ? 1.0 : 0.0;
+        return Color(value, value, value);
+    }
+    const double* pixel = values_->data() + offset_ + i * stride_ + j * channels_;
+    if (channels_ == GRAYSCALE_CHANNELS) {
+        return Color(pixel[0], pixel[0], pixel[0]);
+    }
+    return Color(pixel[0], pixel[1], pixel[2]);
 }
 
 std::vector<std::vector<Color>> Image::GetPixels() const {
-    return pixels_;
+    std::vector pixels(height_, std::vector<Color>(width_));
+    for (size_t i = 0; i < height_; ++i) {
+        for (size_t j = 0; j < width_; ++j) {
+            pixels[i][j] = GetPixel(i, j);
+        }
+    }
+    return pixels;
 }
 
 double NormalizeColorValue(const double x) {
     return std::max(0.0, std::min(1.0, x));
 }
 
+Color NormalizeColor(const Color& color) {
+    return {NormalizeColorValue(color.r), NormalizeColorValue(color.g), NormalizeColorValue(color.b)};
+}
+
+size_t GetMaskStride(const size_t width) {
+    constexpr size_t WordSize = 64;
+    return (width + WordSize - 1) / WordSize;
+}
+
 void Image::SetPixels(const std::vector<std::vector<Color>>& pixels) {
-    if (!pixels.empty()) {
-        const size_t width = pixels[0].size();
-        for (size_t i = 0; i < pixels.size(); ++i) {
-            if (pixels[i].size() != width) {
-                throw InternalException("trying to set image with different lengths of rows");
-            }
+    const size_t height = pixels.size();
+    const size_t width = pixels.empty() ? 0 : pixels[0].size();
+    for (size_t i = 0; i < height; ++i) {
+        if (pixels[i].size() != width) {
+            throw InternalException("trying to set image with different lengths of rows");
         }
     }
 
-    pixels_ = pixels;
-    for (size_t i = 0; i < pixels_.size(); ++i) {
-        for (size_t j = 0; j < pixels_[i].size(); ++j) {
-            pixels_[i][j].r = NormalizeColorValue(pixels_[i][j].r);
-            pixels_[i][j].g = NormalizeColorValue(pixels_[i][j].g);
-            pixels_[i][j].b = NormalizeColorValue(pixels_[i][j].b);
+    auto buffer = std::make_shared<std::vector<double>>(height * width * RGB_CHANNELS);
+    for (size_t i = 0; i < height; ++i) {
+        for (size_t j = 0; j < width; ++j) {
+            double* pixel = buffer->data() + (i * width + j) * RGB_CHANNELS;
+            pixel[0] = NormalizeColorValue(pixels[i][j].r);
+            pixel[1] = NormalizeColorValue(pixels[i][j].g);
+            pixel[2] = NormalizeColorValue(pixels[i][j].b);
         }
     }
 
-    height_ = pixels_.size();
-    if (height_ == 0) {
-        width_ = 0;
-    } else {
-        width_ = pixels[0].size();
-    }
+    values_ = std::move(buffer);
+    mask_.reset();
+    is_mask_ = false;
+    channels_ = RGB_CHANNELS;
+    offset_ = 0;
+    stride_ = width * RGB_CHANNELS;
+    height_ = height;
+    width_ = width;
 }
 
 void Image::SetPixels(std::vector<std::vector<Color>>&& pixels) {
-    if (!pixels.empty()) {
-        const size_t width = pixels[0].size();
-        for (size_t i = 0; i < pixels.size(); ++i) {
-            if (pixels[i].size() != width) {
-                throw InternalException("trying to set image with different lengths of rows");
-            }
-        }
+    SetPixels(pixels);
+    pixels.clear();
+}
+
+const double* Image::GetRow(const size_t i) const {
+    if (is_mask_) {
+        throw InternalException("trying to get row of the mask, it should be expanded first");
+    }
+    if (height_ <= i) {
+        throw InternalException("GetRow index is out of bounds");
+    }
+    return values_->data() + offset_ + i * stride_;
+}
+
+double* Image::GetMutableRow(const size_t i) {
+    if (is_mask_) {
+        throw InternalException("trying to get row of the mask, it should be expanded first");
+    }
+    if (height_ <= i) {
+        throw InternalException("GetMutableRow index is out of bounds");
     }
+    MakeUnique();
+    return values_->data() + offset_ + i * stride_;
+}
 
-    pixels_ = std::move(pixels);
-    for (size_t i = 0; i < pixels_.size(); ++i) {
-        for (size_t j = 0; j < pixels_[i].size(); ++j) {
-            pixels_[i][j].r = NormalizeColorValue(pixels_[i][j].r);
-            pixels_[i][j].g = NormalizeColorValue(pixels_[i][j].g);
-            pixels_[i][j].b = NormalizeColorValue(pixels_[i][j].b);
+bool Image::IsMask() const {
+    return is_mask_;
+}
+
+bool Image::GetMaskBit(const size_t i, const size_t j) const {
+    if (!is_mask_) {
+        throw InternalException("trying to get mask bit of the image that is not a mask");
+    }
+    if (height_ <= i || width_ <= j) {
+        throw InternalException("GetMaskBit coordinates are out of bounds");
+    }
+    constexpr size_t WordSize = 64;
+    const size_t bit = offset_ + i * stride_ + j;
+    return ((*mask_)[bit / WordSize] >> (bit % WordSize)) & 1;
+}
+
+void Image::SetMask(const size_t height, const size_t width, std::vector<uint64_t>&& mask) {
+    if (mask.size() != height * GetMaskStride(width)) {
+        throw InternalException("trying to set mask of incorrect size");
+    }
+    constexpr size_t WordSize = 64;
+    values_.reset();
+    mask_ = std::make_shared<std::vector<uint64_t>>(std::move(mask));
+    is_mask_ = true;
+    offset_ = 0;
+    stride_ = GetMaskStride(width) * WordSize;
+    height_ = height;
+    width_ = width;
+}
+
+uint64_t* Image::GetMutableMaskRow(const size_t i) {
+    if (!is_mask_) {
+        throw InternalException("trying to get mask row of the image that is not a mask");
+    }
+    if (height_ <= i) {
+        throw InternalException("GetMutableMaskRow index is out of bounds");
+    }
+    MakeUnique();
+    constexpr size_t WordSize = 64;
+    if (offset_ % WordSize != 0) {
+        throw InternalException("mask row does not start from a new word");
+    }
+    return mask_->data() + (offset_ + i * stride_) / WordSize;
+}
+
+void Image::ExpandMask() {
+    if (!is_mask_) {
+        return;
+    }
+    Image expanded(height_, width_, GRAYSCALE_CHANNELS);
+    for (size_t i = 0; i < height_; ++i) {
+        double* row = expanded.GetMutableRow(i);
+        for (size_t j = 0; j < width_; ++j) {
+            row[j] = GetMaskBit(i, j) ? 1.0 : 0.0;
         }
     }
+    *this = std::move(expanded);
+}
+
+void Image::Crop(const Rect& rect) {
+    if (rect.top + rect.height > height_ || rect.left + rect.width > width_) {
+        throw InternalException("trying to crop the image to the rectangle outside of it");
+    }
+    offset_ += rect.top * stride_ + rect.left * (is_mask_ ? 1 : channels_);
+    height_ = rect.height;
+    width_ = rect.width;
+}
 
-    height_ = pixels_.size();
-    if (height_ == 0) {
-        width_ = 0;
-    } else {
-        width_ = pixels_[0].size();
+void Image::MakeUnique() {
+    if (is_mask_ && mask_.use_count() > 1) {
+        std::vector<uint64_t> mask(height_ * GetMaskStride(width_));
+        for (size_t i = 0; i < height_; ++i) {
+            for (size_t j = 0; j < width_; ++j) {
+                constexpr size_t WordSize = 64;
+                mask[i * GetMaskStride(width_) + j / WordSize] |= static_cast<uint64_t>(GetMaskBit(i, j))
+                                                                  << (j % WordSize);
+            }
+        }
+        SetMask(height_, width_, std::move(mask));
+    } else if (!is_mask_ && values_.use_count() > 1) {
+        const size_t row_size = width_ * channels_;
+        auto buffer = std::make_shared<std::vector<double>>(height_ * row_size);
+        for (size_t i = 0; i < height_; ++i) {
+            std::copy(GetRow(i), GetRow(i) + row_size, buffer->data() + i * row_size);
+        }
+        values_ = std::move(buffer);
+        offset_ = 0;
+        stride_ = row_size;
     }
 }
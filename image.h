@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 struct Color {
@@ -19,14 +22,48 @@ Color operator*(const Color& a, double x);
 
 double NormalizeColorValue(double x);
 
+Color NormalizeColor(const Color& color);
+
+size_t GetMaskStride(size_t width);
+
+struct Rect {
+    size_t top = 0;
+    size_t left = 0;
+    size_t height = 0;
+    size_t width = 0;
+};
+
+bool operator==(const Rect& a, const Rect& b);
+
+constexpr size_t GRAYSCALE_CHANNELS = 1;
+constexpr size_t RGB_CHANNELS = 3;
+
+// Dimensions of an image without its pixels, used to plan memory before decoding.
+struct ImageShape {
+    size_t height = 0;
+    size_t width = 0;
+    size_t channels = RGB_CHANNELS;
+    bool is_mask = false;
+};
+
+bool operator==(const ImageShape& a, const ImageShape& b);
+
+// Size of the buffer of an image of the given shape.
+uint64_t GetImageBytes(const ImageShape& shape);
+
+// Pixels are stored as channel values one after another, so a grayscale image keeps one value per pixel and an RGB
+// image keeps three of them.
 class Image {
 public:
     Image();
     explicit Image(const std::vector<std::vector<Color>>& pixels);
     explicit Image(std::vector<std::vector<Color>>&& pixels);
+    Image(size_t height, size_t width, size_t channels = RGB_CHANNELS);
 
     size_t GetHeight() const;
     size_t GetWidth() const;
+    size_t GetChannels() const;
+    ImageShape GetShape() const;
 
     Color GetPixel(size_t i, size_t j) const;
     std::vector<std::vector<Color>> GetPixels() const;
@@ -34,7 +71,30 @@ public:
     void SetPixels(const std::vector<std::vector<Color>>& pixels);
     void SetPixels(std::vector<std::vector<Color>>&& pixels);
 
+    // Rows give direct access to the channel values. Values written through them must be already normalized.
+    const double* GetRow(size_t i) const;
+    double* GetMutableRow(size_t i);
+
+    // Black-and-white images are stored as 1 bit per pixel, every row starts from a new word of the mask. When
+    // expanded, the mask becomes a grayscale image.
+    bool IsMask() const;
+    bool GetMaskBit(size_t i, size_t j) const;
+
+    void SetMask(size_t height, size_t width, std::vector<uint64_t>&& mask);
+    uint64_t* GetMutableMaskRow(size_t i);
+    void ExpandMask();
+
+    // Turns the image into a view of the given rectangle, pixels are shared with the original buffer.
+    void Crop(const Rect& rect);
+
 private:
-    std::vector<std::vector<Color>> pixels_;
+    // Copies the pixels if the buffer is shared with other images.
+    void MakeUnique();
+
+    std::shared_ptr<std::vector<double>> values_;
+    std::shared_ptr<std::vector<uint64_t>> mask_;
+    bool is_mask_ = false;
+    size_t channels_ = RGB_CHANNELS;
+    size_t offset_ = 0, stride_ = 0;
     size_t height_ = 0, width_ = 0;
 };
\ No newline at end of file
@@ -1,22 +1,127 @@
 #include <iostream>
+#include <optional>
 
+#include "batch.h"
+#include "cache.h"
 #include "controller.h"
 #include "exceptions.h"
+#include "graph.h"
 #include "io.h"
+#include "memory_planner.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "profiler.h"
+#include "server.h"
+#include "spectrum_file.h"
 
 const std::string HELP = R"(DESCRIPTION
     Small console application for applying filters on images.
     Filters are applied in the order they appear in the command.
-    Supports only 24-bit uncompressed BMP files.
+    Supports BMP files with 4-bit and 8-bit palettes, uncompressed or
+    RLE, and with 24-bit and 32-bit pixels, binary PGM/PPM files and raw
+    images. The path - means stdin for the input and stdout for the output.
 
 USAGE
-    image_processor <input_path> <output_path> [-filter_name [<params>]]
+    image_processor <input_path> <output_path> [--option [<value>]] [-filter_name [<params>]]
+    image_processor --batch <manifest_path> [--option [<value>]] [-filter_name [<params>]]
+    image_processor --serve <socket_path> [--option [<value>]] [-filter_name [<params>]]
+    image_processor <input_path> --graph <graph_path> [--option [<value>]]
+    image_processor --info|--validate <input_path> [<input_path> ...]
 
 ARGUMENTS
     input_path
     output_path
 
+OPTIONS
+    --threads count            Number of threads used to apply filters. By default
+                               all hardware threads are used.
+    --batch manifest_path      Processes every file listed in the manifest. Every line
+                               is either a JSON object {"input": "a.bmp", "output":
+                               "b.bmp", "filters": "-gs -blur 2"} or a plain list
+                               a.bmp b.bmp -gs -blur 2. Filters of the line replace
+                               filters from the command line for this file. Failed
+                               files are reported and do not stop the batch. Files
+                               are read ahead and written behind while filters are
+                               applied.
+    --in-flight count          Maximum number of files processed at the same time in
+                               batch and server modes. By default equals the number
+                               of threads.
+    --serve socket_path        Runs as a server accepting jobs over the Unix domain
+                               socket, one JSON object per line:
+                               {"id": 1, "input": "a.bmp", "filters": "-gs",
+                               "output": "b.bmp"}. Instead of "input" the BMP file can
+                               be given as base64 in "input_data". Filters from the
+                               command line are used when a job has none. Every job
+                               gets a reply with "status" and timings in milliseconds.
+                               A job may set "deadline_ms", and {"command": "cancel",
+                               "id": 1} cancels a queued or running job.
+                               {"command": "stats"} returns the numbers of processed
+                               jobs and p50/p99 latencies, {"command": "shutdown"}
+                               stops the server.
+    --queue-size count         Maximum number of jobs waiting in the server queue, 64 by
+                               default. When the queue is full, requests are not read
+                               until there is space for them.
+    --graph graph_path         Applies the filter graph from the file to the input and
+                               writes several outputs. Every line either defines a named
+                               image: "name = source [-filter_name [<params>]]", where
+                               source is "input" or a name defined above, or writes it:
+                               "output name path". Common prefixes of the chains are
+                               computed once, and all FFT filters applied to the same
+                               image share one FFT.
+    --cache-dir path           Stores images after every prefix of the chain of filters
+                               in the directory, keyed by the hash of the input file
+                               and the prefix. Runs resume from the longest cached
+                               prefix, so only the changed tail of the chain is
+                               applied. Used in single file and batch modes.
+    --cache-size megabytes     Size limit of the cache directory, 1024 by default. Least
+                               recently used images are removed when it is exceeded.
+    --deadline milliseconds    Cancels a job that takes longer: the whole run in single
+                               file and graph modes, filtering of every file in batch
+                               mode, and every job counting from its arrival in server
+                               mode. Filters stop within a row or a tile.
+    --memory-limit megabytes   Estimates the peak memory of the job from the header of
+                               the input before decoding it and refuses the job if the
+                               estimate is above the limit. In batch and server modes
+                               the limit is shared: every file reserves its estimate
+                               and waits while the memory is taken by other files.
+    --bits count               Bits per pixel of written files: 4, 8, 24 or 32. By
+                               default grayscale results (-gs) are written as 8-bit
+                               files with a palette of grays, masks (-edge) as RLE8
+                               files with a palette of black and white and others as
+                               24-bit files. 4 bits are used only for masks, written
+                               with RLE4. Used in single file and graph modes.
+    --rle                      Compresses 8-bit grayscale results with RLE8 as well.
+                               Used in single file and graph modes.
+    --format name              Format of written files: bmp, ppm, pgm or raw. By
+                               default .ppm, .pgm and .raw files are written in their
+                               format and others, including stdout, as BMP.
+    --raw-size WxH[xC]         Reads the input as a raw image without a header: rows
+                               of 8-bit values from top to bottom with 1 or 3 channels,
+                               3 by default.
+    --save-spectrum path       Saves the spectrum computed for the first -fft-* filter.
+                               Used in single file mode.
+    --from-spectrum            Starts the chain from the spectrum saved in input_path
+                               instead of an image. The first filter must be -fft-*.
+    --info                     Prints a JSON line for every given file with its format,
+                               width, height, channels, bits per pixel and compression,
+                               read from the headers without decoding the pixels. The
+                               headers are validated and the size of the file is
+                               checked against them, invalid files get "valid": false
+                               and the error.
+    --validate                 Same as --info, but exits with status 1 if any file is
+                               invalid.
+    --profile trace_path       Records wall time, CPU time, allocated bytes and peak RSS
+                               of decoding, every filter and encoding. The trace is
+                               written in Chrome trace event format and a summary line
+                               is printed to stderr. Used in single file mode.
+    --explain                  Prints the plan of filters after optimization and the
+                               estimated memory of every stage, then exits without
+                               processing images. Before running, chains are
+                               rewritten to do fewer passes: crops go ahead of -gs and
+                               -neg, "-blur 0", "-neg -neg" are removed, repeated -gs
+                               are collapsed, and consecutive blurs are merged into one
+                               with sigma = sqrt(sigma1^2 + sigma2^2).
+
 FILTERS
     -crop height, width        Crops the image to [height, width]. If image is smaller
                                than requested result by any axis, it stays the same
@@ -29,13 +134,27 @@ FILTERS
                                fewer detected edges.
     -blur sigma                Applies Gaussian blur with parameter sigma. Higher
                                 sigma values produce a blurrier image.
+    -box radius                Replaces every pixel with the mean of the square of
+                               side 2 * radius + 1 around it, pixels outside of the
+                               image are taken from the nearest border. Computed from
+                               the integral image, the time does not depend on radius.
+    -localmean radius          Same as -box, but pixels outside of the image are left
+                               out of the mean.
+    -median radius             Replaces every value with the median of the square of
+                               side 2 * radius + 1 around the pixel, removes salt and
+                               pepper noise. The time does not depend on radius,
+                               values are rounded to 256 levels for radii above 1.
+    -resize height width [mode]
+                               Scales the image to [height, width]. Mode is box,
+                               bilinear, bicubic (default) or lanczos. Box by integer
+                               factors averages blocks of pixels in one pass.
 
     -fft-real [coefficient] [verbose]             Converts image into absolute values of real parts
                                                   of coefficients in frequency domain representation.
                                                   If [coefficient] is given, values are multiplied by it.
                                                   [verbose] should be either 0 or 1 and regulates printing
                                                   50 maximal values (without multiplication by
-                                                  [coefficient]).
+                                                  [coefficient]) to the standard error.
     -fft-imag [coefficient] [verbose]             Converts image into absolute values of imaginary parts
                                                   of coefficients in frequency domain representation. See -fft-real
                                                   for parameters description.
@@ -67,9 +186,25 @@ EXAMPLES
     $ image_processor a.bmp ./results/b.bmp -crop 20 10 -neg
     $ image_processor a.bmp ./results/b.bmp -sharp -gs -edge 0.3
     $ image_processor a.bmp ./results/b.bmp -blur 4.2
+    $ image_processor a.bmp ./results/b.bmp -box 50
+    $ image_processor fingerprint.bmp ./results/b.bmp -median 2 -gs
+    $ image_processor photo.bmp ./results/b.bmp -resize 3000 4000 lanczos -sharp
+    $ image_processor a.bmp ./results/b.bmp --threads 8 -sharp -blur 2
+    $ image_processor a.bmp ./results/b.bmp --profile trace.json -sharp -blur 2
+    $ image_processor a.bmp ./results/b.bmp --bits 32 -gs
+    $ image_processor a.ppm - --format pgm -gs | image_processor - b.bmp -neg
+    $ image_processor --batch manifest.jsonl -gs -edge 0.1
+    $ image_processor a.bmp b.bmp --cache-dir ./cache -fft-peaks 0.001 -sharp -edge 0.2
+    $ image_processor a.bmp --graph spectrum.txt
+    $ image_processor a.bmp b.bmp --explain -neg -gs -crop 20 10 -neg -blur 1 -blur 2
+    $ image_processor --serve /tmp/image_processor.sock --queue-size 16
+    $ image_processor --batch manifest.jsonl --memory-limit 4096 -fft-lowpass 0.1
     $ image_processor a.bmp ./results/b.bmp -fft-real 1000 1
     $ image_processor a.bmp ./results/b.bmp -fft-lowpass 0.01
-    $ image_processor a.bmp ./results/b.bmp -fft-peaks 0.001 0.01 0.01)";
+    $ image_processor a.bmp ./results/b.bmp -fft-peaks 0.001 0.01 0.01
+    $ image_processor a.bmp b.bmp -gs -fft-peaks 0.001 --save-spectrum a.spectrum
+    $ image_processor a.spectrum c.bmp --from-spectrum -fft-peaks 0.002
+    $ image_processor --validate uploads/*.bmp)";
 
 int main(int argc, char** argv) {
     if (argc == 1) {
@@ -78,10 +213,166 @@ int main(int argc, char** argv) {
     }
     try {
         const ParserResult params = Parse(argc, argv);
-        Image image = ReadImage(params.input_path);
-        const std::vector<std::shared_ptr<BaseFilter>> filters = CreateFilters(params.filters);
-        ApplyFilters(image, filters);
-        WriteImage(image, params.output_path);
+        ConfigureThreads(params.options);
+        if (params.options.contains("info") || params.options.contains("validate")) {
+            bool all_valid = true;
+            for (const std::string& path : params.input_paths) {
+                const JsonValue report = InspectImage(path);
+                all_valid = all_valid && report.Find("valid")->GetBool();
+                std::cout << WriteJson(report) << std::endl;
+            }
+            return params.options.contains("validate") && !all_valid ? 1 : 0;
+        }
+        if (params.options.contains("explain")) {
+            if (params.options.contains("graph")) {
+                const GraphSpec spec = ReadGraphSpec(params.options.at("graph"));
+                const auto chains = GetImageChains(spec);
+                for (const GraphOutput& output : spec.outputs) {
+                    std::cout << "output " << output.path << "\n" << ExplainPlan(chains.at(output.name));
+                }
+            } else {
+                std::cout << ExplainPlan(params.filters);
+                // The memory is estimated from the header of the input if it can be read.
+                if (!params.input_path.empty()) {
+                    try {
+                        const std::vector<FilterInput> inputs = OptimizeFilters(params.filters).filters;
+                        const std::optional<ImageShape> raw_shape = GetRawShape(params.options);
+                        const ImageShape shape =
+                            raw_shape.has_value() ? *raw_shape : ReadImageShape(params.input_path);
+                        std::cout << ExplainMemory(EstimateMemory(shape, CreateFilters(inputs)), inputs);
+                    } catch (const ImageProcessorException& exc) {
+                        std::cout << "memory: unknown, " << exc.what() << "\n";
+                    }
+                }
+            }
+            return 0;
+        }
+        if (params.options.contains("batch")) {
+            const std::unique_ptr<ResultCache> cache = CreateResultCache(params.options);
+            const std::optional<uint64_t> memory_limit = GetMemoryLimit(params.options);
+            std::optional<MemoryBudget> budget;
+            if (memory_limit.has_value()) {
+                budget.emplace(*memory_limit);
+            }
+            RunBatch(ReadManifest(params.options.at("batch")), params.filters, GetMaxInFlight(params.options),
+                     std::cerr, cache.get(), GetDeadline(params.options), budget.has_value() ? &*budget : nullptr);
+            return 0;
+        }
+        const CancellationToken token = CreateCancellationToken(GetDeadline(params.options));
+        const std::optional<uint16_t> bit_count = GetBitCount(params.options);
+        const bool rle = params.options.contains("rle");
+        const std::optional<ImageFormat> format = GetOutputFormat(params.options);
+        const std::optional<ImageShape> raw_shape = GetRawShape(params.options);
+        const auto read_input = [&params, &raw_shape] {
+            return raw_shape.has_value() ? ReadRawImage(params.input_path, *raw_shape) : ReadImage(params.input_path);
+        };
+        if (params.options.contains("graph")) {
+            if (params.options.contains("profile") || params.options.contains("cache-dir")) {
+                throw UsageException("--profile and --cache-dir can not be used with --graph");
+            }
+            const GraphSpec spec = ReadGraphSpec(params.options.at("graph"));
+            const std::optional<uint64_t> memory_limit = GetMemoryLimit(params.options);
+            const auto check_memory_limit = [&memory_limit, &spec](const ImageShape& shape) {
+                if (memory_limit.has_value()) {
+                    CheckMemoryLimit(EstimateGraphPeakBytes(shape, spec), *memory_limit);
+                }
+            };
+            // Every output chain is checked before decoding, images from stdin after it.
+            const bool shape_after_decoding = params.input_path == STDIO_PATH && !raw_shape.has_value();
+            if (!shape_after_decoding) {
+                check_memory_limit(raw_shape.has_value() ? *raw_shape : ReadImageShape(params.input_path));
+            }
+            const CancellationScope scope(&token);
+            const FilterGraph graph(spec);
+            Image input = read_input();
+            if (shape_after_decoding) {
+                check_memory_limit(input.GetShape());
+            }
+            graph.Run(std::move(input), [bit_count, rle, format](const std::string& path, const Image& image) {
+                WriteImage(image, path, bit_count, rle, format);
+            });
+            return 0;
+        }
+        if (params.options.contains("serve")) {
+            constexpr size_t DefaultQueueSize = 64;
+            Server server(params.options.at("serve"), params.filters, GetMaxInFlight(params.options),
+                          GetPositiveOption(params.options, "queue-size").value_or(DefaultQueueSize),
+                          GetDeadline(params.options), GetMemoryLimit(params.options));
+            server.Run();
+            return 0;
+        }
+        const std::vector<FilterInput> inputs = OptimizeFilters(params.filters).filters;
+        const std::vector<std::shared_ptr<BaseFilter>> filters = CreateFilters(inputs);
+        const std::optional<uint64_t> memory_limit = GetMemoryLimit(params.options);
+        const auto check_memory_limit = [&memory_limit, &filters](const ImageShape& shape) {
+            if (memory_limit.has_value()) {
+                CheckMemoryLimit(EstimateMemory(shape, filters).peak_bytes, *memory_limit);
+            }
+        };
+        SpectrumFiles spectrum_files;
+        if (params.options.contains("from-spectrum")) {
+            spectrum_files.input_path = params.input_path;
+        }
+        if (params.options.contains("save-spectrum")) {
+            spectrum_files.output_path = params.options.at("save-spectrum");
+        }
+        const bool use_spectrum_files = spectrum_files.input_path.has_value() || spectrum_files.output_path.has_value();
+        // The header of stdin can not be read twice, so such images are checked after decoding, before the filters.
+        const bool shape_after_decoding = params.input_path == STDIO_PATH && !raw_shape.has_value();
+        if (spectrum_files.input_path.has_value()) {
+            check_memory_limit(MappedSpectrum(params.input_path).GetImageShape());
+        } else if (!shape_after_decoding) {
+            check_memory_limit(raw_shape.has_value() ? *raw_shape : ReadImageShape(params.input_path));
+        }
+        const std::unique_ptr<ResultCache> cache = CreateResultCache(params.options);
+        if (cache != nullptr && (raw_shape.has_value() || use_spectrum_files)) {
+            throw UsageException("raw inputs and spectrum files can not be used with --cache-dir");
+        }
+        std::optional<Profiler> profiler;
+        if (params.options.contains("profile")) {
+            profiler.emplace();
+        }
+        Profiler* const profiler_pointer = profiler.has_value() ? &*profiler : nullptr;
+        const CancellationScope scope(&token);
+
+        // Chains of pointwise filters are applied to uncompressed BMP files as lookup tables, without decoding them.
+        const bool lut_allowed = cache == nullptr && !use_spectrum_files && !raw_shape.has_value() &&
+                                 params.input_path != STDIO_PATH && !bit_count.has_value() && !rle &&
+                                 format.value_or(GetFileFormat(params.output_path)) == ImageFormat::Bmp;
+        const std::optional<std::vector<ChannelLut>> luts = lut_allowed ? ComposeLuts(filters) : std::nullopt;
+        bool lut_applied = false;
+        if (luts.has_value()) {
+            MeasureStage(profiler_pointer, "lookup tables", "filter", [&] {
+                lut_applied = ApplyLutsToBmp(params.input_path, params.output_path, *luts);
+            });
+        }
+
+        if (!lut_applied) {
+            Image image;
+            if (cache != nullptr) {
+                MeasureStage(profiler_pointer, "cached filters", "filter", [&] {
+                    image = ReadAndApplyFilters(params.input_path, inputs, filters, *cache);
+                });
+            } else {
+                if (!spectrum_files.input_path.has_value()) {
+                    MeasureStage(profiler_pointer, "decode", "io", [&] { image = read_input(); });
+                }
+                if (shape_after_decoding) {
+                    check_memory_limit(image.GetShape());
+                }
+                if (use_spectrum_files) {
+                    ApplyFilters(image, filters, inputs, profiler_pointer, spectrum_files);
+                } else {
+                    ApplyFilters(image, filters, inputs, profiler_pointer);
+                }
+            }
+            MeasureStage(profiler_pointer, "encode", "io",
+                         [&] { WriteImage(image, params.output_path, bit_count, rle, format); });
+        }
+        if (profiler.has_value()) {
+            profiler->WriteTrace(params.options.at("profile"));
+            std::cerr << profiler->GetSummary() << std::endl;
+        }
     } catch (const ImageProcessorException& exc) {
         std::cerr << exc.what() << std::endl;
     } catch (const std::exception& exc) {
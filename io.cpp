@@ -1,30 +1,53 @@
 #include "io.h"
 
 #include "exceptions.h"
+#include "thread_pool.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
 
 #include <cstdint>
 
+constexpr uint32_t NoCompression = 0;
+constexpr uint32_t Rle8Compression = 1;
+constexpr uint32_t Rle4Compression = 2;
+constexpr uint32_t BitFieldsCompression = 3;
+
 BinaryReader::BinaryReader() {
 }
 
-BinaryReader::BinaryReader(const std::string& filename) : in_(filename, std::ios::binary) {
+BinaryReader::BinaryReader(const std::string& filename)
+    : file_(std::make_unique<std::ifstream>(filename, std::ios::binary)), in_(file_.get()) {
+}
+
+BinaryReader::BinaryReader(std::istream& in) : in_(&in) {
 }
 
 template <std::integral T>
 void BinaryReader::Read(T& value) {
     value = 0;
-    for (int i = 0; i < sizeof(T); i++) {
+    for (size_t i = 0; i < sizeof(T); i++) {
         char buffer = '\0';
         try {
-            in_.read(&buffer, 1);
+            in_->read(&buffer, 1);
         } catch (const std::exception& exc) {
             throw ReadException(exc.what());
         }
-        if (in_.eof()) {
+        if (in_->eof()) {
             throw ReadException("reached end of file");
         }
         constexpr uint8_t ByteSize = 8;
@@ -32,15 +55,26 @@ void BinaryReader::Read(T& value) {
     }
 }
 
+void BinaryReader::ReadBytes(uint8_t* data, const size_t count) {
+    try {
+        in_->read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(count));
+    } catch (const std::exception& exc) {
+        throw ReadException(exc.what());
+    }
+    if (static_cast<size_t>(in_->gcount()) != count) {
+        throw ReadException("reached end of file");
+    }
+}
+
 void BinaryReader::Skip(size_t bytes_count) {
     char buffer = '\0';
     while (bytes_count--) {
         try {
-            in_.read(&buffer, 1);
+            in_->read(&buffer, 1);
         } catch (const std::exception& exc) {
             throw ReadException(exc.what());
         }
-        if (in_.eof()) {
+        if (in_->eof()) {
             throw ReadException("reached end of file");
         }
     }
@@ -49,7 +83,11 @@ void BinaryReader::Skip(size_t bytes_count) {
 BinaryWriter::BinaryWriter() {
 }
 
-BinaryWriter::BinaryWriter(const std::string& filename) : out_(filename, std::ios::binary) {
+BinaryWriter::BinaryWriter(const std::string& filename)
+    : file_(std::make_unique<std::ofstream>(filename, std::ios::binary)), out_(file_.get()) {
+}
+
+BinaryWriter::BinaryWriter(std::ostream& out) : out_(&out) {
 }
 
 template <std::integral T>
@@ -59,32 +97,81 @@ void BinaryWriter::Write(const T& value) {
             constexpr uint8_t ByteSize = 8;
             constexpr uint8_t ByteMask = 0xFF;
             char c = static_cast<char>(static_cast<uint8_t>(value >> (i * ByteSize)) & ByteMask);
-            out_.write(&c, 1);
+            out_->write(&c, 1);
         }
     } catch (const std::exception& exc) {
         throw WriteException(exc.what());
     }
 }
 
+void BinaryWriter::WriteBytes(const uint8_t* data, const size_t count) {
+    try {
+        out_->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count));
+    } catch (const std::exception& exc) {
+        throw WriteException(exc.what());
+    }
+}
+
 void BinaryWriter::WriteZero(size_t bytes_count) {
     try {
         constexpr char Zero = '\0';
         while (bytes_count--) {
-            out_.write(&Zero, 1);
+            out_->write(&Zero, 1);
         }
     } catch (const std::exception& exc) {
         throw WriteException(exc.what());
     }
 }
 
-Image ReadImage(const std::string& filename) {
-    BinaryReader reader;
-    try {
-        reader = BinaryReader(filename);
-    } catch (const std::exception& exc) {
-        throw ReadException(exc.what());
+ImageFormat ParseImageFormat(const std::string& name) {
+    if (name == "bmp") {
+        return ImageFormat::Bmp;
+    }
+    if (name == "ppm") {
+        return ImageFormat::Ppm;
     }
+    if (name == "pgm") {
+        return ImageFormat::Pgm;
+    }
+    if (name == "raw") {
+        return ImageFormat::Raw;
+    }
+    throw UsageException("unknown image format " + name + ", should be bmp, ppm, pgm or raw");
+}
 
+ImageFormat GetFileFormat(const std::string& filename) {
+    std::string extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    if (extension == ".ppm") {
+        return ImageFormat::Ppm;
+    }
+    if (extension == ".pgm") {
+        return ImageFormat::Pgm;
+    }
+    if (extension == ".raw") {
+        return ImageFormat::Raw;
+    }
+    return ImageFormat::Bmp;
+}
+
+
+size_t GetBmpRowSize(const size_t width, const uint16_t bit_count) {
+    constexpr size_t DwordBits = 32;
+    constexpr size_t DwordSize = 4;
+    return (width * bit_count + DwordBits - 1) / DwordBits * DwordSize;
+}
+
+bool IsGrayscalePalette(const std::vector<Color>& palette) {
+    return std::all_of(palette.begin(), palette.end(),
+                       [](const Color& color) { return color.r == color.g && color.g == color.b; });
+}
+
+bool IsRle(const BmpHeader& header) {
+    return header.compression == Rle8Compression || header.compression == Rle4Compression;
+}
+
+BmpHeader ReadBmpHeader(BinaryReader& reader) {
     char bf_type1 = 0;
     char bf_type2 = 0;
     uint32_t bf_size = 0;
@@ -136,63 +223,246 @@ Image ReadImage(const std::string& filename) {
         throw CorruptedFileException("biPlanes must be equal to 1");
     }
 
-    constexpr size_t BitsPerPixel = 24;
     reader.Read(bi_bit_count);
-    if (bi_bit_count != BitsPerPixel) {
-        throw SupportException("files with encoding different from 24 bits per pixel are not supported");
+    if (bi_bit_count != PALETTE4_BITS && bi_bit_count != PALETTE8_BITS && bi_bit_count != RGB_BITS &&
+        bi_bit_count != RGBX_BITS) {
+        throw SupportException("files with encoding different from 4, 8, 24 or 32 bits per pixel are not supported");
     }
 
+    // Bit fields are accepted for 32-bit files only if they describe the usual BGRX layout.
     reader.Read(bi_compression);
-    if (bi_compression != 0) {
-        throw SupportException("compressed files are not supported");
+    if (bi_compression != NoCompression && !(bi_compression == Rle8Compression && bi_bit_count == PALETTE8_BITS) &&
+        !(bi_compression == Rle4Compression && bi_bit_count == PALETTE4_BITS) &&
+        !(bi_compression == BitFieldsCompression && bi_bit_count == RGBX_BITS)) {
+        throw SupportException("compression " + std::to_string(bi_compression) + " of " +
+                               std::to_string(bi_bit_count) + "-bit files is not supported");
+    }
+    const bool rle = bi_compression == Rle8Compression || bi_compression == Rle4Compression;
+    // RLE rows always go from bottom to top.
+    if (rle && bi_height < 0) {
+        throw CorruptedFileException("RLE files can not be stored from top to bottom");
     }
 
+    const size_t height = std::abs(bi_height);
+    const size_t row_size = GetBmpRowSize(bi_width, bi_bit_count);
     reader.Read(bi_size_image);
-    if (bi_size_image != 0 && bi_size_image != 3 * std::abs(bi_height) * bi_width) {
-        throw CorruptedFileException("incorrect size of the image: " + std::to_string(bi_size_image) + ", should be" +
-                                     std::to_string(3 * std::abs(bi_height) * bi_width));
+    if (rle && bi_size_image == 0) {
+        throw CorruptedFileException("size of the image must be given for RLE files");
+    }
+    // 24-bit files written without counting the padding of rows are accepted too.
+    if (!rle && bi_size_image != 0 && bi_size_image != row_size * height &&
+        !(bi_bit_count == RGB_BITS && bi_size_image == 3 * height * bi_width)) {
+        throw CorruptedFileException("incorrect size of the image: " + std::to_string(bi_size_image) +
+                                     ", should be " + std::to_string(row_size * height));
     }
 
     reader.Read(bi_x_pels_per_meter);
     reader.Read(bi_y_pels_per_meter);
 
+    const bool palettized = bi_bit_count <= PALETTE8_BITS;
+    const size_t max_palette_size = size_t{1} << bi_bit_count;
     reader.Read(bi_clr_used);
-    if (bi_clr_used != 0) {
+    if (palettized ? bi_clr_used > max_palette_size : bi_clr_used != 0) {
         throw SupportException("files with custom color map are not supported");
     }
 
     reader.Read(bi_clr_important);
-    if (bi_clr_important != 0) {
+    if (!palettized && bi_clr_important != 0) {
         throw SupportException("files with custom significant colors are not supported");
     }
 
-    constexpr size_t FileHeaderSize = 54;
-    if (bf_off_bits < FileHeaderSize) {
-        throw CorruptedFileException("bfOffBits must be at least the size of the header");
+    constexpr size_t FileHeaderSize = 14;
+    size_t offset = FileHeaderSize + MinImageHeaderSize;
+    if (bi_compression == BitFieldsCompression) {
+        constexpr uint32_t RedMask = 0x00FF0000;
+        constexpr uint32_t GreenMask = 0x0000FF00;
+        constexpr uint32_t BlueMask = 0x000000FF;
+        uint32_t red_mask = 0;
+        uint32_t green_mask = 0;
+        uint32_t blue_mask = 0;
+        reader.Read(red_mask);
+        reader.Read(green_mask);
+        reader.Read(blue_mask);
+        if (red_mask != RedMask || green_mask != GreenMask || blue_mask != BlueMask) {
+            throw SupportException("32-bit files with channel masks different from BGRX are not supported");
+        }
+        constexpr size_t MasksSize = 12;
+        offset += MasksSize;
     }
-    reader.Skip(bf_off_bits - FileHeaderSize);
-
-    std::vector pixels(std::abs(bi_height), std::vector<Color>(bi_width));
 
-    constexpr size_t DwordSize = 4;
-    const size_t padding = ((bi_width * 3 + DwordSize - 1) / DwordSize) * DwordSize - bi_width * 3;
-    for (size_t i = 0; i < std::abs(bi_height); ++i) {
-        for (size_t j = 0; j < bi_width; ++j) {
+    std::vector<Color> palette;
+    if (palettized) {
+        if (offset > FileHeaderSize + bi_size) {
+            throw CorruptedFileException("palette must follow the image header");
+        }
+        reader.Skip(FileHeaderSize + bi_size - offset);
+        palette.resize(bi_clr_used == 0 ? max_palette_size : bi_clr_used);
+        for (Color& color : palette) {
             uint8_t r = 0;
             uint8_t g = 0;
             uint8_t b = 0;
+            uint8_t reserved = 0;
             reader.Read(b);
             reader.Read(g);
             reader.Read(r);
+            reader.Read(reserved);
+            color = Color(static_cast<double>(r) / COLOR_MAX_VALUE, static_cast<double>(g) / COLOR_MAX_VALUE,
+                          static_cast<double>(b) / COLOR_MAX_VALUE);
+        }
+        constexpr size_t PaletteEntrySize = 4;
+        offset = FileHeaderSize + bi_size + palette.size() * PaletteEntrySize;
+    }
 
-            constexpr double ColorMaxValue = 255.0;
-            pixels[(bi_height >= 0 ? bi_height - i - 1 : i)][j] =
-                Color(static_cast<double>(r) / ColorMaxValue, static_cast<double>(g) / ColorMaxValue,
-                      static_cast<double>(b) / ColorMaxValue);
+    if (bf_off_bits < offset) {
+        throw CorruptedFileException("bfOffBits must be at least the size of the header");
+    }
+    reader.Skip(bf_off_bits - offset);
+
+    if (bf_size != bf_off_bits + (rle ? bi_size_image : height * row_size)) {
+        throw CorruptedFileException("incorrect declared size of the file");
+    }
+
+    return BmpHeader{bf_size,        bf_off_bits,   bi_width, bi_height, bi_bit_count,
+                     bi_compression, bi_size_image, std::move(palette)};
+}
+
+ImageShape GetImageShape(const BmpHeader& header) {
+    const bool grayscale = header.bit_count <= PALETTE8_BITS && IsGrayscalePalette(header.palette);
+    return ImageShape{static_cast<size_t>(std::abs(header.height)), header.width,
+                      grayscale ? GRAYSCALE_CHANNELS : RGB_CHANNELS, false};
+}
+
+// Colors of a row of palettized pixels, one index per pixel.
+void DecodeIndexes(const BmpHeader& header, const uint8_t* indexes, double* dst, const size_t channels) {
+    const size_t width = header.width;
+    for (size_t j = 0; j < width; ++j) {
+        if (indexes[j] >= header.palette.size()) {
+            throw CorruptedFileException("pixel refers to a color outside of the palette");
         }
-        reader.Skip(padding);
     }
+    if (channels == GRAYSCALE_CHANNELS) {
+        for (size_t j = 0; j < width; ++j) {
+            dst[j] = header.palette[indexes[j]].r;
+        }
+        return;
+    }
+    for (size_t j = 0; j < width; ++j) {
+        const Color& color = header.palette[indexes[j]];
+        dst[j * RGB_CHANNELS] = color.r;
+        dst[j * RGB_CHANNELS + 1] = color.g;
+        dst[j * RGB_CHANNELS + 2] = color.b;
+    }
+}
+
+// Channel values of a row of the file in the order of the image, pixels of 24-bit and 32-bit files are stored as BGR.
+// 4-bit rows are unpacked to the indexes buffer first.
+void DecodeRow(const BmpHeader& header, const uint8_t* src, double* dst, const size_t channels,
+               std::vector<uint8_t>& indexes) {
+    const size_t width = header.width;
+    if (header.bit_count == PALETTE4_BITS) {
+        constexpr uint8_t NibbleSize = 4;
+        constexpr uint8_t NibbleMask = 0x0F;
+        indexes.resize(width);
+        for (size_t j = 0; j < width; ++j) {
+            indexes[j] = j % 2 == 0 ? src[j / 2] >> NibbleSize : src[j / 2] & NibbleMask;
+        }
+        DecodeIndexes(header, indexes.data(), dst, channels);
+        return;
+    }
+    if (header.bit_count == PALETTE8_BITS) {
+        DecodeIndexes(header, src, dst, channels);
+        return;
+    }
+    // Rows are converted in a loop without branches, which the compiler vectorizes.
+    constexpr size_t ByteSize = 8;
+    const size_t pixel_size = header.bit_count / ByteSize;
+    for (size_t j = 0; j < width; ++j) {
+        const uint8_t* pixel = src + j * pixel_size;
+        dst[j * RGB_CHANNELS] = static_cast<double>(pixel[2]) / COLOR_MAX_VALUE;
+        dst[j * RGB_CHANNELS + 1] = static_cast<double>(pixel[1]) / COLOR_MAX_VALUE;
+        dst[j * RGB_CHANNELS + 2] = static_cast<double>(pixel[0]) / COLOR_MAX_VALUE;
+    }
+}
+
+// Expands RLE8 or RLE4 data into one palette index per pixel, rows from bottom to top. Pixels skipped by the end of a
+// line, a delta or the end of the bitmap get the index 0.
+std::vector<uint8_t> DecodeRle(const BmpHeader& header, const std::vector<uint8_t>& data) {
+    constexpr uint8_t EndOfLine = 0;
+    constexpr uint8_t EndOfBitmap = 1;
+    constexpr uint8_t Delta = 2;
+    constexpr uint8_t NibbleSize = 4;
+    constexpr uint8_t NibbleMask = 0x0F;
+    const size_t width = header.width;
+    const size_t height = header.height;
+    const bool rle4 = header.compression == Rle4Compression;
+    std::vector<uint8_t> indexes(height * width, 0);
+
+    size_t position = 0;
+    const auto next = [&] {
+        if (position >= data.size()) {
+            throw CorruptedFileException("RLE data ends in the middle of a command");
+        }
+        return data[position++];
+    };
+    size_t x = 0;
+    size_t y = 0;
+    const auto check_run = [&](const size_t count) {
+        if (y >= height || x > width || count > width - x) {
+            throw CorruptedFileException("RLE run goes outside of the image");
+        }
+    };
+
+    while (position < data.size()) {
+        const uint8_t count = next();
+        const uint8_t value = next();
+        if (count > 0) {
+            // Encoded run, the two nibbles of RLE4 alternate.
+            check_run(count);
+            uint8_t* run = indexes.data() + y * width + x;
+            if (rle4) {
+                for (size_t k = 0; k < count; ++k) {
+                    run[k] = k % 2 == 0 ? value >> NibbleSize : value & NibbleMask;
+                }
+            } else {
+                std::fill(run, run + count, value);
+            }
+            x += count;
+        } else if (value == EndOfLine) {
+            x = 0;
+            ++y;
+        } else if (value == EndOfBitmap) {
+            break;
+        } else if (value == Delta) {
+            x += next();
+            y += next();
+            if (x > width || y > height) {
+                throw CorruptedFileException("RLE delta goes outside of the image");
+            }
+        } else {
+            // Absolute mode, the literal pixels are padded to 16 bits.
+            check_run(value);
+            const size_t bytes_count = rle4 ? (value + 1) / 2 : value;
+            const size_t padded_count = bytes_count + bytes_count % 2;
+            if (padded_count > data.size() - position) {
+                throw CorruptedFileException("RLE data ends in the middle of a command");
+            }
+            const uint8_t* literal = data.data() + position;
+            uint8_t* run = indexes.data() + y * width + x;
+            if (rle4) {
+                for (size_t k = 0; k < value; ++k) {
+                    run[k] = k % 2 == 0 ? literal[k / 2] >> NibbleSize : literal[k / 2] & NibbleMask;
+                }
+            } else {
+                std::copy(literal, literal + value, run);
+            }
+            x += value;
+            position += padded_count;
+        }
+    }
+    return indexes;
+}
 
+void CheckEndOfFile(BinaryReader& reader) {
     bool reached_eof = false;
     try {
         reader.Skip(1);
@@ -207,56 +477,727 @@ Image ReadImage(const std::string& filename) {
     if (!reached_eof) {
         throw CorruptedFileException("file has extra bytes in the end");
     }
+}
 
-    if (bf_size != bf_off_bits + std::abs(bi_height) * (3 * bi_width + padding)) {
-        throw CorruptedFileException("incorrect declared size of the file");
+// Fields of the PGM and PPM headers.
+struct PnmHeader {
+    ImageShape shape;
+    uint16_t max_value = COLOR_MAX_VALUE;
+};
+
+// Decimal value of the header, whitespace and comments before it are skipped and one whitespace after it is read.
+size_t ReadPnmValue(BinaryReader& reader) {
+    uint8_t c = 0;
+    reader.Read(c);
+    while (std::isspace(c) || c == '#') {
+        if (c == '#') {
+            while (c != '\n' && c != '\r') {
+                reader.Read(c);
+            }
+        }
+        reader.Read(c);
+    }
+    if (!std::isdigit(c)) {
+        throw CorruptedFileException("PGM/PPM header must consist of decimal values");
+    }
+    constexpr size_t MaxValue = 1 << 30;
+    constexpr size_t Base = 10;
+    size_t value = 0;
+    while (std::isdigit(c)) {
+        value = value * Base + (c - '0');
+        if (value > MaxValue) {
+            throw CorruptedFileException("value of the PGM/PPM header is too large");
+        }
+        reader.Read(c);
+    }
+    if (!std::isspace(c)) {
+        throw CorruptedFileException("values of the PGM/PPM header must be separated by whitespace");
+    }
+    return value;
+}
+
+PnmHeader ReadPnmHeader(BinaryReader& reader) {
+    uint8_t magic = 0;
+    uint8_t kind = 0;
+    reader.Read(magic);
+    reader.Read(kind);
+    if (magic != 'P' || kind < '1' || kind > '7') {
+        throw CorruptedFileException("PGM/PPM files must start with P5 or P6");
+    }
+    if (kind != '5' && kind != '6') {
+        throw SupportException("only binary PGM and PPM files (P5 and P6) are supported");
     }
+    PnmHeader header;
+    header.shape.channels = kind == '5' ? GRAYSCALE_CHANNELS : RGB_CHANNELS;
+    header.shape.width = ReadPnmValue(reader);
+    header.shape.height = ReadPnmValue(reader);
+    constexpr size_t MaxSampleValue = 65535;
+    const size_t max_value = ReadPnmValue(reader);
+    if (max_value == 0 || max_value > MaxSampleValue) {
+        throw CorruptedFileException("maximal value of PGM/PPM files must be from 1 to 65535");
+    }
+    header.max_value = static_cast<uint16_t>(max_value);
+    return header;
+}
+
+// Reads rows of samples from top to bottom, samples above 255 take two bytes with the high byte first.
+void ReadSamples(BinaryReader& reader, Image& image, const uint16_t max_value) {
+    constexpr size_t ByteSize = 8;
+    const size_t sample_size = max_value > COLOR_MAX_VALUE ? 2 : 1;
+    const size_t samples_count = image.GetWidth() * image.GetChannels();
+    std::vector<uint8_t> row(samples_count * sample_size);
+    for (size_t i = 0; i < image.GetHeight(); ++i) {
+        reader.ReadBytes(row.data(), row.size());
+        double* dst = image.GetMutableRow(i);
+        for (size_t k = 0; k < samples_count; ++k) {
+            const uint16_t value =
+                sample_size == 1 ? row[k] : static_cast<uint16_t>(row[2 * k] << ByteSize | row[2 * k + 1]);
+            if (value > max_value) {
+                throw CorruptedFileException("sample is above the maximal value of the file");
+            }
+            dst[k] = static_cast<double>(value) / max_value;
+        }
+    }
+}
+
+// Decodes the pixels following the headers in the stream row by row.
+Image ReadBmpPixels(const BmpHeader& header, BinaryReader& reader) {
+    const ImageShape shape = GetImageShape(header);
+
+    Image image(shape.height, shape.width, shape.channels);
+    if (IsRle(header)) {
+        std::vector<uint8_t> data(header.image_size);
+        reader.ReadBytes(data.data(), data.size());
+        const std::vector<uint8_t> indexes = DecodeRle(header, data);
+        for (size_t i = 0; i < shape.height; ++i) {
+            DecodeIndexes(header, indexes.data() + i * shape.width, image.GetMutableRow(shape.height - i - 1),
+                          shape.channels);
+        }
+    } else {
+        std::vector<uint8_t> row(GetBmpRowSize(header.width, header.bit_count));
+        std::vector<uint8_t> indexes;
+        for (size_t i = 0; i < shape.height; ++i) {
+            reader.ReadBytes(row.data(), row.size());
+            DecodeRow(header, row.data(), image.GetMutableRow(header.height >= 0 ? shape.height - i - 1 : i),
+                      shape.channels, indexes);
+        }
+    }
+    return image;
+}
+
+// Reads the bytes at the offset of the file, pread may return fewer bytes than asked for.
+void ReadAt(const int fd, uint8_t* data, size_t count, off_t offset) {
+    while (count > 0) {
+        const ssize_t read_count = pread(fd, data, count, offset);
+        if (read_count < 0) {
+            throw ReadException(std::strerror(errno));
+        }
+        if (read_count == 0) {
+            throw ReadException("reached end of file");
+        }
+        data += read_count;
+        count -= read_count;
+        offset += read_count;
+    }
+}
 
-    return Image(std::move(pixels));
+// Rows of uncompressed files sit at fixed offsets, so slices of rows are read with pread and decoded by the thread
+// pool, every slice directly into its rows of the image. Returns nullopt if the file is not a regular file.
+std::optional<Image> ReadBmpPixelsInParallel(const std::string& filename, const BmpHeader& header) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw ReadException("could not open " + filename);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    const ImageShape shape = GetImageShape(header);
+    const size_t row_size = GetBmpRowSize(header.width, header.bit_count);
+    const uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    const uint64_t pixels_end = header.pixels_offset + shape.height * row_size;
+    if (file_size != pixels_end) {
+        close(fd);
+        if (file_size < pixels_end) {
+            throw ReadException("reached end of file");
+        }
+        throw CorruptedFileException("file has extra bytes in the end");
+    }
+
+    // Slices are large enough for reads to pay off and several per thread, so that faster threads take more of them.
+    constexpr size_t MinSliceBytes = 1 << 18;
+    constexpr size_t SlicesPerThread = 4;
+    const size_t slices_count =
+        std::clamp<size_t>(shape.height * row_size / MinSliceBytes, 1,
+                           std::min(shape.height, GetThreadPool().GetThreadsCount() * SlicesPerThread));
+    const size_t slice_rows = (shape.height + slices_count - 1) / slices_count;
+
+    Image image(shape.height, shape.width, shape.channels);
+    try {
+        GetThreadPool().ParallelFor(slices_count, [&](const size_t slice) {
+            const size_t begin = slice * slice_rows;
+            const size_t end = std::min(shape.height, begin + slice_rows);
+            if (begin >= end) {
+                return;
+            }
+            std::vector<uint8_t> data((end - begin) * row_size);
+            std::vector<uint8_t> indexes;
+            ReadAt(fd, data.data(), data.size(), static_cast<off_t>(header.pixels_offset + begin * row_size));
+            for (size_t i = begin; i < end; ++i) {
+                DecodeRow(header, data.data() + (i - begin) * row_size,
+                          image.GetMutableRow(header.height >= 0 ? shape.height - i - 1 : i), shape.channels, indexes);
+            }
+        });
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return image;
 }
 
-void WriteImage(const Image& image, const std::string& filename) {
-    BinaryWriter writer;
+Image ReadImage(const std::string& filename) {
+    if (filename == STDIO_PATH) {
+        return ReadImage(std::cin);
+    }
+    std::ifstream in;
     try {
-        writer = BinaryWriter(filename);
+        in.open(filename, std::ios::binary);
     } catch (const std::exception& exc) {
-        throw WriteException(exc.what());
+        throw ReadException(exc.what());
+    }
+    if (!in.is_open()) {
+        throw ReadException("could not open " + filename);
+    }
+    if (in.peek() != 'B') {
+        return ReadImage(in);
+    }
+    BinaryReader reader(in);
+    const BmpHeader header = ReadBmpHeader(reader);
+    if (!IsRle(header)) {
+        if (std::optional<Image> image = ReadBmpPixelsInParallel(filename, header)) {
+            return std::move(*image);
+        }
     }
+    Image image = ReadBmpPixels(header, reader);
+    CheckEndOfFile(reader);
+    return image;
+}
 
-    constexpr size_t DwordSize = 4;
+Image ReadImage(std::istream& in) {
+    BinaryReader reader(in);
+    if (in.peek() == 'P') {
+        const PnmHeader header = ReadPnmHeader(reader);
+        Image image(header.shape.height, header.shape.width, header.shape.channels);
+        ReadSamples(reader, image, header.max_value);
+        CheckEndOfFile(reader);
+        return image;
+    }
+    Image image = ReadBmpPixels(ReadBmpHeader(reader), reader);
+    CheckEndOfFile(reader);
+    return image;
+}
+
+Image ReadRawImage(const std::string& filename, const ImageShape& shape) {
+    if (filename == STDIO_PATH) {
+        return ReadRawImage(std::cin, shape);
+    }
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        throw ReadException("could not open " + filename);
+    }
+    return ReadRawImage(in, shape);
+}
+
+Image ReadRawImage(std::istream& in, const ImageShape& shape) {
+    if (shape.channels != GRAYSCALE_CHANNELS && shape.channels != RGB_CHANNELS) {
+        throw UsageException("raw images must have 1 or 3 channels");
+    }
+    BinaryReader reader(in);
+    Image image(shape.height, shape.width, shape.channels);
+    ReadSamples(reader, image, COLOR_MAX_VALUE);
+    CheckEndOfFile(reader);
+    return image;
+}
+
+ImageShape ReadImageShape(const std::string& filename) {
+    if (filename == STDIO_PATH) {
+        throw UsageException("the shape of an image from stdin is not known before decoding it");
+    }
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        throw ReadException("could not open " + filename);
+    }
+    return ReadImageShape(in);
+}
+
+ImageShape ReadImageShape(std::istream& in) {
+    BinaryReader reader(in);
+    if (in.peek() == 'P') {
+        return ReadPnmHeader(reader).shape;
+    }
+    return GetImageShape(ReadBmpHeader(reader));
+}
+
+// Bytes left in the stream. Files are measured by seeking to their end, other streams are read through.
+uint64_t GetRemainingSize(std::istream& in) {
+    const std::streampos position = in.tellg();
+    if (position != std::streampos(-1) && in.seekg(0, std::ios::end)) {
+        const std::streampos end = in.tellg();
+        in.seekg(position);
+        return static_cast<uint64_t>(end - position);
+    }
+    in.clear();
+    in.ignore(std::numeric_limits<std::streamsize>::max());
+    return static_cast<uint64_t>(in.gcount());
+}
+
+ImageHeader ReadImageHeader(const std::string& filename) {
+    if (filename == STDIO_PATH) {
+        return ReadImageHeader(std::cin);
+    }
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        throw ReadException("could not open " + filename);
+    }
+    return ReadImageHeader(in);
+}
+
+ImageHeader ReadImageHeader(std::istream& in) {
+    BinaryReader reader(in);
+    ImageHeader result;
+    uint64_t pixels_size = 0;
+    if (in.peek() == 'P') {
+        const PnmHeader header = ReadPnmHeader(reader);
+        const size_t sample_size = header.max_value > COLOR_MAX_VALUE ? 2 : 1;
+        constexpr uint16_t ByteSize = 8;
+        result.format = header.shape.channels == GRAYSCALE_CHANNELS ? ImageFormat::Pgm : ImageFormat::Ppm;
+        result.shape = header.shape;
+        result.bit_count = static_cast<uint16_t>(header.shape.channels * sample_size * ByteSize);
+        pixels_size = header.shape.height * header.shape.width * header.shape.channels * sample_size;
+    } else {
+        // The declared size of the file is already checked against the headers.
+        const BmpHeader header = ReadBmpHeader(reader);
+        result.shape = GetImageShape(header);
+        result.bit_count = header.bit_count;
+        result.rle = IsRle(header);
+        pixels_size = header.file_size - header.pixels_offset;
+    }
+    const uint64_t remaining_size = GetRemainingSize(in);
+    if (remaining_size < pixels_size) {
+        throw ReadException("reached end of file");
+    }
+    if (remaining_size > pixels_size) {
+        throw CorruptedFileException("file has extra bytes in the end");
+    }
+    return result;
+}
+
+// Palette indexes of the row of a grayscale image or a mask, masks use the palette of black and white.
+void GetPaletteIndexes(const Image& image, const size_t i, uint8_t* dst) {
+    const size_t width = image.GetWidth();
+    if (image.IsMask()) {
+        for (size_t j = 0; j < width; ++j) {
+            dst[j] = image.GetMaskBit(i, j) ? 1 : 0;
+        }
+        return;
+    }
+    const double* row = image.GetRow(i);
+    for (size_t j = 0; j < width; ++j) {
+        dst[j] = static_cast<uint8_t>(row[j] * COLOR_MAX_VALUE);
+    }
+}
+
+// Channel values of the row of the image as bytes of the file.
+void EncodeRow(const Image& image, const size_t i, const uint16_t bit_count, uint8_t* dst) {
+    constexpr size_t ByteSize = 8;
+    const size_t width = image.GetWidth();
+    const size_t pixel_size = bit_count / ByteSize;
+    if (bit_count == PALETTE8_BITS) {
+        GetPaletteIndexes(image, i, dst);
+        return;
+    }
+    if (image.IsMask()) {
+        for (size_t j = 0; j < width; ++j) {
+            const uint8_t value = image.GetMaskBit(i, j) ? COLOR_MAX_VALUE : 0;
+            std::fill(dst + j * pixel_size, dst + j * pixel_size + RGB_CHANNELS, value);
+            if (pixel_size > RGB_CHANNELS) {
+                dst[j * pixel_size + RGB_CHANNELS] = COLOR_MAX_VALUE;
+            }
+        }
+        return;
+    }
+    const double* row = image.GetRow(i);
+    const size_t channels = image.GetChannels();
+    // The red channel of a grayscale image is its only channel.
+    const size_t green = channels == GRAYSCALE_CHANNELS ? 0 : 1;
+    const size_t blue = channels == GRAYSCALE_CHANNELS ? 0 : 2;
+    for (size_t j = 0; j < width; ++j) {
+        const double* pixel = row + j * channels;
+        uint8_t* out = dst + j * pixel_size;
+        out[0] = static_cast<uint8_t>(pixel[blue] * COLOR_MAX_VALUE);
+        out[1] = static_cast<uint8_t>(pixel[green] * COLOR_MAX_VALUE);
+        out[2] = static_cast<uint8_t>(pixel[0] * COLOR_MAX_VALUE);
+        if (pixel_size > RGB_CHANNELS) {
+            out[RGB_CHANNELS] = COLOR_MAX_VALUE;
+        }
+    }
+}
+
+size_t GetRunLength(const uint8_t* data, const size_t size) {
+    // Eight bytes are compared at once with the first byte repeated over a word, the first different byte is the
+    // lowest non-zero byte of their XOR.
+    constexpr uint64_t RepeatedByte = 0x0101010101010101;
+    constexpr size_t ByteSize = 8;
+    const uint64_t pattern = data[0] * RepeatedByte;
+    size_t length = 0;
+    for (; length + sizeof(uint64_t) <= size; length += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + length, sizeof(word));
+        if (const uint64_t difference = word ^ pattern; difference != 0) {
+            const int zero_bits = std::endian::native == std::endian::little ? std::countr_zero(difference)
+                                                                              : std::countl_zero(difference);
+            return length + zero_bits / ByteSize;
+        }
+    }
+    while (length < size && data[length] == data[0]) {
+        ++length;
+    }
+    return length;
+}
+
+// Appends RLE8 or RLE4 commands for a row of palette indexes: runs of at least 3 equal pixels are encoded, stretches
+// of other pixels are written in absolute mode.
+void EncodeRleRow(const uint8_t* indexes, const size_t width, const bool rle4, std::vector<uint8_t>& data) {
+    constexpr size_t MaxRun = 255;
+    constexpr size_t MinRun = 3;
+    constexpr uint8_t NibbleSize = 4;
+    const auto append_run = [&](const size_t count, const uint8_t index) {
+        data.push_back(static_cast<uint8_t>(count));
+        data.push_back(rle4 ? static_cast<uint8_t>(index << NibbleSize | index) : index);
+    };
+    size_t j = 0;
+    while (j < width) {
+        const size_t run = GetRunLength(indexes + j, std::min(width - j, MaxRun));
+        if (run >= MinRun) {
+            append_run(run, indexes[j]);
+            j += run;
+            continue;
+        }
+        size_t end = j + run;
+        while (end < width && end - j < MaxRun) {
+            const size_t next_run = GetRunLength(indexes + end, std::min(width - end, MaxRun - (end - j)));
+            if (next_run >= MinRun) {
+                break;
+            }
+            end += next_run;
+        }
+        const size_t count = end - j;
+        if (count < MinRun) {
+            // Absolute mode can not hold fewer than 3 pixels, the counts 1 and 2 mean the end of the bitmap and delta.
+            while (j < end) {
+                const size_t part = GetRunLength(indexes + j, end - j);
+                append_run(part, indexes[j]);
+                j += part;
+            }
+            continue;
+        }
+        data.push_back(0);
+        data.push_back(static_cast<uint8_t>(count));
+        if (rle4) {
+            for (size_t k = 0; k < count; k += 2) {
+                const uint8_t low = k + 1 < count ? indexes[j + k + 1] : 0;
+                data.push_back(static_cast<uint8_t>(indexes[j + k] << NibbleSize | low));
+            }
+        } else {
+            data.insert(data.end(), indexes + j, indexes + end);
+        }
+        if ((rle4 ? (count + 1) / 2 : count) % 2 != 0) {
+            data.push_back(0);
+        }
+        j = end;
+    }
+}
+
+// RLE data of the whole image, rows from bottom to top. Every row ends with the end of line, the last one with the end
+// of the bitmap.
+std::vector<uint8_t> EncodeRle(const Image& image, const bool rle4) {
+    constexpr uint8_t EndOfLine = 0;
+    constexpr uint8_t EndOfBitmap = 1;
+    const size_t height = image.GetHeight();
+    const size_t width = image.GetWidth();
+    std::vector<uint8_t> indexes(width);
+    std::vector<uint8_t> data;
+    for (size_t i = height; i-- > 0;) {
+        GetPaletteIndexes(image, i, indexes.data());
+        EncodeRleRow(indexes.data(), width, rle4, data);
+        data.push_back(0);
+        data.push_back(i == 0 ? EndOfBitmap : EndOfLine);
+    }
+    if (height == 0) {
+        data.push_back(0);
+        data.push_back(EndOfBitmap);
+    }
+    return data;
+}
+
+// Throws before anything is written if the image can not be written with these options.
+void CheckWriteOptions(const Image& image, const ImageFormat format, const std::optional<uint16_t> bit_count,
+                       const bool rle) {
+    const bool grayscale = image.GetChannels() == GRAYSCALE_CHANNELS;
+    if (format != ImageFormat::Bmp) {
+        if (bit_count.has_value() || rle) {
+            throw UsageException("bits per pixel and RLE can be chosen only for BMP files");
+        }
+        if (format == ImageFormat::Pgm && !grayscale) {
+            throw UsageException("only grayscale images can be written as PGM files");
+        }
+        return;
+    }
+    const uint16_t bits = bit_count.value_or(grayscale ? PALETTE8_BITS : RGB_BITS);
+    if (bits != PALETTE4_BITS && bits != PALETTE8_BITS && bits != RGB_BITS && bits != RGBX_BITS) {
+        throw UsageException("files can be written with 4, 8, 24 or 32 bits per pixel");
+    }
+    if (bits == PALETTE4_BITS && !image.IsMask()) {
+        throw UsageException("only masks can be written with 4 bits per pixel");
+    }
+    if (bits == PALETTE8_BITS && !grayscale) {
+        throw UsageException("only grayscale images can be written with 8 bits per pixel");
+    }
+    if (rle && bits > PALETTE8_BITS) {
+        throw UsageException("only files with 4 or 8 bits per pixel can be compressed");
+    }
+}
+
+// Rows of channel values from top to bottom, one byte each. Grayscale images get equal channels if channels is 3.
+void WriteSamples(const Image& image, const size_t channels, BinaryWriter& writer) {
+    const size_t width = image.GetWidth();
+    const size_t image_channels = image.GetChannels();
+    std::vector<uint8_t> row(width * channels);
+    for (size_t i = 0; i < image.GetHeight(); ++i) {
+        if (image.IsMask()) {
+            for (size_t j = 0; j < width; ++j) {
+                std::fill_n(row.data() + j * channels, channels, image.GetMaskBit(i, j) ? COLOR_MAX_VALUE : 0);
+            }
+        } else {
+            const double* src = image.GetRow(i);
+            for (size_t j = 0; j < width; ++j) {
+                for (size_t k = 0; k < channels; ++k) {
+                    const double value = src[j * image_channels + (image_channels == GRAYSCALE_CHANNELS ? 0 : k)];
+                    row[j * channels + k] = static_cast<uint8_t>(value * COLOR_MAX_VALUE);
+                }
+            }
+        }
+        writer.WriteBytes(row.data(), row.size());
+    }
+}
+
+void WritePnm(const Image& image, const ImageFormat format, BinaryWriter& writer) {
+    const size_t channels = format == ImageFormat::Pgm ? GRAYSCALE_CHANNELS : RGB_CHANNELS;
+    const std::string header = (format == ImageFormat::Pgm ? "P5\n" : "P6\n") + std::to_string(image.GetWidth()) +
+                               " " + std::to_string(image.GetHeight()) + "\n" +
+                               std::to_string(COLOR_MAX_VALUE) + "\n";
+    writer.WriteBytes(reinterpret_cast<const uint8_t*>(header.data()), header.size());
+    WriteSamples(image, channels, writer);
+}
+
+// Headers and palette of a written BMP file: grayscale images get the palette of grays and masks the palette of black
+// and white. Pixels follow them, uncompressed ones from top to bottom.
+void WriteBmpHeaders(const size_t height, const size_t width, const uint16_t bits, const bool is_mask,
+                     const std::optional<size_t> rle_size, BinaryWriter& writer) {
     constexpr size_t FileHeaderSize = 54;
     constexpr size_t ImageHeaderSize = 40;
-    constexpr size_t BitsPerPixel = 24;
-    const size_t padding = ((image.GetWidth() * 3 + DwordSize - 1) / DwordSize) * DwordSize - image.GetWidth() * 3;
-
-    writer.Write('B');  // bfType
-    writer.Write('M');  // bfType
-    writer.Write(
-        static_cast<uint32_t>(FileHeaderSize + image.GetHeight() * (image.GetWidth() * 3 + padding)));  // bfSize
-    writer.Write(static_cast<uint16_t>(0));                                                             // bfReserved1
-    writer.Write(static_cast<uint16_t>(0));                                                             // bfReserved2
-    writer.Write(static_cast<uint32_t>(FileHeaderSize));                                                // bfOffBits
-
-    writer.Write(static_cast<uint32_t>(ImageHeaderSize));                           // biSize
-    writer.Write(static_cast<uint32_t>(image.GetWidth()));                          // biWidth
-    writer.Write(static_cast<int32_t>(-image.GetHeight()));                         // biHeight
-    writer.Write(static_cast<uint16_t>(1));                                         // biPlanes
-    writer.Write(static_cast<uint16_t>(BitsPerPixel));                              // biBitCount
-    writer.Write(static_cast<uint32_t>(0));                                         // biCompression
-    writer.Write(static_cast<uint32_t>(3 * image.GetHeight() * image.GetWidth()));  // biSizeImage
-    writer.Write(static_cast<uint32_t>(0));                                         // biXPelsPerMeter
-    writer.Write(static_cast<uint32_t>(0));                                         // biYPelsPerMeter
-    writer.Write(static_cast<uint32_t>(0));                                         // biClrUsed
-    writer.Write(static_cast<uint32_t>(0));                                         // biClrImportant
+    constexpr size_t GrayPaletteSize = 256;
+    constexpr size_t MaskPaletteSize = 2;
+    constexpr size_t PaletteEntrySize = 4;
+    const size_t row_size = GetBmpRowSize(width, bits);
+    const bool palettized = bits <= PALETTE8_BITS;
+    const bool compressed = rle_size.has_value();
+    const size_t palette_size = !palettized ? 0 : is_mask ? MaskPaletteSize : GrayPaletteSize;
+    const size_t pixels_offset = FileHeaderSize + palette_size * PaletteEntrySize;
+    const uint32_t compression =
+        !compressed ? NoCompression : bits == PALETTE4_BITS ? Rle4Compression : Rle8Compression;
+    // 24-bit files keep the size of the image without the padding of rows, as they always had.
+    const size_t image_size = compressed        ? *rle_size
+                              : bits == RGB_BITS ? 3 * height * width
+                                                 : row_size * height;
+    const size_t file_size = pixels_offset + (compressed ? *rle_size : height * row_size);
+    // RLE files can only be stored from bottom to top.
+    const int32_t signed_height = compressed ? static_cast<int32_t>(height) : -static_cast<int32_t>(height);
 
-    for (size_t i = 0; i < image.GetHeight(); ++i) {
-        for (size_t j = 0; j < image.GetWidth(); ++j) {
-            const Color color = image.GetPixel(i, j);
-            constexpr uint8_t ColorMaxValue = 255;
-            writer.Write(static_cast<uint8_t>(color.b * ColorMaxValue));
-            writer.Write(static_cast<uint8_t>(color.g * ColorMaxValue));
-            writer.Write(static_cast<uint8_t>(color.r * ColorMaxValue));
+    writer.Write('B');                                   // bfType
+    writer.Write('M');                                   // bfType
+    writer.Write(static_cast<uint32_t>(file_size));      // bfSize
+    writer.Write(static_cast<uint16_t>(0));              // bfReserved1
+    writer.Write(static_cast<uint16_t>(0));              // bfReserved2
+    writer.Write(static_cast<uint32_t>(pixels_offset));  // bfOffBits
+
+    writer.Write(static_cast<uint32_t>(ImageHeaderSize));  // biSize
+    writer.Write(static_cast<uint32_t>(width));            // biWidth
+    writer.Write(signed_height);                           // biHeight
+    writer.Write(static_cast<uint16_t>(1));                // biPlanes
+    writer.Write(bits);                                    // biBitCount
+    writer.Write(compression);                             // biCompression
+    writer.Write(static_cast<uint32_t>(image_size));       // biSizeImage
+    writer.Write(static_cast<uint32_t>(0));                // biXPelsPerMeter
+    writer.Write(static_cast<uint32_t>(0));                // biYPelsPerMeter
+    writer.Write(static_cast<uint32_t>(palette_size));     // biClrUsed
+    writer.Write(static_cast<uint32_t>(0));                // biClrImportant
+
+    for (size_t k = 0; k < palette_size; ++k) {
+        const uint8_t value = is_mask ? static_cast<uint8_t>(k * COLOR_MAX_VALUE) : static_cast<uint8_t>(k);
+        const std::array<uint8_t, PaletteEntrySize> entry = {value, value, value, 0};
+        writer.WriteBytes(entry.data(), entry.size());
+    }
+}
+
+void WriteBmp(const Image& image, const std::optional<uint16_t> bit_count, const bool rle, BinaryWriter& writer) {
+    const uint16_t bits = bit_count.value_or(image.GetChannels() == GRAYSCALE_CHANNELS ? PALETTE8_BITS : RGB_BITS);
+    const size_t height = image.GetHeight();
+    const size_t width = image.GetWidth();
+    if (bits <= PALETTE8_BITS && (rle || image.IsMask())) {
+        const std::vector<uint8_t> rle_data = EncodeRle(image, bits == PALETTE4_BITS);
+        WriteBmpHeaders(height, width, bits, image.IsMask(), rle_data.size(), writer);
+        writer.WriteBytes(rle_data.data(), rle_data.size());
+        return;
+    }
+    WriteBmpHeaders(height, width, bits, image.IsMask(), std::nullopt, writer);
+    std::vector<uint8_t> row(GetBmpRowSize(width, bits));
+    for (size_t i = 0; i < height; ++i) {
+        EncodeRow(image, i, bits, row.data());
+        writer.WriteBytes(row.data(), row.size());
+    }
+}
+
+bool ApplyLutsToBmp(const std::string& input_path, const std::string& output_path,
+                    const std::vector<ChannelLut>& luts) {
+    if (luts.size() != RGB_CHANNELS) {
+        throw InternalException("lookup tables must be given for the red, green and blue channels");
+    }
+    std::ifstream in(input_path, std::ios::binary);
+    if (!in.is_open()) {
+        throw ReadException("could not open " + input_path);
+    }
+    if (in.peek() != 'B') {
+        return false;
+    }
+    BinaryReader reader(in);
+    const BmpHeader header = ReadBmpHeader(reader);
+    if (IsRle(header)) {
+        return false;
+    }
+    const ImageShape shape = GetImageShape(header);
+    const size_t src_row_size = GetBmpRowSize(header.width, header.bit_count);
+    std::vector<uint8_t> src(shape.height * src_row_size);
+    reader.ReadBytes(src.data(), src.size());
+    CheckEndOfFile(reader);
+
+    // Grayscale images are written with the palette of grays, so their bytes are the values themselves.
+    constexpr size_t ByteSize = 8;
+    const uint16_t bits = shape.channels == GRAYSCALE_CHANNELS ? PALETTE8_BITS : RGB_BITS;
+    const size_t pixel_size = bits / ByteSize;
+    const size_t dst_row_size = GetBmpRowSize(shape.width, bits);
+    // Written bytes of every palette index, BGR or the gray value.
+    const auto to_byte = [](const double value) { return static_cast<uint8_t>(std::lround(value * COLOR_MAX_VALUE)); };
+    std::vector<std::array<uint8_t, RGB_CHANNELS>> palette(header.palette.size());
+    for (size_t k = 0; k < palette.size(); ++k) {
+        const Color& color = header.palette[k];
+        const uint8_t red = luts[0][to_byte(color.r)];
+        palette[k] = shape.channels == GRAYSCALE_CHANNELS
+                         ? std::array<uint8_t, RGB_CHANNELS>{red, red, red}
+                         : std::array<uint8_t, RGB_CHANNELS>{luts[2][to_byte(color.b)], luts[1][to_byte(color.g)], red};
+    }
+
+    std::vector<uint8_t> dst(shape.height * dst_row_size, 0);
+    constexpr size_t MinSliceBytes = 1 << 18;
+    const size_t slices_count = std::clamp<size_t>(src.size() / MinSliceBytes, 1, std::max<size_t>(shape.height, 1));
+    const size_t slice_rows = (shape.height + slices_count - 1) / slices_count;
+    GetThreadPool().ParallelFor(slices_count, [&](const size_t slice) {
+        const size_t end = std::min(shape.height, (slice + 1) * slice_rows);
+        for (size_t i = slice * slice_rows; i < end; ++i) {
+            const uint8_t* src_row = src.data() + (header.height >= 0 ? shape.height - i - 1 : i) * src_row_size;
+            uint8_t* dst_row = dst.data() + i * dst_row_size;
+            if (header.bit_count <= PALETTE8_BITS) {
+                constexpr uint8_t NibbleSize = 4;
+                constexpr uint8_t NibbleMask = 0x0F;
+                for (size_t j = 0; j < shape.width; ++j) {
+                    const uint8_t index = header.bit_count == PALETTE8_BITS ? src_row[j]
+                                          : j % 2 == 0                     ? src_row[j / 2] >> NibbleSize
+                                                                           : src_row[j / 2] & NibbleMask;
+                    if (index >= palette.size()) {
+                        throw CorruptedFileException("pixel refers to a color outside of the palette");
+                    }
+                    std::copy(palette[index].begin(), palette[index].begin() + pixel_size, dst_row + j * pixel_size);
+                }
+                continue;
+            }
+            const size_t src_pixel_size = header.bit_count / ByteSize;
+            for (size_t j = 0; j < shape.width; ++j) {
+                const uint8_t* pixel = src_row + j * src_pixel_size;
+                dst_row[j * RGB_CHANNELS] = luts[2][pixel[0]];
+                dst_row[j * RGB_CHANNELS + 1] = luts[1][pixel[1]];
+                dst_row[j * RGB_CHANNELS + 2] = luts[0][pixel[2]];
+            }
+        }
+    });
+
+    const auto write = [&](BinaryWriter& writer) {
+        WriteBmpHeaders(shape.height, shape.width, bits, false, std::nullopt, writer);
+        writer.WriteBytes(dst.data(), dst.size());
+    };
+    if (output_path == STDIO_PATH) {
+        BinaryWriter writer(std::cout);
+        write(writer);
+        try {
+            std::cout.flush();
+        } catch (const std::exception& exc) {
+            throw WriteException(exc.what());
         }
-        writer.WriteZero(padding);
+    } else {
+        BinaryWriter writer(output_path);
+        write(writer);
+    }
+    return true;
+}
+
+void WriteImage(const Image& image, std::ostream& out, const ImageFormat format,
+                const std::optional<uint16_t> bit_count, const bool rle) {
+    CheckWriteOptions(image, format, bit_count, rle);
+    BinaryWriter writer(out);
+    switch (format) {
+        case ImageFormat::Bmp:
+            WriteBmp(image, bit_count, rle, writer);
+            break;
+        case ImageFormat::Ppm:
+        case ImageFormat::Pgm:
+            WritePnm(image, format, writer);
+            break;
+        case ImageFormat::Raw:
+            WriteSamples(image, image.GetChannels(), writer);
+            break;
+    }
+}
+
+void WriteImage(const Image& image, const std::string& filename, const std::optional<uint16_t> bit_count,
+                const bool rle, const std::optional<ImageFormat> format) {
+    const ImageFormat file_format = format.value_or(GetFileFormat(filename));
+    CheckWriteOptions(image, file_format, bit_count, rle);
+    if (filename == STDIO_PATH) {
+        WriteImage(image, std::cout, file_format, bit_count, rle);
+        try {
+            std::cout.flush();
+        } catch (const std::exception& exc) {
+            throw WriteException(exc.what());
+        }
+        return;
+    }
+    std::ofstream out;
+    try {
+        out.open(filename, std::ios::binary);
+    } catch (const std::exception& exc) {
+        throw WriteException(exc.what());
     }
+    WriteImage(image, out, file_format, bit_count, rle);
 }
\ No newline at end of file
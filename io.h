@@ -2,37 +2,147 @@
 
 #include "image.h"
 
+#include <array>
+#include <cstdint>
 #include <fstream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <vector>
+
+// Supported encodings: 4-bit and 8-bit palettized, uncompressed or RLE, 24-bit BGR and 32-bit BGRX.
+constexpr uint16_t PALETTE4_BITS = 4;
+constexpr uint16_t PALETTE8_BITS = 8;
+constexpr uint16_t RGB_BITS = 24;
+constexpr uint16_t RGBX_BITS = 32;
+
+constexpr uint8_t COLOR_MAX_VALUE = 255;
+
+// Path meaning stdin when reading and stdout when writing.
+const std::string STDIO_PATH = "-";
+
+// Raw images are channel values of rows from top to bottom, one byte each, without a header.
+enum class ImageFormat { Bmp, Ppm, Pgm, Raw };
+
+// Name of the format as in --format: bmp, ppm, pgm or raw.
+ImageFormat ParseImageFormat(const std::string& name);
+
+// Format of a written file by its extension, BMP for stdout and unknown extensions.
+ImageFormat GetFileFormat(const std::string& filename);
 
 class BinaryReader {
 public:
     BinaryReader();
     explicit BinaryReader(const std::string& filename);
+    // Reads from the stream owned by the caller.
+    explicit BinaryReader(std::istream& in);
 
     template <std::integral T>
     void Read(T& value);
 
+    // Reads the bytes with a single call, used for whole rows of pixels.
+    void ReadBytes(uint8_t* data, size_t count);
+
     void Skip(size_t bytes_count);
 
 private:
-    std::ifstream in_;
+    std::unique_ptr<std::ifstream> file_;
+    std::istream* in_ = nullptr;
 };
 
 class BinaryWriter {
 public:
     BinaryWriter();
     explicit BinaryWriter(const std::string& filename);
+    // Writes to the stream owned by the caller.
+    explicit BinaryWriter(std::ostream& out);
 
     template <std::integral T>
     void Write(const T& value);
 
+    void WriteBytes(const uint8_t* data, size_t count);
+
     void WriteZero(size_t bytes_count);
 
 private:
-    std::ofstream out_;
+    std::unique_ptr<std::ofstream> file_;
+    std::ostream* out_ = nullptr;
+};
+
+// Fields of the BMP headers needed to decode the pixels.
+struct BmpHeader {
+    uint32_t file_size = 0;
+    uint32_t pixels_offset = 0;
+    uint32_t width = 0;
+    // Negative if rows are stored from top to bottom.
+    int32_t height = 0;
+    uint16_t bit_count = RGB_BITS;
+    // 0 for uncompressed pixels, 1 for RLE8, 2 for RLE4, 3 for bit fields.
+    uint32_t compression = 0;
+    // Size of the pixel data, known for every RLE file.
+    uint32_t image_size = 0;
+    // Colors of palettized files.
+    std::vector<Color> palette;
 };
 
+// Reads and validates the headers, leaving the reader at the first row of pixels.
+BmpHeader ReadBmpHeader(BinaryReader& reader);
+
+// Size of a row of pixels in the file, rows are padded to 4 bytes.
+size_t GetBmpRowSize(size_t width, uint16_t bit_count);
+
+// Palettized files whose colors are all gray are decoded as grayscale images, other files as RGB images.
+ImageShape GetImageShape(const BmpHeader& header);
+
+// BMP and binary PGM/PPM (P5/P6) files are told apart by their first byte.
 Image ReadImage(const std::string& filename);
 
-void WriteImage(const Image& image, const std::string& filename);
\ No newline at end of file
+Image ReadImage(std::istream& in);
+
+// Raw images have no header, so their shape is given by the caller. Grayscale images have 1 channel, others 3.
+Image ReadRawImage(const std::string& filename, const ImageShape& shape);
+
+Image ReadRawImage(std::istream& in, const ImageShape& shape);
+
+// Reads only the headers, so the memory needed for the image can be planned before decoding it. Headers of stdin can
+// not be read twice, so the shape of such images is not known in advance.
+ImageShape ReadImageShape(const std::string& filename);
+
+ImageShape ReadImageShape(std::istream& in);
+
+// What the headers of a file tell about the image.
+struct ImageHeader {
+    ImageFormat format = ImageFormat::Bmp;
+    ImageShape shape;
+    // Bits per pixel in the file, samples of PGM/PPM files with values above 255 take 16 bits.
+    uint16_t bit_count = RGB_BITS;
+    bool rle = false;
+};
+
+// Reads and validates the headers and checks that the size of the file matches them without reading the pixels, so
+// truncated files and extra bytes in the end are found before decoding. Regular files are not read past the headers.
+ImageHeader ReadImageHeader(const std::string& filename);
+
+ImageHeader ReadImageHeader(std::istream& in);
+
+// Value written to the file for every 8-bit value of a channel read from it.
+using ChannelLut = std::array<uint8_t, COLOR_MAX_VALUE + 1>;
+
+// Applies the tables of the red, green and blue channels to an uncompressed BMP file without decoding it into an
+// Image, grayscale images use the table of the red channel. The file is written as WriteImage with the default options
+// would write the image decoded by ReadImage with the tables applied. Returns false without writing anything if the
+// input is not an uncompressed BMP file, such files are decoded as usual.
+bool ApplyLutsToBmp(const std::string& input_path, const std::string& output_path, const std::vector<ChannelLut>& luts);
+
+// Grayscale images are written as 8-bit files with the palette of grays and other images as 24-bit files, unless
+// bit_count is given. The fourth byte of 32-bit pixels is 255. Masks get the palette of black and white and, with 4 or
+// 8 bits, are always compressed with RLE, grayscale images are compressed with RLE8 if rle is set.
+// Bits per pixel and RLE can be chosen only for BMP files. PGM files hold grayscale images and masks only, PPM files
+// hold any image.
+void WriteImage(const Image& image, const std::string& filename, std::optional<uint16_t> bit_count = std::nullopt,
+                bool rle = false, std::optional<ImageFormat> format = std::nullopt);
+
+void WriteImage(const Image& image, std::ostream& out, ImageFormat format = ImageFormat::Bmp,
+                std::optional<uint16_t> bit_count = std::nullopt, bool rle = false);
\ No newline at end of file
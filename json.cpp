@@ -0,0 +1,390 @@
+#include "json.h"
+
+#include "exceptions.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+
+JsonValue::JsonValue() {
+}
+
+JsonValue::JsonValue(const bool value) : value_(value) {
+}
+
+JsonValue::JsonValue(const double value) : value_(value) {
+}
+
+JsonValue::JsonValue(const char* value) : value_(std::string(value)) {
+}
+
+JsonValue::JsonValue(std::string value) : value_(std::move(value)) {
+}
+
+JsonValue::JsonValue(Array value) : value_(std::move(value)) {
+}
+
+JsonValue::JsonValue(Object value) : value_(std::move(value)) {
+}
+
+bool JsonValue::IsNull() const {
+    return std::holds_alternative<std::monostate>(value_);
+}
+
+bool JsonValue::IsBool() const {
+    return std::holds_alternative<bool>(value_);
+}
+
+bool JsonValue::IsNumber() const {
+    return std::holds_alternative<double>(value_);
+}
+
+bool JsonValue::IsString() const {
+    return std::holds_alternative<std::string>(value_);
+}
+
+bool JsonValue::IsArray() const {
+    return std::holds_alternative<Array>(value_);
+}
+
+bool JsonValue::IsObject() const {
+    return std::holds_alternative<Object>(value_);
+}
+
+bool JsonValue::GetBool() const {
+    if (!IsBool()) {
+        throw JsonException("expected boolean");
+    }
+    return std::get<bool>(value_);
+}
+
+double JsonValue::GetNumber() const {
+    if (!IsNumber()) {
+        throw JsonException("expected number");
+    }
+    return std::get<double>(value_);
+}
+
+const std::string& JsonValue::GetString() const {
+    if (!IsString()) {
+        throw JsonException("expected string");
+    }
+    return std::get<std::string>(value_);
+}
+
+const JsonValue::Array& JsonValue::GetArray() const {
+    if (!IsArray()) {
+        throw JsonException("expected array");
+    }
+    return std::get<Array>(value_);
+}
+
+const JsonValue::Object& JsonValue::GetObject() const {
+    if (!IsObject()) {
+        throw JsonException("expected object");
+    }
+    return std::get<Object>(value_);
+}
+
+const JsonValue* JsonValue::Find(const std::string& key) const {
+    if (!IsObject()) {
+        return nullptr;
+    }
+    for (const auto& [name, value] : std::get<Object>(value_)) {
+        if (name == key) {
+            return &value;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text_(text) {
+    }
+
+    JsonValue ParseDocument() {
+        JsonValue value = ParseValue();
+        SkipSpaces();
+        if (pos_ != text_.size()) {
+            throw JsonException("unexpected characters after the value at position " + std::to_string(pos_));
+        }
+        return value;
+    }
+
+private:
+    void SkipSpaces() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    char Peek() {
+        SkipSpaces();
+        if (pos_ == text_.size()) {
+            throw JsonException("unexpected end of input");
+        }
+        return text_[pos_];
+    }
+
+    void Expect(const char c) {
+        if (Peek() != c) {
+            throw JsonException(std::string("expected '") + c + "' at position " + std::to_string(pos_));
+        }
+        ++pos_;
+    }
+
+    void ExpectWord(const std::string& word) {
+        if (text_.compare(pos_, word.size(), word) != 0) {
+            throw JsonException("unexpected token at position " + std::to_string(pos_));
+        }
+        pos_ += word.size();
+    }
+
+    JsonValue ParseValue() {
+        const char c = Peek();
+        if (c == '{') {
+            return ParseObject();
+        }
+        if (c == '[') {
+            return ParseArray();
+        }
+        if (c == '"') {
+            return ParseString();
+        }
+        if (c == 't') {
+            ExpectWord("true");
+            return JsonValue(true);
+        }
+        if (c == 'f') {
+            ExpectWord("false");
+            return JsonValue(false);
+        }
+        if (c == 'n') {
+            ExpectWord("null");
+            return JsonValue();
+        }
+        return ParseNumber();
+    }
+
+    JsonValue ParseObject() {
+        Expect('{');
+        JsonValue::Object object;
+        if (Peek() == '}') {
+            ++pos_;
+            return object;
+        }
+        while (true) {
+            if (Peek() != '"') {
+                throw JsonException("expected key at position " + std::to_string(pos_));
+            }
+            std::string key = ParseString();
+            Expect(':');
+            object.emplace_back(std::move(key), ParseValue());
+            if (Peek() == '}') {
+                ++pos_;
+                return object;
+            }
+            Expect(',');
+        }
+    }
+
+    JsonValue ParseArray() {
+        Expect('[');
+        JsonValue::Array array;
+        if (Peek() == ']') {
+            ++pos_;
+            return array;
+        }
+        while (true) {
+            array.push_back(ParseValue());
+            if (Peek() == ']') {
+                ++pos_;
+                return array;
+            }
+            Expect(',');
+        }
+    }
+
+    JsonValue ParseNumber() {
+        const char first = text_[pos_];
+        if (first != '-' && (first < '0' || first > '9')) {
+            throw JsonException("unexpected token at position " + std::to_string(pos_));
+        }
+        double value = 0;
+        const auto [end, error] = std::from_chars(text_.data() + pos_, text_.data() + text_.size(), value);
+        if (error != std::errc() || end == text_.data() + pos_) {
+            throw JsonException("unexpected token at position " + std::to_string(pos_));
+        }
+        pos_ = end - text_.data();
+        return value;
+    }
+
+    uint32_t ParseHex() {
+        constexpr size_t HexLength = 4;
+        if (pos_ + HexLength > text_.size()) {
+            throw JsonException("unexpected end of input");
+        }
+        uint32_t code = 0;
+        const auto [end, error] = std::from_chars(text_.data() + pos_, text_.data() + pos_ + HexLength, code, 16);
+        if (error != std::errc() || end != text_.data() + pos_ + HexLength) {
+            throw JsonException("incorrect escape sequence at position " + std::to_string(pos_));
+        }
+        pos_ += HexLength;
+        return code;
+    }
+
+    static void AppendUtf8(std::string& result, const uint32_t code) {
+        if (code < 0x80) {
+            result += static_cast<char>(code);
+        } else if (code < 0x800) {
+            result += static_cast<char>(0xC0 | (code >> 6));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            result += static_cast<char>(0xE0 | (code >> 12));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            result += static_cast<char>(0xF0 | (code >> 18));
+            result += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    std::string ParseString() {
+        Expect('"');
+        std::string result;
+        while (true) {
+            if (pos_ == text_.size()) {
+                throw JsonException("unterminated string");
+            }
+            const char c = text_[pos_++];
+            if (c == '"') {
+                return result;
+            }
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (pos_ == text_.size()) {
+                throw JsonException("unterminated string");
+            }
+            const char escaped = text_[pos_++];
+            switch (escaped) {
+                case '"':
+                case '\\':
+                case '/':
+                    result += escaped;
+                    break;
+                case 'b':
+                    result += '\b';
+                    break;
+                case 'f':
+                    result += '\f';
+                    break;
+                case 'n':
+                    result += '\n';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'u': {
+                    uint32_t code = ParseHex();
+                    // Characters outside of the basic plane are written as surrogate pairs.
+                    if (0xD800 <= code && code < 0xDC00 && text_.compare(pos_, 2, "\\u") == 0) {
+                        pos_ += 2;
+                        const uint32_t low = ParseHex();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    AppendUtf8(result, code);
+                    break;
+                }
+                default:
+                    throw JsonException("incorrect escape sequence at position " + std::to_string(pos_ - 1));
+            }
+        }
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+void WriteString(const std::string& s, std::string& out) {
+    out += '"';
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            constexpr char Hex[] = "0123456789abcdef";
+            out += "\\u00";
+            out += Hex[c >> 4];
+            out += Hex[c & 0xF];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void WriteValue(const JsonValue& value, std::string& out) {
+    if (value.IsNull()) {
+        out += "null";
+    } else if (value.IsBool()) {
+        out += value.GetBool() ? "true" : "false";
+    } else if (value.IsNumber()) {
+        const double number = value.GetNumber();
+        if (!std::isfinite(number)) {
+            out += "null";
+            return;
+        }
+        char buffer[32];
+        const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out.append(buffer, end);
+    } else if (value.IsString()) {
+        WriteString(value.GetString(), out);
+    } else if (value.IsArray()) {
+        out += '[';
+        for (size_t i = 0; i < value.GetArray().size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            WriteValue(value.GetArray()[i], out);
+        }
+        out += ']';
+    } else {
+        out += '{';
+        for (size_t i = 0; i < value.GetObject().size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            WriteString(value.GetObject()[i].first, out);
+            out += ':';
+            WriteValue(value.GetObject()[i].second, out);
+        }
+        out += '}';
+    }
+}
+}  // namespace
+
+JsonValue ParseJson(const std::string& text) {
+    return JsonParser(text).ParseDocument();
+}
+
+std::string WriteJson(const JsonValue& value) {
+    std::string result;
+    WriteValue(value, result);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Minimal JSON value used for manifests and machine-readable reports. Keys of objects keep their order.
+class JsonValue {
+public:
+    using Array = std::vector<JsonValue>;
+    using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+    JsonValue();
+    JsonValue(bool value);
+    JsonValue(double value);
+    JsonValue(const char* value);
+    JsonValue(std::string value);
+    JsonValue(Array value);
+    JsonValue(Object value);
+
+    bool IsNull() const;
+    bool IsBool() const;
+    bool IsNumber() const;
+    bool IsString() const;
+    bool IsArray() const;
+    bool IsObject() const;
+
+    bool GetBool() const;
+    double GetNumber() const;
+    const std::string& GetString() const;
+    const Array& GetArray() const;
+    const Object& GetObject() const;
+
+    // Returns nullptr if the value is not an object or does not have the key.
+    const JsonValue* Find(const std::string& key) const;
+
+private:
+    std::variant<std::monostate, bool, double, std::string, Array, Object> value_;
+};
+
+JsonValue ParseJson(const std::string& text);
+
+std::string WriteJson(const JsonValue& value);
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "memory_planner.h"
+
+#include "cancellation.h"
+#include "controller.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+std::string FormatMegabytes(const uint64_t bytes) {
+    constexpr double BytesInMegabyte = 1 << 20;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / BytesInMegabyte << " MB";
+    return out.str();
+}
+
+MemoryPlan EstimateMemory(const ImageShape& input, const std::vector<std::shared_ptr<BaseFilter>>& filters) {
+    MemoryPlan plan;
+    uint64_t buffer_bytes = GetImageBytes(input);
+    plan.decode_bytes = buffer_bytes;
+    plan.peak_bytes = plan.decode_bytes;
+
+    ImageShape shape = input;
+    for (const std::shared_ptr<BaseFilter>& filter : filters) {
+        const FilterMemory memory = filter->EstimateMemory(shape);
+        plan.filter_bytes.push_back(buffer_bytes + memory.peak_bytes);
+        plan.peak_bytes = std::max(plan.peak_bytes, plan.filter_bytes.back());
+        shape = memory.output;
+        buffer_bytes = memory.output_bytes.value_or(buffer_bytes);
+    }
+    return plan;
+}
+
+std::string ExplainMemory(const MemoryPlan& plan, const std::vector<FilterInput>& inputs) {
+    if (inputs.size() != plan.filter_bytes.size()) {
+        throw InternalException("every filter of the plan must have its input");
+    }
+    std::string result = "memory: decode " + FormatMegabytes(plan.decode_bytes);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        result += ", -" + inputs[i].name + " " + FormatMegabytes(plan.filter_bytes[i]);
+    }
+    return result + ", peak " + FormatMegabytes(plan.peak_bytes) + "\n";
+}
+
+void CheckMemoryLimit(const uint64_t bytes, const uint64_t limit_bytes) {
+    if (bytes > limit_bytes) {
+        throw MemoryLimitException("estimated peak " + FormatMegabytes(bytes) + " is above the limit of " +
+                                   FormatMegabytes(limit_bytes));
+    }
+}
+
+MemoryBudget::MemoryBudget(const uint64_t limit_bytes) : limit_bytes_(limit_bytes) {
+}
+
+void MemoryBudget::Acquire(const uint64_t bytes) {
+    CheckMemoryLimit(bytes, limit_bytes_);
+    std::unique_lock lock(mutex_);
+    constexpr std::chrono::milliseconds CancellationCheckInterval(10);
+    while (!released_.wait_for(lock, CancellationCheckInterval, [&] { return used_bytes_ + bytes <= limit_bytes_; })) {
+        CheckCancellation();
+    }
+    used_bytes_ += bytes;
+}
+
+void MemoryBudget::Release(const uint64_t bytes) {
+    {
+        std::lock_guard lock(mutex_);
+        used_bytes_ -= bytes;
+    }
+    released_.notify_all();
+}
+
+uint64_t MemoryBudget::GetLimit() const {
+    return limit_bytes_;
+}
+
+uint64_t MemoryBudget::GetUsed() const {
+    std::lock_guard lock(mutex_);
+    return used_bytes_;
+}
+
+MemoryReservation::MemoryReservation(MemoryBudget* budget, const uint64_t bytes) {
+    if (budget != nullptr) {
+        budget->Acquire(bytes);
+        budget_ = budget;
+        bytes_ = bytes;
+    }
+}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept
+    : budget_(std::exchange(other.budget_, nullptr)), bytes_(std::exchange(other.bytes_, 0)) {
+}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this != &other) {
+        if (budget_ != nullptr) {
+            budget_->Release(bytes_);
+        }
+        budget_ = std::exchange(other.budget_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+    }
+    return *this;
+}
+
+MemoryReservation::~MemoryReservation() {
+    if (budget_ != nullptr) {
+        budget_->Release(bytes_);
+    }
+}
+
+std::optional<uint64_t> GetMemoryLimit(const std::unordered_map<std::string, std::string>& options) {
+    constexpr uint64_t BytesInMegabyte = 1 << 20;
+    if (const std::optional<size_t> megabytes = GetPositiveOption(options, "memory-limit")) {
+        return *megabytes * BytesInMegabyte;
+    }
+    return std::nullopt;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "filters/base_filter.h"
+#include "parser.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Peak memory of decoding an image and applying a chain of filters to it.
+struct MemoryPlan {
+    // Rows are decoded straight into the buffer of the image.
+    uint64_t decode_bytes = 0;
+    // Peak of every filter, the buffer of its input included.
+    std::vector<uint64_t> filter_bytes;
+    uint64_t peak_bytes = 0;
+};
+
+// Memory taken by the images and spectra, computed from the shape of the input only. Allocator overhead and the memory
+// of the process itself are not counted.
+MemoryPlan EstimateMemory(const ImageShape& input, const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// Peak of every stage, filters are named by their inputs.
+std::string ExplainMemory(const MemoryPlan& plan, const std::vector<FilterInput>& inputs);
+
+// Throws MemoryLimitException if bytes exceed the limit.
+void CheckMemoryLimit(uint64_t bytes, uint64_t limit_bytes);
+
+// Memory shared by the jobs running at the same time. A job reserves its estimated peak before decoding and waits
+// while the budget is taken by other jobs, jobs which do not fit into the whole budget are refused.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit_bytes);
+
+    // Waits until the bytes are free, the wait stops with CancelledException if the current job is cancelled.
+    void Acquire(uint64_t bytes);
+    void Release(uint64_t bytes);
+
+    uint64_t GetLimit() const;
+    uint64_t GetUsed() const;
+
+private:
+    const uint64_t limit_bytes_;
+    uint64_t used_bytes_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+// Part of the budget held by a job, returned when the reservation is destroyed. Without a budget it does nothing.
+class MemoryReservation {
+public:
+    MemoryReservation() = default;
+    MemoryReservation(MemoryBudget* budget, uint64_t bytes);
+    MemoryReservation(MemoryReservation&& other) noexcept;
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+    ~MemoryReservation();
+
+private:
+    MemoryBudget* budget_ = nullptr;
+    uint64_t bytes_ = 0;
+};
+
+// Limit from the --memory-limit option in bytes, nullopt if the option is not given.
+std::optional<uint64_t> GetMemoryLimit(const std::unordered_map<std::string, std::string>& options);
\ No newline at end of file
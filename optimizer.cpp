@@ -0,0 +1,133 @@
+#include "optimizer.h"
+
+#include "exceptions.h"
+#include "factories/base_factory.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <optional>
+#include <sstream>
+#include <unordered_set>
+
+const std::unordered_set<std::string> POINTWISE_FILTERS = {"gs", "neg"};
+
+bool IsFilter(const FilterInput& filter, const std::string& name, const size_t params_count) {
+    return filter.name == name && filter.params.size() == params_count;
+}
+
+std::optional<double> GetBlurSigma(const FilterInput& filter) {
+    if (!IsFilter(filter, "blur", 1)) {
+        return std::nullopt;
+    }
+    try {
+        return std::abs(ConvertToDouble(filter.params[0]));
+    } catch (const InternalException&) {
+        return std::nullopt;
+    }
+}
+
+std::optional<std::pair<size_t, size_t>> GetCropSize(const FilterInput& filter) {
+    if (!IsFilter(filter, "crop", 2)) {
+        return std::nullopt;
+    }
+    try {
+        return std::make_pair(ConvertToSizeT(filter.params[0]), ConvertToSizeT(filter.params[1]));
+    } catch (const InternalException&) {
+        return std::nullopt;
+    }
+}
+
+std::string FormatDouble(const double value) {
+    char buffer[32];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, end);
+}
+
+// Tries to rewrite filters[i] and filters[i + 1], returns true if the chain was changed.
+bool RewritePair(std::vector<FilterInput>& filters, const size_t i, std::vector<std::string>& rewrites) {
+    const FilterInput& first = filters[i];
+    const FilterInput& second = filters[i + 1];
+    const std::string pair = FormatFilters({first, second});
+
+    if (POINTWISE_FILTERS.contains(first.name) && first.params.empty() && GetCropSize(second).has_value()) {
+        std::swap(filters[i], filters[i + 1]);
+        rewrites.push_back("moved crop ahead of pointwise filter: " + pair + " -> " +
+                           FormatFilters({filters[i], filters[i + 1]}));
+        return true;
+    }
+    if (GetCropSize(first).has_value() && GetCropSize(second).has_value()) {
+        const auto [first_height, first_width] = *GetCropSize(first);
+        const auto [second_height, second_width] = *GetCropSize(second);
+        filters[i] = FilterInput("crop", {std::to_string(std::min(first_height, second_height)),
+                                          std::to_string(std::min(first_width, second_width))});
+        filters.erase(filters.begin() + i + 1);
+        rewrites.push_back("merged crops: " + pair + " -> " + FormatFilters({filters[i]}));
+        return true;
+    }
+    if (IsFilter(first, "neg", 0) && IsFilter(second, "neg", 0)) {
+        filters.erase(filters.begin() + i, filters.begin() + i + 2);
+        rewrites.push_back("removed double negative: " + pair);
+        return true;
+    }
+    if (IsFilter(first, "gs", 0) && IsFilter(second, "gs", 0)) {
+        filters.erase(filters.begin() + i + 1);
+        rewrites.push_back("removed repeated grayscale: " + pair + " -> -gs");
+        return true;
+    }
+    const std::optional<double> first_sigma = GetBlurSigma(first);
+    const std::optional<double> second_sigma = GetBlurSigma(second);
+    if (first_sigma.has_value() && second_sigma.has_value() && *first_sigma > 0 && *second_sigma > 0) {
+        // Convolution of Gaussians is a Gaussian with summed variances.
+        const double sigma = std::sqrt(*first_sigma * *first_sigma + *second_sigma * *second_sigma);
+        filters[i] = FilterInput("blur", {FormatDouble(sigma)});
+        filters.erase(filters.begin() + i + 1);
+        rewrites.push_back("merged blurs: " + pair + " -> " + FormatFilters({filters[i]}));
+        return true;
+    }
+    return false;
+}
+
+OptimizedPlan OptimizeFilters(const std::vector<FilterInput>& filters) {
+    OptimizedPlan plan{filters, {}};
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < plan.filters.size() && !changed; ++i) {
+            if (GetBlurSigma(plan.filters[i]) == 0.0) {
+                plan.rewrites.push_back("removed blur with zero sigma: " + FormatFilters({plan.filters[i]}));
+                plan.filters.erase(plan.filters.begin() + i);
+                changed = true;
+            } else if (i + 1 < plan.filters.size()) {
+                changed = RewritePair(plan.filters, i, plan.rewrites);
+            }
+        }
+    }
+    return plan;
+}
+
+std::string FormatFilters(const std::vector<FilterInput>& filters) {
+    std::string result;
+    for (const FilterInput& filter : filters) {
+        if (!result.empty()) {
+            result += " ";
+        }
+        result += "-" + filter.name;
+        for (const std::string& param : filter.params) {
+            result += " " + param;
+        }
+    }
+    return result;
+}
+
+std::string ExplainPlan(const std::vector<FilterInput>& filters) {
+    const OptimizedPlan plan = OptimizeFilters(filters);
+    std::ostringstream explanation;
+    explanation << "original: " << FormatFilters(filters) << "\n";
+    explanation << "optimized: " << FormatFilters(plan.filters) << "\n";
+    explanation << "passes: " << filters.size() << " -> " << plan.filters.size() << "\n";
+    for (const std::string& rewrite : plan.rewrites) {
+        explanation << "    " << rewrite << "\n";
+    }
+    return explanation.str();
+}
\ No newline at end of file
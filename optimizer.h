@@ -0,0 +1,29 @@
+#pragma once
+
+#include "parser.h"
+
+#include <string>
+#include <vector>
+
+struct OptimizedPlan {
+    std::vector<FilterInput> filters;
+    // Human-readable description of every applied rewrite, in order.
+    std::vector<std::string> rewrites;
+};
+
+// Rewrites the chain into an equivalent one doing fewer passes over the image:
+//     -gs -crop h w      ->  -crop h w -gs        (crops go ahead of pointwise filters)
+//     -crop a b -crop c d ->  -crop min(a, c) min(b, d)
+//     -blur 0            ->  nothing
+//     -neg -neg          ->  nothing
+//     -gs -gs            ->  -gs
+//     -blur s -blur t    ->  -blur sqrt(s^2 + t^2)
+// Rules are applied until none of them matches. Filters with incorrect parameters are never rewritten, so that
+// creating them reports the error.
+OptimizedPlan OptimizeFilters(const std::vector<FilterInput>& filters);
+
+// Formats the chain as command line arguments.
+std::string FormatFilters(const std::vector<FilterInput>& filters);
+
+// Description of the original and the rewritten chains for --explain.
+std::string ExplainPlan(const std::vector<FilterInput>& filters);
\ No newline at end of file
@@ -2,33 +2,90 @@
 
 #include "exceptions.h"
 
+#include <sstream>
+
 bool operator==(const FilterInput& a, const FilterInput& b) {
     return a.name == b.name && a.params == b.params;
 }
 
 bool operator==(const ParserResult& a, const ParserResult& b) {
-    return a.input_path == b.input_path && a.output_path == b.output_path && a.filters == b.filters;
+    return a.input_path == b.input_path && a.output_path == b.output_path && a.filters == b.filters &&
+           a.options == b.options && a.input_paths == b.input_paths;
 }
 
-ParserResult Parse(int argc, char** argv) {
-    if (argc < 3) {
-        throw UsageException("you should specify input path and output path");
+std::vector<std::string> SplitBySpaces(const std::string& line) {
+    std::istringstream stream(line);
+    std::vector<std::string> words;
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word);
     }
-    ParserResult result;
-    result.input_path = argv[1];
-    result.output_path = argv[2];
+    return words;
+}
 
-    for (size_t i = 3; i < argc; i++) {
-        std::string arg = argv[i];
-        if (arg[0] == '-') {
-            result.filters.emplace_back();
-            result.filters.back().name = arg.substr(1, arg.size() - 1);
+std::vector<FilterInput> ParseFilters(const std::vector<std::string>& args) {
+    std::vector<FilterInput> filters;
+    for (const std::string& arg : args) {
+        if (!arg.empty() && arg[0] == '-') {
+            filters.emplace_back();
+            filters.back().name = arg.substr(1, arg.size() - 1);
         } else {
-            if (result.filters.empty()) {
+            if (filters.empty()) {
                 throw UsageException("excess of unnamed arguments");
             }
-            result.filters.back().params.push_back(arg);
+            filters.back().params.push_back(arg);
+        }
+    }
+    return filters;
+}
+
+ParserResult Parse(int argc, char** argv) {
+    ParserResult result;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.size() <= 2 || arg.substr(0, 2) != "--") {
+            args.push_back(arg);
+            continue;
         }
+        const std::string name = arg.substr(2, arg.size() - 2);
+        auto option = OPTIONS.find(name);
+        if (option == OPTIONS.end()) {
+            throw UsageException("unknown option " + arg);
+        }
+        if (option->second) {
+            if (i + 1 == argc) {
+                throw UsageException("option " + arg + " requires a value");
+            }
+            result.options[name] = argv[++i];
+        } else {
+            result.options[name] = "";
+        }
+    }
+
+    if (result.options.contains("batch") || result.options.contains("serve")) {
+        result.filters = ParseFilters(args);
+        return result;
+    }
+    if (result.options.contains("info") || result.options.contains("validate")) {
+        if (args.empty()) {
+            throw UsageException("you should specify paths of the images to inspect");
+        }
+        result.input_paths = args;
+        return result;
+    }
+    if (result.options.contains("graph")) {
+        if (args.size() != 1) {
+            throw UsageException("in graph mode only the input path is given, filters and outputs are in the graph");
+        }
+        result.input_path = args[0];
+        return result;
+    }
+    if (args.size() < 2) {
+        throw UsageException("you should specify input path and output path");
     }
+    result.input_path = args[0];
+    result.output_path = args[1];
+    result.filters = ParseFilters(std::vector<std::string>(args.begin() + 2, args.end()));
     return result;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 struct FilterInput {
@@ -10,12 +11,30 @@ struct FilterInput {
 
 bool operator==(const FilterInput& a, const FilterInput& b);
 
+// Options are given as --name [value], for every known option it is stored whether it takes a value.
+const std::unordered_map<std::string, bool> OPTIONS = {
+    {"threads", true},       {"batch", true},          {"in-flight", true}, {"serve", true},
+    {"queue-size", true},    {"graph", true},          {"explain", false},  {"cache-dir", true},
+    {"cache-size", true},    {"profile", true},        {"deadline", true},  {"memory-limit", true},
+    {"bits", true},          {"rle", false},           {"format", true},    {"raw-size", true},
+    {"save-spectrum", true}, {"from-spectrum", false}, {"info", false},     {"validate", false}};
+
 struct ParserResult {
     std::string input_path;
     std::string output_path;
     std::vector<FilterInput> filters;
+    std::unordered_map<std::string, std::string> options;
+    // Every path given with --info and --validate.
+    std::vector<std::string> input_paths;
 };
 
 bool operator==(const ParserResult& a, const ParserResult& b);
 
+std::vector<std::string> SplitBySpaces(const std::string& line);
+
+// Groups arguments like -name param1 param2 into filters.
+std::vector<FilterInput> ParseFilters(const std::vector<std::string>& args);
+
+// In batch and server modes input and output paths are given with jobs, so all positional arguments are filters. In
+// graph mode the only positional argument is the input path.
 ParserResult Parse(int argc, char** argv);
\ No newline at end of file
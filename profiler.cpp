@@ -0,0 +1,156 @@
+#include "profiler.h"
+
+#include "exceptions.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+std::atomic<size_t> active_profilers = 0;
+std::atomic<uint64_t> allocated_bytes = 0;
+
+void* operator new(const size_t size) {
+    if (active_profilers.load(std::memory_order_relaxed) != 0) {
+        allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+uint64_t GetAllocatedBytes() {
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+double GetProcessCpuMilliseconds() {
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    constexpr double MillisecondsInSecond = 1e3;
+    constexpr double NanosecondsInMillisecond = 1e6;
+    return static_cast<double>(time.tv_sec) * MillisecondsInSecond +
+           static_cast<double>(time.tv_nsec) / NanosecondsInMillisecond;
+}
+
+uint64_t GetPeakRssKilobytes() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+size_t GetThreadIndex() {
+    static std::atomic<size_t> threads_count = 0;
+    thread_local const size_t index = threads_count.fetch_add(1);
+    return index;
+}
+
+Profiler::Profiler() : start_(std::chrono::steady_clock::now()) {
+    active_profilers.fetch_add(1);
+}
+
+Profiler::~Profiler() {
+    active_profilers.fetch_sub(1);
+}
+
+void Profiler::Measure(const std::string& name, const std::string& category, const std::function<void()>& stage) {
+    ProfileEvent event{name, category, GetThreadIndex()};
+    const auto started = std::chrono::steady_clock::now();
+    const double cpu_started = GetProcessCpuMilliseconds();
+    const uint64_t allocated_started = GetAllocatedBytes();
+    const auto record = [&] {
+        const auto finished = std::chrono::steady_clock::now();
+        event.start_us = std::chrono::duration<double, std::micro>(started - start_).count();
+        event.wall_ms = std::chrono::duration<double, std::milli>(finished - started).count();
+        event.cpu_ms = GetProcessCpuMilliseconds() - cpu_started;
+        event.allocated_bytes = GetAllocatedBytes() - allocated_started;
+        event.peak_rss_kb = GetPeakRssKilobytes();
+        std::lock_guard lock(mutex_);
+        events_.push_back(std::move(event));
+    };
+    try {
+        stage();
+    } catch (...) {
+        record();
+        throw;
+    }
+    record();
+}
+
+const std::vector<ProfileEvent>& Profiler::GetEvents() const {
+    return events_;
+}
+
+JsonValue Profiler::GetTrace() const {
+    std::lock_guard lock(mutex_);
+    JsonValue::Array trace_events;
+    constexpr double MicrosecondsInMillisecond = 1e3;
+    for (const ProfileEvent& event : events_) {
+        trace_events.emplace_back(JsonValue::Object{
+            {"name", event.name},
+            {"cat", event.category},
+            {"ph", "X"},
+            {"ts", event.start_us},
+            {"dur", event.wall_ms * MicrosecondsInMillisecond},
+            {"pid", 1.0},
+            {"tid", static_cast<double>(event.thread)},
+            {"args", JsonValue::Object{{"cpu_ms", event.cpu_ms},
+                                       {"allocated_bytes", static_cast<double>(event.allocated_bytes)},
+                                       {"peak_rss_kb", static_cast<double>(event.peak_rss_kb)}}}});
+    }
+    return JsonValue::Object{{"traceEvents", std::move(trace_events)}, {"displayTimeUnit", "ms"}};
+}
+
+void Profiler::WriteTrace(const std::string& filename) const {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        throw WriteException("could not open " + filename);
+    }
+    out << WriteJson(GetTrace()) << "\n";
+}
+
+std::string Profiler::GetSummary() const {
+    std::lock_guard lock(mutex_);
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(1) << "profile:";
+    double wall_ms = 0;
+    double cpu_ms = 0;
+    uint64_t allocated = 0;
+    uint64_t peak_rss_kb = 0;
+    for (const ProfileEvent& event : events_) {
+        summary << " " << event.name << " " << event.wall_ms << " ms |";
+        wall_ms += event.wall_ms;
+        cpu_ms += event.cpu_ms;
+        allocated += event.allocated_bytes;
+        peak_rss_kb = std::max(peak_rss_kb, event.peak_rss_kb);
+    }
+    constexpr double BytesInMegabyte = 1 << 20;
+    constexpr double KilobytesInMegabyte = 1 << 10;
+    summary << " total " << wall_ms << " ms wall, " << cpu_ms << " ms CPU, "
+            << static_cast<double>(allocated) / BytesInMegabyte << " MB allocated, peak RSS "
+            << static_cast<double>(peak_rss_kb) / KilobytesInMegabyte << " MB";
+    return summary.str();
+}
+
+void MeasureStage(Profiler* profiler, const std::string& name, const std::string& category,
+                  const std::function<void()>& stage) {
+    if (profiler == nullptr) {
+        stage();
+    } else {
+        profiler->Measure(name, category, stage);
+    }
+}
\ No newline at end of file
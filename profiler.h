@@ -0,0 +1,57 @@
+#pragma once
+
+#include "json.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent {
+    std::string name;
+    std::string category;
+    size_t thread = 0;
+    // Microseconds from the creation of the profiler.
+    double start_us = 0;
+    double wall_ms = 0;
+    // CPU time of the whole process, including the thread pool working for the stage.
+    double cpu_ms = 0;
+    uint64_t allocated_bytes = 0;
+    // Peak resident set size of the process at the end of the stage.
+    uint64_t peak_rss_kb = 0;
+};
+
+// Records stages of a run. While a profiler exists, allocations made through operator new are counted.
+class Profiler {
+public:
+    Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    ~Profiler();
+
+    // Runs the stage and records it, the event is recorded even if the stage throws.
+    void Measure(const std::string& name, const std::string& category, const std::function<void()>& stage);
+
+    const std::vector<ProfileEvent>& GetEvents() const;
+
+    // Chrome trace event format, can be opened in chrome://tracing or Perfetto.
+    JsonValue GetTrace() const;
+    void WriteTrace(const std::string& filename) const;
+
+    // Single line with wall time of every stage and totals.
+    std::string GetSummary() const;
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<ProfileEvent> events_;
+};
+
+// Runs the stage, recording it if the profiler is given.
+void MeasureStage(Profiler* profiler, const std::string& name, const std::string& category,
+                  const std::function<void()>& stage);
+
+// Total number of bytes requested from operator new while profilers exist.
+uint64_t GetAllocatedBytes();
\ No newline at end of file
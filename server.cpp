@@ -0,0 +1,442 @@
+#include "server.h"
+
+#include "batch.h"
+#include "controller.h"
+#include "exceptions.h"
+#include "io.h"
+#include "memory_planner.h"
+#include "optimizer.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+void LatencyHistogram::Record(const double milliseconds) {
+    constexpr double MicrosecondsInMillisecond = 1000.0;
+    const double microseconds = milliseconds * MicrosecondsInMillisecond;
+    size_t bucket = 0;
+    if (microseconds > 1.0) {
+        bucket = std::min(BUCKETS_COUNT - 1,
+                          static_cast<size_t>(std::log2(microseconds) * static_cast<double>(BUCKETS_PER_DOUBLING)));
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::GetPercentile(const double percentile) const {
+    const uint64_t count = count_.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0.0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * count)));
+    uint64_t seen = 0;
+    size_t bucket = 0;
+    for (; bucket + 1 < BUCKETS_COUNT; ++bucket) {
+        seen += buckets_[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            break;
+        }
+    }
+    constexpr double MicrosecondsInMillisecond = 1000.0;
+    return std::exp2(static_cast<double>(bucket + 1) / static_cast<double>(BUCKETS_PER_DOUBLING)) /
+           MicrosecondsInMillisecond;
+}
+
+std::string DecodeBase64(const std::string& text) {
+    std::string result;
+    uint32_t buffer = 0;
+    size_t bits = 0;
+    for (const char c : text) {
+        uint32_t value = 0;
+        if ('A' <= c && c <= 'Z') {
+            value = c - 'A';
+        } else if ('a' <= c && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if ('0' <= c && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '+') {
+            value = 62;
+        } else if (c == '/') {
+            value = 63;
+        } else if (c == '=' || c == '\n' || c == '\r') {
+            continue;
+        } else {
+            throw UsageException("incorrect character in base64 data");
+        }
+        constexpr size_t Base64Bits = 6;
+        constexpr size_t ByteBits = 8;
+        buffer = (buffer << Base64Bits) | value;
+        bits += Base64Bits;
+        if (bits >= ByteBits) {
+            bits -= ByteBits;
+            result += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    return result;
+}
+
+double GetMilliseconds(const std::chrono::steady_clock::time_point from,
+                       const std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Removes a socket left by a server which has stopped. Other files and sockets of running servers are kept.
+void RemoveStaleSocket(const std::string& path, const sockaddr_un& address) {
+    struct stat status {};
+    if (lstat(path.c_str(), &status) != 0) {
+        return;
+    }
+    if (!S_ISSOCK(status.st_mode)) {
+        throw UsageException(path + " exists and is not a socket");
+    }
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        throw SupportException(std::string("could not create socket: ") + std::strerror(errno));
+    }
+    const bool listening = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    close(probe);
+    if (listening) {
+        throw UsageException("another server is listening on " + path);
+    }
+    unlink(path.c_str());
+}
+
+Server::Connection::Connection(const int fd) : fd(fd) {
+}
+
+Server::Connection::~Connection() {
+    close(fd);
+}
+
+void Server::Connection::Send(const JsonValue& reply) {
+    const std::string line = WriteJson(reply) + "\n";
+    std::lock_guard lock(write_mutex);
+    size_t sent = 0;
+    while (sent < line.size()) {
+        const ssize_t result = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            // The client has gone, there is nobody to report to.
+            return;
+        }
+        sent += result;
+    }
+}
+
+Server::Server(std::string socket_path, std::vector<FilterInput> default_filters, const size_t workers_count,
+               const size_t queue_size, const std::optional<std::chrono::milliseconds> default_deadline,
+               const std::optional<uint64_t> memory_limit)
+    : socket_path_(std::move(socket_path)),
+      default_filters_(std::move(default_filters)),
+      default_deadline_(default_deadline),
+      queue_(queue_size) {
+    if (memory_limit.has_value()) {
+        memory_budget_ = std::make_unique<MemoryBudget>(*memory_limit);
+    }
+    GetChain(default_filters_);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        throw UsageException("socket path is too long");
+    }
+    std::strcpy(address.sun_path, socket_path_.c_str());
+
+    RemoveStaleSocket(socket_path_, address);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        throw SupportException(std::string("could not create socket: ") + std::strerror(errno));
+    }
+    constexpr int Backlog = 64;
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd_, Backlog) < 0) {
+        const std::string error = std::strerror(errno);
+        close(listen_fd_);
+        throw UsageException("could not listen on " + socket_path_ + ": " + error);
+    }
+
+    for (size_t i = 0; i < workers_count; ++i) {
+        workers_.emplace_back(&Server::WorkerLoop, this);
+    }
+}
+
+Server::~Server() {
+    Stop();
+    {
+        std::unique_lock lock(connections_mutex_);
+        for (const auto& [fd, connection] : connections_) {
+            shutdown(fd, SHUT_RD);
+        }
+        connections_done_.wait(lock, [this] { return connections_.empty(); });
+    }
+    // Workers finish the queued jobs before they get to the empty jobs telling them to stop.
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        queue_.Push(Job{});
+    }
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void Server::Run() {
+    while (!stopping_.load()) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        auto connection = std::make_shared<Connection>(fd);
+        {
+            std::lock_guard lock(connections_mutex_);
+            connections_.emplace(fd, connection);
+        }
+        std::thread(&Server::ServeConnection, this, std::move(connection)).detach();
+    }
+}
+
+void Server::Stop() {
+    if (!stopping_.exchange(true)) {
+        // Wakes up the thread blocked in accept.
+        shutdown(listen_fd_, SHUT_RDWR);
+    }
+}
+
+void Server::ServeConnection(std::shared_ptr<Connection> connection) {
+    std::string pending;
+    constexpr size_t BufferSize = 1 << 16;
+    std::vector<char> buffer(BufferSize);
+    while (true) {
+        const ssize_t received = recv(connection->fd, buffer.data(), buffer.size(), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        pending.append(buffer.data(), received);
+        size_t line_start = 0;
+        // Only the received bytes are searched, the pending part before them has no line breaks.
+        for (size_t line_end = pending.find('\n', pending.size() - received); line_end != std::string::npos;
+             line_end = pending.find('\n', line_start)) {
+            HandleRequest(pending.substr(line_start, line_end - line_start), connection);
+            line_start = line_end + 1;
+        }
+        pending.erase(0, line_start);
+        // Inline inputs take a third more than the file, larger files must be given by path.
+        constexpr size_t MaxRequestBytes = 256 << 20;
+        if (pending.size() > MaxRequestBytes) {
+            connection->Send(JsonValue::Object{
+                {"status", "error"},
+                {"message", "request is longer than " + std::to_string(MaxRequestBytes) + " bytes"}});
+            break;
+        }
+    }
+
+    std::lock_guard lock(connections_mutex_);
+    connections_.erase(connection->fd);
+    connection.reset();
+    connections_done_.notify_all();
+}
+
+void Server::HandleRequest(const std::string& line, const std::shared_ptr<Connection>& connection) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        return;
+    }
+    JsonValue request;
+    try {
+        request = ParseJson(line);
+        if (!request.IsObject()) {
+            throw UsageException("request must be an object");
+        }
+    } catch (const ImageProcessorException& exc) {
+        connection->Send(JsonValue::Object{{"status", "error"}, {"message", exc.what()}});
+        return;
+    }
+
+    if (const JsonValue* command = request.Find("command")) {
+        if (command->IsString() && command->GetString() == "stats") {
+            connection->Send(GetStats());
+        } else if (command->IsString() && command->GetString() == "cancel") {
+            connection->Send(CancelJob(request));
+        } else if (command->IsString() && command->GetString() == "shutdown") {
+            connection->Send(JsonValue::Object{{"status", "ok"}});
+            Stop();
+        } else {
+            connection->Send(JsonValue::Object{{"status", "error"}, {"message", "unknown command"}});
+        }
+        return;
+    }
+
+    std::optional<std::chrono::milliseconds> deadline = default_deadline_;
+    if (const JsonValue* deadline_ms = request.Find("deadline_ms")) {
+        if (!deadline_ms->IsNumber() || !(deadline_ms->GetNumber() > 0)) {
+            connection->Send(JsonValue::Object{{"status", "error"}, {"message", "deadline_ms must be positive"}});
+            return;
+        }
+        deadline = std::chrono::milliseconds(static_cast<int64_t>(std::ceil(deadline_ms->GetNumber())));
+    }
+    const CancellationToken token = CreateCancellationToken(deadline);
+    // Ids of queued and running jobs are unique, so that cancel and the end of a job refer to one token.
+    if (const JsonValue* id = request.Find("id")) {
+        bool added = false;
+        {
+            std::lock_guard lock(active_jobs_mutex_);
+            added = active_jobs_.try_emplace(WriteJson(*id), token).second;
+        }
+        if (!added) {
+            connection->Send(JsonValue::Object{{"id", *id},
+                                               {"status", "error"},
+                                               {"message", "job with this id is already queued or running"}});
+            return;
+        }
+    }
+    queue_.Push(Job{std::move(request), connection, std::chrono::steady_clock::now(), token});
+}
+
+void Server::WorkerLoop() {
+    while (true) {
+        Job job = queue_.Pop();
+        if (job.connection == nullptr) {
+            return;
+        }
+
+        const auto started = std::chrono::steady_clock::now();
+        JsonValue::Object reply;
+        if (const JsonValue* id = job.request.Find("id")) {
+            reply.emplace_back("id", *id);
+        }
+        JsonValue result;
+        {
+            const CancellationScope scope(&job.token);
+            result = ProcessJob(job.request);
+        }
+        if (const JsonValue* id = job.request.Find("id")) {
+            std::lock_guard lock(active_jobs_mutex_);
+            active_jobs_.erase(WriteJson(*id));
+        }
+        reply.insert(reply.end(), result.GetObject().begin(), result.GetObject().end());
+        const auto finished = std::chrono::steady_clock::now();
+        reply.emplace_back("queue_ms", GetMilliseconds(job.enqueued, started));
+        reply.emplace_back("total_ms", GetMilliseconds(job.enqueued, finished));
+        latencies_.Record(GetMilliseconds(job.enqueued, finished));
+        job.connection->Send(std::move(reply));
+    }
+}
+
+JsonValue Server::ProcessJob(const JsonValue& request) {
+    try {
+        // Jobs which missed their deadline in the queue are not started.
+        CheckCancellation();
+        const JsonValue* input = request.Find("input");
+        const JsonValue* input_data = request.Find("input_data");
+        const JsonValue* output = request.Find("output");
+        if ((input == nullptr) == (input_data == nullptr)) {
+            throw UsageException("exactly one of input and input_data must be given");
+        }
+        if (output == nullptr) {
+            throw UsageException("output must be given");
+        }
+        const JsonValue* filters = request.Find("filters");
+        const std::shared_ptr<const Chain> chain =
+            filters == nullptr ? GetChain(default_filters_) : GetChain(ParseJsonFilters(*filters));
+
+        const std::string data = input_data == nullptr ? std::string() : DecodeBase64(input_data->GetString());
+        // Jobs wait for their estimated peak memory before decoding, the ones larger than the budget are refused.
+        const auto arrived = std::chrono::steady_clock::now();
+        MemoryReservation reservation;
+        if (memory_budget_ != nullptr) {
+            std::istringstream in(data);
+            const ImageShape shape = input != nullptr ? ReadImageShape(input->GetString()) : ReadImageShape(in);
+            reservation = MemoryReservation(memory_budget_.get(), EstimateMemory(shape, *chain).peak_bytes);
+        }
+
+        const auto started = std::chrono::steady_clock::now();
+        Image image;
+        if (input != nullptr) {
+            image = ReadImage(input->GetString());
+        } else {
+            std::istringstream in(data);
+            image = ReadImage(in);
+        }
+        const auto read = std::chrono::steady_clock::now();
+        ApplyFilters(image, *chain);
+        const auto filtered = std::chrono::steady_clock::now();
+        WriteImage(image, output->GetString());
+        const auto written = std::chrono::steady_clock::now();
+
+        completed_.fetch_add(1, std::memory_order_relaxed);
+        return JsonValue::Object{{"status", "ok"},
+                                 {"memory_wait_ms", GetMilliseconds(arrived, started)},
+                                 {"read_ms", GetMilliseconds(started, read)},
+                                 {"filters_ms", GetMilliseconds(read, filtered)},
+                                 {"write_ms", GetMilliseconds(filtered, written)}};
+    } catch (const CancelledException& exc) {
+        cancelled_.fetch_add(1, std::memory_order_relaxed);
+        return JsonValue::Object{{"status", "cancelled"}, {"message", exc.what()}};
+    } catch (const ImageProcessorException& exc) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        return JsonValue::Object{{"status", "error"}, {"message", exc.what()}};
+    } catch (const std::exception& exc) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        return JsonValue::Object{{"status", "error"}, {"message", std::string("Unknown exception: ") + exc.what()}};
+    }
+}
+
+JsonValue Server::CancelJob(const JsonValue& request) {
+    const JsonValue* id = request.Find("id");
+    if (id == nullptr) {
+        return JsonValue::Object{{"status", "error"}, {"message", "id of the job must be given"}};
+    }
+    std::lock_guard lock(active_jobs_mutex_);
+    auto job = active_jobs_.find(WriteJson(*id));
+    if (job == active_jobs_.end()) {
+        return JsonValue::Object{{"status", "error"}, {"message", "job is not queued or running"}};
+    }
+    job->second.Cancel();
+    return JsonValue::Object{{"status", "ok"}};
+}
+
+JsonValue Server::GetStats() const {
+    constexpr double BytesInMegabyte = 1 << 20;
+    const uint64_t reserved_bytes = memory_budget_ == nullptr ? 0 : memory_budget_->GetUsed();
+    return JsonValue::Object{{"status", "ok"},
+                             {"completed", static_cast<double>(completed_.load())},
+                             {"failed", static_cast<double>(failed_.load())},
+                             {"cancelled", static_cast<double>(cancelled_.load())},
+                             {"queued", static_cast<double>(queue_.GetSize())},
+                             {"reserved_mb", static_cast<double>(reserved_bytes) / BytesInMegabyte},
+                             {"p50_ms", latencies_.GetPercentile(50)},
+                             {"p99_ms", latencies_.GetPercentile(99)}};
+}
+
+std::shared_ptr<const Server::Chain> Server::GetChain(const std::vector<FilterInput>& filters) {
+    const std::string key = GetChainKey(filters);
+    std::lock_guard lock(chains_mutex_);
+    auto chain = chains_.find(key);
+    if (chain != chains_.end()) {
+        return chain->second;
+    }
+    constexpr size_t MaxCachedChains = 256;
+    if (chains_.size() >= MaxCachedChains) {
+        chains_.clear();
+    }
+    auto created = std::make_shared<const Chain>(CreateFilters(OptimizeFilters(filters).filters));
+    return chains_.emplace(key, std::move(created)).first->second;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "cancellation.h"
+#include "filters/base_filter.h"
+#include "json.h"
+#include "memory_planner.h"
+#include "parser.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Latencies are counted in buckets growing geometrically from 1 microsecond, 8 buckets per doubling, so recording is a
+// single atomic increment and percentiles are found with relative error below 10%.
+class LatencyHistogram {
+public:
+    void Record(double milliseconds);
+
+    size_t GetCount() const;
+
+    // Upper bound of the bucket containing the given percentile (from 0 to 100), in milliseconds.
+    double GetPercentile(double percentile) const;
+
+private:
+    static constexpr size_t BUCKETS_PER_DOUBLING = 8;
+    static constexpr size_t BUCKETS_COUNT = BUCKETS_PER_DOUBLING * 48;
+
+    std::array<std::atomic<uint64_t>, BUCKETS_COUNT> buckets_{};
+    std::atomic<uint64_t> count_ = 0;
+};
+
+std::string DecodeBase64(const std::string& text);
+
+// Daemon accepting jobs over a Unix domain socket. Requests and replies are JSON objects, one per line:
+//     {"id": 1, "input": "a.bmp", "filters": "-gs -blur 2", "output": "b.bmp"}
+// The input can be given inline as base64 in "input_data" instead of "input", filters default to the ones from the
+// command line. Replies contain "status" ("ok" or "error") and timings in milliseconds. {"command": "stats"} returns
+// latency percentiles and counters, {"command": "shutdown"} stops the server after queued jobs are finished.
+// A job is cancelled when its deadline passes, counted from receiving it: "deadline_ms" of the job or default_deadline,
+// or by {"command": "cancel", "id": ...}. Jobs cancelled while queued are dropped without being started.
+// With memory_limit, every job reserves its estimated peak memory before decoding and waits while the memory is taken
+// by other jobs; jobs estimated above the whole limit are refused.
+class Server {
+public:
+    Server(std::string socket_path, std::vector<FilterInput> default_filters, size_t workers_count,
+           size_t queue_size, std::optional<std::chrono::milliseconds> default_deadline = std::nullopt,
+           std::optional<uint64_t> memory_limit = std::nullopt);
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    ~Server();
+
+    // Serves connections until the shutdown command is received.
+    void Run();
+
+    // Executes the job synchronously and returns its reply.
+    JsonValue ProcessJob(const JsonValue& request);
+
+    JsonValue GetStats() const;
+
+private:
+    using Chain = std::vector<std::shared_ptr<BaseFilter>>;
+
+    struct Connection {
+        explicit Connection(int fd);
+        ~Connection();
+
+        void Send(const JsonValue& reply);
+
+        const int fd;
+        std::mutex write_mutex;
+    };
+
+    struct Job {
+        JsonValue request;
+        std::shared_ptr<Connection> connection;
+        std::chrono::steady_clock::time_point enqueued;
+        CancellationToken token;
+    };
+
+    void ServeConnection(std::shared_ptr<Connection> connection);
+    void HandleRequest(const std::string& line, const std::shared_ptr<Connection>& connection);
+    JsonValue CancelJob(const JsonValue& request);
+    void WorkerLoop();
+    void Stop();
+
+    std::shared_ptr<const Chain> GetChain(const std::vector<FilterInput>& filters);
+
+    const std::string socket_path_;
+    const std::vector<FilterInput> default_filters_;
+    const std::optional<std::chrono::milliseconds> default_deadline_;
+    std::unique_ptr<MemoryBudget> memory_budget_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_ = false;
+
+    // Producers wait for free slots, so a full queue stops reading from the sockets and clients are slowed down.
+    BlockingQueue<Job> queue_;
+    std::vector<std::thread> workers_;
+
+    std::mutex connections_mutex_;
+    std::condition_variable connections_done_;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections_;
+
+    // Tokens of queued and running jobs with ids, keyed by the id written as JSON.
+    std::mutex active_jobs_mutex_;
+    std::unordered_map<std::string, CancellationToken> active_jobs_;
+
+    std::mutex chains_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Chain>> chains_;
+
+    LatencyHistogram latencies_;
+    std::atomic<uint64_t> completed_ = 0;
+    std::atomic<uint64_t> failed_ = 0;
+    std::atomic<uint64_t> cancelled_ = 0;
+};
\ No newline at end of file
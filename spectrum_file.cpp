@@ -0,0 +1,141 @@
+#include "spectrum_file.h"
+
+#include "exceptions.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+static_assert(std::endian::native == std::endian::little, "spectrum files are stored in little-endian byte order");
+static_assert(sizeof(SpectrumHeader) == 48, "planes must start right after the 48 bytes of the header");
+
+const SpectrumHeader EXPECTED_HEADER;
+
+void WriteSpectrum(const std::string& filename, const ImageFrequencyDomainRepresentation& spectrum,
+                   const ImageShape& image_shape) {
+    SpectrumHeader header;
+    header.channels = static_cast<uint32_t>(spectrum.GetChannels());
+    header.height = spectrum.GetHeight();
+    header.width = spectrum.GetWidth();
+    header.image_height = image_shape.height;
+    header.image_width = image_shape.width;
+
+    std::ofstream out;
+    try {
+        out.exceptions(std::ios::failbit | std::ios::badbit);
+        out.open(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t color = 0; color < spectrum.GetChannels(); ++color) {
+            for (size_t i = 0; i < spectrum.GetHeight(); ++i) {
+                const std::vector<std::complex<double>>& row = spectrum.GetRow(color, i);
+                out.write(reinterpret_cast<const char*>(row.data()),
+                          static_cast<std::streamsize>(row.size() * sizeof(std::complex<double>)));
+            }
+        }
+    } catch (const std::exception& exc) {
+        throw WriteException("could not write spectrum to " + filename + ": " + exc.what());
+    }
+}
+
+MappedSpectrum::MappedSpectrum(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw ReadException("could not open " + filename);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw ReadException("could not get the size of " + filename);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ < sizeof(SpectrumHeader)) {
+        close(fd);
+        throw CorruptedFileException(filename + " is too short for a spectrum file");
+    }
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        throw ReadException("could not map " + filename + " into memory");
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+
+    std::memcpy(&header_, data_, sizeof(header_));
+    try {
+        if (!std::equal(header_.magic, header_.magic + sizeof(header_.magic), EXPECTED_HEADER.magic)) {
+            throw CorruptedFileException(filename + " is not a spectrum file");
+        }
+        if (header_.version != EXPECTED_HEADER.version) {
+            throw SupportException("version " + std::to_string(header_.version) +
+                                   " of spectrum files is not supported");
+        }
+        // Planes are padded exactly as FFT pads them, empty images have empty spectra.
+        const bool empty = header_.image_height == 0 || header_.image_width == 0;
+        if (empty ? header_.height != 0 || header_.width != 0
+                  : header_.height != RoundUpToPowerOfTwo(header_.image_height) ||
+                        header_.width != RoundUpToPowerOfTwo(header_.image_width)) {
+            throw CorruptedFileException("spectrum planes must be padded to the next powers of two");
+        }
+        if (header_.channels != GRAYSCALE_CHANNELS && header_.channels != RGB_CHANNELS && !empty) {
+            throw CorruptedFileException("spectrum must have 1 or 3 channels");
+        }
+        // Sizes are checked against the file before they are multiplied, so that the product does not overflow.
+        const uint64_t values_count = (size_ - sizeof(SpectrumHeader)) / sizeof(std::complex<double>);
+        const bool too_large = !empty && (header_.width > values_count / header_.height ||
+                                          header_.channels > values_count / (header_.height * header_.width));
+        const uint64_t planes_size = header_.channels * header_.height * header_.width * sizeof(std::complex<double>);
+        if (too_large || size_ != sizeof(SpectrumHeader) + planes_size) {
+            throw CorruptedFileException("size of " + filename + " does not match the size of its planes");
+        }
+    } catch (...) {
+        munmap(data_, size_);
+        throw;
+    }
+}
+
+MappedSpectrum::~MappedSpectrum() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+size_t MappedSpectrum::GetChannels() const {
+    return header_.channels;
+}
+
+size_t MappedSpectrum::GetHeight() const {
+    return header_.height;
+}
+
+size_t MappedSpectrum::GetWidth() const {
+    return header_.width;
+}
+
+ImageShape MappedSpectrum::GetImageShape() const {
+    return ImageShape{header_.image_height, header_.image_width, header_.channels, false};
+}
+
+const std::complex<double>* MappedSpectrum::GetRow(const size_t channel, const size_t i) const {
+    const auto* planes = reinterpret_cast<const std::complex<double>*>(static_cast<const char*>(data_) +
+                                                                       sizeof(SpectrumHeader));
+    return planes + (channel * header_.height + i) * header_.width;
+}
+
+ImageFrequencyDomainRepresentation MappedSpectrum::GetRepresentation() const {
+    std::vector<std::vector<std::vector<std::complex<double>>>> matrix(GetChannels());
+    for (size_t color = 0; color < GetChannels(); ++color) {
+        matrix[color].reserve(GetHeight());
+        for (size_t i = 0; i < GetHeight(); ++i) {
+            const std::complex<double>* row = GetRow(color, i);
+            matrix[color].emplace_back(row, row + GetWidth());
+        }
+    }
+    return ImageFrequencyDomainRepresentation(std::move(matrix));
+}
\ No newline at end of file
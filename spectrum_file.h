@@ -0,0 +1,54 @@
+#pragma once
+
+#include "fft.h"
+#include "image.h"
+
+#include <complex>
+#include <cstdint>
+#include <string>
+
+// Spectrum file, all values in the byte order of the host, which must be little-endian:
+//   "IPSPECTR", version (uint32), channels (uint32),
+//   height and width of the planes, padded to powers of two (uint64),
+//   height and width of the transformed image (uint64),
+//   channels planes of height x width complex<double> values, rows one after another.
+// The header takes 48 bytes, so the planes stay aligned for complex<double> when the file is mapped.
+struct SpectrumHeader {
+    char magic[8] = {'I', 'P', 'S', 'P', 'E', 'C', 'T', 'R'};
+    uint32_t version = 1;
+    uint32_t channels = 0;
+    uint64_t height = 0;
+    uint64_t width = 0;
+    uint64_t image_height = 0;
+    uint64_t image_width = 0;
+};
+
+// Saves the spectrum computed by FFT for the image of the given shape.
+void WriteSpectrum(const std::string& filename, const ImageFrequencyDomainRepresentation& spectrum,
+                   const ImageShape& image_shape);
+
+// Spectrum file mapped into memory. The header is validated once, then the planes are used in place without parsing.
+class MappedSpectrum {
+public:
+    explicit MappedSpectrum(const std::string& filename);
+    MappedSpectrum(const MappedSpectrum&) = delete;
+    MappedSpectrum& operator=(const MappedSpectrum&) = delete;
+    ~MappedSpectrum();
+
+    size_t GetChannels() const;
+    size_t GetHeight() const;
+    size_t GetWidth() const;
+
+    // Shape of the image the spectrum was computed for, the filters crop their results to it.
+    ImageShape GetImageShape() const;
+
+    const std::complex<double>* GetRow(size_t channel, size_t i) const;
+
+    // Copies the planes row by row into the representation used by the filters.
+    ImageFrequencyDomainRepresentation GetRepresentation() const;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    SpectrumHeader header_;
+};
\ No newline at end of file
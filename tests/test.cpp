@@ -3,11 +3,39 @@
 #include "catch2/matchers/catch_matchers.hpp"
 #include "catch2/matchers/catch_matchers_exception.hpp"
 
+#include "../batch.h"
+#include "../cache.h"
+#include "../cancellation.h"
 #include "../controller.h"
 #include "../exceptions.h"
 #include "../factories/crop_factory.h"
 #include "../factories/edge_factory.h"
+#include "../filters/grayscale_filter.h"
+#include "../filters/integral_image.h"
+#include "../filters/kernels.h"
+#include "../filters/median_filter.h"
+#include "../filters/negative_filter.h"
+#include "../filters/resize_filter.h"
+#include "../graph.h"
+#include "../io.h"
+#include "../json.h"
+#include "../memory_planner.h"
+#include "../optimizer.h"
 #include "../parser.h"
+#include "../profiler.h"
+#include "../server.h"
+#include "../spectrum_file.h"
+#include "../thread_pool.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 
 TEST_CASE("Parser: positional arguments") {
     SECTION("No arguments given") {
@@ -42,7 +70,148 @@ TEST_CASE("Parser") {
     REQUIRE(Parse(11, argv) ==
             ParserResult("a.bmp", "b.bmp",
                          {FilterInput("crop", {"1", "abc"}), FilterInput("0.3", {}), FilterInput("edge", {}),
-                          FilterInput("blur", {"*&?"}), FilterInput("", {})}));
+                          FilterInput("blur", {"*&?"}), FilterInput("", {})},
+                         {}, {}));
+}
+
+TEST_CASE("Parser: options") {
+    SECTION("Options with values are taken out of positional arguments") {
+        char* argv[] = {(char*)"image_processor", (char*)"--threads", (char*)"4", (char*)"a.bmp", (char*)"b.bmp",
+                        (char*)"-crop", (char*)"1", (char*)"2"};
+        REQUIRE(Parse(8, argv) ==
+                ParserResult("a.bmp", "b.bmp", {FilterInput("crop", {"1", "2"})}, {{"threads", "4"}}, {}));
+    }
+
+    SECTION("Unknown option") {
+        char* argv[] = {(char*)"image_processor", (char*)"a.bmp", (char*)"b.bmp", (char*)"--abcd"};
+        REQUIRE_THROWS_AS(Parse(4, argv), UsageException);
+    }
+
+    SECTION("Missing value") {
+        char* argv[] = {(char*)"image_processor", (char*)"a.bmp", (char*)"b.bmp", (char*)"--threads"};
+        REQUIRE_THROWS_AS(Parse(4, argv), UsageException);
+    }
+}
+
+TEST_CASE("Parser: graph mode") {
+    char* argv[] = {(char*)"image_processor", (char*)"a.bmp", (char*)"--graph", (char*)"graph.txt"};
+    REQUIRE(Parse(4, argv) == ParserResult("a.bmp", "", {}, {{"graph", "graph.txt"}}, {}));
+    char* with_filters[] = {(char*)"image_processor", (char*)"a.bmp", (char*)"--graph", (char*)"graph.txt",
+                            (char*)"-gs"};
+    REQUIRE_THROWS_AS(Parse(5, with_filters), UsageException);
+}
+
+TEST_CASE("Parser: batch mode") {
+    char* argv[] = {(char*)"image_processor", (char*)"--batch", (char*)"manifest.txt", (char*)"-gs", (char*)"-blur",
+                    (char*)"2"};
+    REQUIRE(Parse(6, argv) ==
+            ParserResult("", "", {FilterInput("gs", {}), FilterInput("blur", {"2"})}, {{"batch", "manifest.txt"}}, {}));
+}
+
+TEST_CASE("JSON") {
+    SECTION("Parsing") {
+        const JsonValue value = ParseJson(R"( {"a": [1, -2.5e1, true, null], "b": "x\"\u00e9\n", "c": {}} )");
+        REQUIRE(value.Find("a")->GetArray().size() == 4);
+        REQUIRE(value.Find("a")->GetArray()[1].GetNumber() == -25.0);
+        REQUIRE(value.Find("a")->GetArray()[2].GetBool());
+        REQUIRE(value.Find("a")->GetArray()[3].IsNull());
+        REQUIRE(value.Find("b")->GetString() == "x\"\xC3\xA9\n");
+        REQUIRE(value.Find("c")->GetObject().empty());
+        REQUIRE(value.Find("d") == nullptr);
+        REQUIRE_THROWS_AS(value.Find("b")->GetNumber(), JsonException);
+    }
+
+    SECTION("Incorrect input") {
+        REQUIRE_THROWS_AS(ParseJson("{\"a\": }"), JsonException);
+        REQUIRE_THROWS_AS(ParseJson("[1, 2"), JsonException);
+        REQUIRE_THROWS_AS(ParseJson("\"abc"), JsonException);
+        REQUIRE_THROWS_AS(ParseJson("1 2"), JsonException);
+    }
+
+    SECTION("Writing") {
+        const JsonValue value(JsonValue::Object{{"a", JsonValue::Array{1.0, 0.5, false}}, {"b", "q\"\n"}});
+        REQUIRE(WriteJson(value) == R"({"a":[1,0.5,false],"b":"q\"\n"})");
+        REQUIRE(WriteJson(ParseJson(WriteJson(value))) == WriteJson(value));
+    }
+}
+
+TEST_CASE("Batch manifest") {
+    std::istringstream manifest(
+        "# comment\n"
+        "\n"
+        "a.bmp b.bmp\n"
+        "c.bmp d.bmp -crop 1 2 -gs\n"
+        R"({"input": "e f.bmp", "output": "g.bmp", "filters": "-blur 2"})"
+        "\n"
+        R"({"input": "h.bmp", "output": "i.bmp", "filters": ["-edge", "0.1"]})");
+    const std::vector<BatchJob> jobs = ReadManifest(manifest);
+    const std::vector<FilterInput> crop_and_gs = {FilterInput("crop", {"1", "2"}), FilterInput("gs", {})};
+    REQUIRE(jobs == std::vector<BatchJob>{{"a.bmp", "b.bmp", std::nullopt},
+                                          {"c.bmp", "d.bmp", crop_and_gs},
+                                          {"e f.bmp", "g.bmp", {{FilterInput("blur", {"2"})}}},
+                                          {"h.bmp", "i.bmp", {{FilterInput("edge", {"0.1"})}}}});
+
+    std::istringstream without_output("a.bmp\n");
+    REQUIRE_THROWS_AS(ReadManifest(without_output), UsageException);
+    std::istringstream incorrect_json(R"({"input": "a.bmp", "output": 1})");
+    REQUIRE_THROWS_AS(ReadManifest(incorrect_json), UsageException);
+
+    SECTION("Incorrect default chain fails only the files using it") {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "image_processor_batch_test.bmp";
+        WriteImage(Image(4, 6), path.string());
+        const std::vector<BatchJob> overriding = {{path.string(), path.string(), {{FilterInput("neg", {})}}},
+                                                  {path.string(), path.string(), std::nullopt}};
+        std::ostringstream errors;
+        REQUIRE(RunBatch(overriding, {FilterInput("blur", {"abc"})}, 2, errors) == 1);
+        REQUIRE(errors.str().find("blur") != std::string::npos);
+        REQUIRE(ReadImage(path.string()).GetPixel(3, 5) == Color(1, 1, 1));
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("Filter graph") {
+    std::istringstream spec(
+        "gray = input -gs\n"
+        "# spectrum\n"
+        "real = gray -fft-real 1000\n"
+        "imag = gray -fft-imag 1000\n"
+        "edges = input -gs -edge 0.1\n"
+        "output real real.bmp\n"
+        "output imag imag.bmp\n"
+        "output edges edges.bmp\n"
+        "output gray gray.bmp\n");
+    const FilterGraph graph(ReadGraphSpec(spec));
+    REQUIRE(graph.GetFiltersCount() == 4);
+
+    std::vector<std::vector<Color>> pixels(6, std::vector<Color>(5));
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        for (size_t j = 0; j < pixels[i].size(); ++j) {
+            pixels[i][j] = Color(0.1 * i, 0.15 * j, 0.05 * (i + j));
+        }
+    }
+    std::unordered_map<std::string, Image> outputs;
+    graph.Run(Image(pixels), [&](const std::string& path, const Image& image) { outputs.emplace(path, image); });
+    REQUIRE(outputs.size() == 4);
+
+    const std::unordered_map<std::string, std::vector<FilterInput>> chains = {
+        {"real.bmp", {FilterInput("gs", {}), FilterInput("fft-real", {"1000"})}},
+        {"imag.bmp", {FilterInput("gs", {}), FilterInput("fft-imag", {"1000"})}},
+        {"edges.bmp", {FilterInput("gs", {}), FilterInput("edge", {"0.1"})}},
+        {"gray.bmp", {FilterInput("gs", {})}}};
+    for (const auto& [path, chain] : chains) {
+        Image expected(pixels);
+        ApplyFilters(expected, CreateFilters(chain));
+        REQUIRE(outputs.at(path).GetPixels() == expected.GetPixels());
+    }
+
+    SECTION("Incorrect specs") {
+        std::istringstream undefined("a = b -gs\noutput a a.bmp\n");
+        REQUIRE_THROWS_AS(ReadGraphSpec(undefined), UsageException);
+        std::istringstream redefined("a = input -gs\na = input -neg\noutput a a.bmp\n");
+        REQUIRE_THROWS_AS(ReadGraphSpec(redefined), UsageException);
+        std::istringstream without_outputs("a = input -gs\n");
+        REQUIRE_THROWS_AS(ReadGraphSpec(without_outputs), UsageException);
+    }
 }
 
 TEST_CASE("Controller: creating filters") {
@@ -58,6 +227,1202 @@ TEST_CASE("Controller: creating filters") {
     }
 }
 
+TEST_CASE("Controller: regions of interest") {
+    const Rect whole_image{0, 0, SIZE_MAX, SIZE_MAX};
+
+    SECTION("Crop is propagated through bounded-support filters") {
+        auto filters = CreateFilters({FilterInput("sharp", {}), FilterInput("neg", {}), FilterInput("blur", {"1"}),
+                                      FilterInput("crop", {"20", "10"}), FilterInput("gs", {})});
+        REQUIRE(GetRegionsOfInterest(filters) == std::vector<Rect>{Rect{0, 0, 23, 13}, Rect{0, 0, 22, 12},
+                                                                   Rect{0, 0, 22, 12}, Rect{0, 0, 20, 10},
+                                                                   whole_image});
+    }
+
+    SECTION("Filters depending on the whole image reset the region") {
+        auto filters = CreateFilters(
+            {FilterInput("edge", {"0.1"}), FilterInput("fft-lowpass", {"0.1"}), FilterInput("crop", {"5", "7"})});
+        REQUIRE(GetRegionsOfInterest(filters) == std::vector<Rect>{whole_image, whole_image, Rect{0, 0, 5, 7}});
+    }
+
+    SECTION("Nested crops") {
+        auto filters = CreateFilters({FilterInput("crop", {"20", "10"}), FilterInput("crop", {"5", "70"})});
+        REQUIRE(GetRegionsOfInterest(filters) == std::vector<Rect>{Rect{0, 0, 5, 10}, Rect{0, 0, 5, 70}});
+    }
+}
+
+TEST_CASE("Optimizer") {
+    SECTION("Chain without rewrites stays the same") {
+        const std::vector<FilterInput> chain = {FilterInput("sharp", {}), FilterInput("gs", {}),
+                                                FilterInput("blur", {"2"}), FilterInput("edge", {"0.1"})};
+        const OptimizedPlan plan = OptimizeFilters(chain);
+        REQUIRE(plan.filters == chain);
+        REQUIRE(plan.rewrites.empty());
+    }
+
+    SECTION("Rewrites are applied until none matches") {
+        const OptimizedPlan plan = OptimizeFilters(
+            {FilterInput("gs", {}), FilterInput("crop", {"20", "10"}), FilterInput("crop", {"5", "70"}),
+             FilterInput("neg", {}), FilterInput("blur", {"0"}), FilterInput("neg", {}), FilterInput("gs", {}),
+             FilterInput("blur", {"3"}), FilterInput("blur", {"4"})});
+        REQUIRE(plan.filters == std::vector<FilterInput>{FilterInput("crop", {"5", "10"}), FilterInput("gs", {}),
+                                                         FilterInput("blur", {"5"})});
+        REQUIRE(FormatFilters(plan.filters) == "-crop 5 10 -gs -blur 5");
+    }
+
+    SECTION("Filters with incorrect parameters are not rewritten") {
+        const std::vector<FilterInput> chain = {FilterInput("blur", {"abc"}), FilterInput("blur", {"1"}),
+                                                FilterInput("neg", {"1"}), FilterInput("neg", {}),
+                                                FilterInput("crop", {"1.5", "2"})};
+        REQUIRE(OptimizeFilters(chain).filters == chain);
+    }
+
+    SECTION("Rewritten chain gives the same image") {
+        std::vector<std::vector<Color>> pixels(32, std::vector<Color>(24));
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            for (size_t j = 0; j < pixels[i].size(); ++j) {
+                pixels[i][j] = Color(0.1 * static_cast<double>((i * 7 + j) % 11), j / 24.0, i / 32.0);
+            }
+        }
+        const std::vector<FilterInput> chain = {FilterInput("neg", {}), FilterInput("crop", {"20", "10"}),
+                                                FilterInput("neg", {}), FilterInput("sharp", {})};
+        Image expected(pixels);
+        ApplyFilters(expected, CreateFilters(chain));
+        Image optimized(pixels);
+        ApplyFilters(optimized, CreateFilters(OptimizeFilters(chain).filters));
+        REQUIRE(optimized.GetHeight() == expected.GetHeight());
+        REQUIRE(optimized.GetWidth() == expected.GetWidth());
+        for (size_t i = 0; i < expected.GetHeight(); ++i) {
+            for (size_t j = 0; j < expected.GetWidth(); ++j) {
+                REQUIRE(std::abs(optimized.GetPixel(i, j).r - expected.GetPixel(i, j).r) < 1e-9);
+                REQUIRE(std::abs(optimized.GetPixel(i, j).b - expected.GetPixel(i, j).b) < 1e-9);
+            }
+        }
+    }
+}
+
+TEST_CASE("Result cache") {
+    SECTION("Keys") {
+        REQUIRE(GetFnvHash("") == FNV_OFFSET_BASIS);
+        REQUIRE(GetFnvHash("a") == 0xaf63dc4c8601ec8cULL);
+        REQUIRE(GetFnvHash("b", GetFnvHash("a")) == GetFnvHash("ab"));
+        REQUIRE(GetCanonicalFilter(FilterInput("blur", {"2.0"})) == GetCanonicalFilter(FilterInput("blur", {"2"})));
+        REQUIRE(GetCanonicalFilter(FilterInput("crop", {"020", "1e1"})) == "-crop 20 10");
+        REQUIRE(GetCanonicalFilter(FilterInput("blur", {"abc"})) == "-blur abc");
+    }
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "image_processor_cache_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string input_path = (directory / "input.bmp").string();
+    std::vector<std::vector<Color>> pixels(12, std::vector<Color>(9));
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        for (size_t j = 0; j < pixels[i].size(); ++j) {
+            pixels[i][j] = Color(0.05 * i, 0.1 * j, 0.5);
+        }
+    }
+    WriteImage(Image(pixels), input_path);
+
+    const auto check_chain = [&](ResultCache& cache, const std::vector<FilterInput>& inputs) {
+        Image expected = ReadImage(input_path);
+        ApplyFilters(expected, CreateFilters(inputs));
+        REQUIRE(ReadAndApplyFilters(input_path, inputs, CreateFilters(inputs), cache).GetPixels() ==
+                expected.GetPixels());
+    };
+    const auto count_files = [&](const std::string& cache_directory) {
+        return std::distance(std::filesystem::directory_iterator(cache_directory),
+                             std::filesystem::directory_iterator());
+    };
+
+    SECTION("Cached prefixes give the same results") {
+        const std::string cache_directory = (directory / "cache").string();
+        ResultCache cache(cache_directory, 1 << 30);
+        check_chain(cache, {FilterInput("sharp", {}), FilterInput("gs", {}), FilterInput("edge", {"0.1"})});
+        REQUIRE(count_files(cache_directory) == 3);
+        check_chain(cache, {FilterInput("sharp", {}), FilterInput("gs", {}), FilterInput("edge", {"0.1"})});
+        check_chain(cache, {FilterInput("sharp", {}), FilterInput("gs", {}), FilterInput("edge", {"0.3"})});
+        REQUIRE(count_files(cache_directory) == 4);
+        check_chain(cache, {FilterInput("sharp", {}), FilterInput("crop", {"5", "4"}), FilterInput("neg", {})});
+        REQUIRE(count_files(cache_directory) == 6);
+    }
+
+    SECTION("Inputs with the same file name hash do not share results") {
+        const std::string cache_directory = (directory / "collision_cache").string();
+        ResultCache cache(cache_directory, 1 << 30);
+        const InputKey input = GetInputKey("input");
+        REQUIRE(input.size == 5);
+        REQUIRE(input.check != GetInputKey("inpus").check);
+        cache.Store(input, "-neg\n", ReadImage(input_path));
+        REQUIRE(cache.Load(input, "-neg\n"));
+        REQUIRE_FALSE(cache.Load(InputKey{input.hash, input.size + 1, input.check}, "-neg\n"));
+        REQUIRE_FALSE(cache.Load(InputKey{input.hash, input.size, input.check + 1}, "-neg\n"));
+        REQUIRE_FALSE(cache.Load(input, "-gs\n"));
+    }
+
+    SECTION("Corrupt files are misses") {
+        const std::string cache_directory = (directory / "corrupt_cache").string();
+        ResultCache cache(cache_directory, 1 << 30);
+        const InputKey input = GetInputKey("input");
+        const std::string prefix = "-neg\n";
+        cache.Store(input, prefix, ReadImage(input_path));
+        const std::filesystem::path cache_path = *std::filesystem::directory_iterator(cache_directory);
+        const auto header_offset = static_cast<std::streamoff>(8 + 3 * sizeof(uint64_t) + prefix.size());
+        const auto set_header = [&](const size_t index, const uint64_t value) {
+            std::fstream file(cache_path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(header_offset + static_cast<std::streamoff>(index * sizeof(uint64_t)));
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        REQUIRE(cache.Load(input, prefix));
+        set_header(0, uint64_t{1} << 62);
+        REQUIRE_FALSE(cache.Load(input, prefix));
+        set_header(0, 12);
+        set_header(1, uint64_t{1} << 62);
+        REQUIRE_FALSE(cache.Load(input, prefix));
+        set_header(1, 9);
+        REQUIRE(cache.Load(input, prefix));
+        std::filesystem::resize_file(cache_path, std::filesystem::file_size(cache_path) - 1);
+        REQUIRE_FALSE(cache.Load(input, prefix));
+    }
+
+    SECTION("Least recently used images are removed") {
+        const std::string cache_directory = (directory / "small_cache").string();
+        ResultCache cache(cache_directory, 1);
+        check_chain(cache, {FilterInput("neg", {}), FilterInput("blur", {"1"})});
+        REQUIRE(count_files(cache_directory) == 0);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Profiler") {
+    Profiler profiler;
+    std::vector<std::vector<Color>> pixels(16, std::vector<Color>(16, Color(0.2, 0.4, 0.6)));
+    Image image(pixels);
+    const std::vector<FilterInput> inputs = {FilterInput("neg", {}), FilterInput("gs", {})};
+    ApplyFilters(image, CreateFilters(inputs), inputs, &profiler);
+    REQUIRE_THROWS_AS(MeasureStage(&profiler, "failing", "io", [] { throw ReadException("abc"); }), ReadException);
+
+    const std::vector<ProfileEvent>& events = profiler.GetEvents();
+    REQUIRE(events.size() == 3);
+    REQUIRE(events[0].name == "neg");
+    REQUIRE(events[1].name == "gs");
+    REQUIRE(events[1].category == "filter");
+    REQUIRE(events[1].allocated_bytes >= 16 * 16 * sizeof(double));
+    REQUIRE(events[1].start_us >= events[0].start_us);
+    REQUIRE(events[2].name == "failing");
+
+    const JsonValue trace = ParseJson(WriteJson(profiler.GetTrace()));
+    REQUIRE(trace.Find("traceEvents")->GetArray().size() == 3);
+    REQUIRE(trace.Find("traceEvents")->GetArray()[0].Find("ph")->GetString() == "X");
+    REQUIRE(profiler.GetSummary().starts_with("profile: neg "));
+}
+
+TEST_CASE("Cancellation") {
+    std::vector<std::vector<Color>> pixels(64, std::vector<Color>(64, Color(0.2, 0.4, 0.6)));
+
+    SECTION("Tokens") {
+        const CancellationToken token;
+        const CancellationToken copy = token;
+        REQUIRE(!token.IsCancelled());
+        copy.Cancel();
+        REQUIRE(token.IsCancelled());
+        REQUIRE_THROWS_MATCHES(token.ThrowIfCancelled(), CancelledException,
+                               Catch::Matchers::Message("cancelled: job was cancelled"));
+        const CancellationToken expired = CreateCancellationToken(std::chrono::milliseconds(0));
+        REQUIRE_THROWS_MATCHES(expired.ThrowIfCancelled(), CancelledException,
+                               Catch::Matchers::Message("cancelled: deadline exceeded"));
+        REQUIRE(!CreateCancellationToken(std::nullopt).IsCancelled());
+    }
+
+    SECTION("Filters stop when the current token is cancelled") {
+        const CancellationToken token;
+        token.Cancel();
+        Image image(pixels);
+        {
+            const CancellationScope scope(&token);
+            REQUIRE(GetCurrentCancellationToken() == &token);
+            REQUIRE_THROWS_AS(ApplyFilters(image, CreateFilters({FilterInput("blur", {"3"})})), CancelledException);
+            REQUIRE_THROWS_AS(FFT(image), CancelledException);
+        }
+        REQUIRE(GetCurrentCancellationToken() == nullptr);
+        REQUIRE_NOTHROW(ApplyFilters(image, CreateFilters({FilterInput("blur", {"3"})})));
+    }
+
+    SECTION("Tasks of the thread pool get the token of the caller") {
+        ThreadPool pool(4);
+        const CancellationToken token;
+        const CancellationScope scope(&token);
+        std::atomic<int> with_token = 0;
+        pool.ParallelFor(16, [&](size_t) { with_token += GetCurrentCancellationToken() == &token ? 1 : 0; });
+        REQUIRE(with_token == 16);
+    }
+}
+
+TEST_CASE("Memory planner") {
+    std::vector<std::vector<Color>> pixels(40, std::vector<Color>(30, Color(0.2, 0.4, 0.6)));
+
+    SECTION("Shape is read from the header") {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "image_processor_shape_test.bmp";
+        WriteImage(Image(pixels), path.string());
+        REQUIRE(ReadImageShape(path.string()) == ImageShape{40, 30, RGB_CHANNELS, false});
+        std::filesystem::remove(path);
+        std::istringstream corrupted("BA");
+        REQUIRE_THROWS_AS(ReadImageShape(corrupted), CorruptedFileException);
+    }
+
+    SECTION("Estimated shapes match the applied filters") {
+        const std::vector<FilterInput> inputs = {
+            FilterInput("sharp", {}), FilterInput("gs", {}), FilterInput("edge", {"0.1"}), FilterInput("blur", {"1"}),
+            FilterInput("crop", {"20", "25"}), FilterInput("fft-lowpass", {"0.5"}), FilterInput("fft-magnitude", {}),
+            FilterInput("neg", {})};
+        const std::vector<std::shared_ptr<BaseFilter>> filters = CreateFilters(inputs);
+        Image image(pixels);
+        ImageShape shape = image.GetShape();
+        for (const std::shared_ptr<BaseFilter>& filter : filters) {
+            shape = filter->EstimateMemory(shape).output;
+            filter->Apply(image);
+            REQUIRE(image.GetShape() == shape);
+        }
+        REQUIRE(shape == ImageShape{32, 32, GRAYSCALE_CHANNELS, false});
+    }
+
+    SECTION("Peak of the chain") {
+        const ImageShape input{100, 60, RGB_CHANNELS, false};
+        const uint64_t image_bytes = 100 * 60 * 3 * sizeof(double);
+        const MemoryPlan plan = EstimateMemory(
+            input, CreateFilters({FilterInput("crop", {"50", "60"}), FilterInput("neg", {}), FilterInput("gs", {})}));
+        REQUIRE(plan.decode_bytes == image_bytes);
+        REQUIRE(plan.filter_bytes == std::vector<uint64_t>{image_bytes, image_bytes + image_bytes / 2,
+                                                           image_bytes / 2 + image_bytes / 6});
+        REQUIRE(plan.peak_bytes == image_bytes + image_bytes / 2);
+
+        const MemoryPlan fft_plan = EstimateMemory(input, CreateFilters({FilterInput("fft-lowpass", {"0.1"})}));
+        // Spectra of the padded 128 x 64 image take 16 bytes per value.
+        REQUIRE(fft_plan.peak_bytes > image_bytes + 3 * 128 * 64 * 3 * 16);
+        REQUIRE(ExplainMemory(fft_plan, {FilterInput("fft-lowpass", {"0.1"})}).starts_with("memory: decode "));
+
+        std::istringstream spec("gray = input -gs\nlow = gray -fft-lowpass 0.1\noutput gray g.bmp\noutput low l.bmp\n");
+        const uint64_t graph_bytes = EstimateGraphPeakBytes(input, ReadGraphSpec(spec));
+        REQUIRE(graph_bytes ==
+                EstimateMemory(input, CreateFilters({FilterInput("gs", {}), FilterInput("fft-lowpass", {"0.1"})}))
+                    .peak_bytes);
+        REQUIRE(graph_bytes > EstimateMemory(input, CreateFilters({FilterInput("gs", {})})).peak_bytes);
+    }
+
+    SECTION("Budget") {
+        REQUIRE_THROWS_MATCHES(CheckMemoryLimit(3 << 20, 2 << 20), MemoryLimitException,
+                               Catch::Matchers::Message(
+                                   "memory limit exceeded: estimated peak 3.0 MB is above the limit of 2.0 MB"));
+        MemoryBudget budget(100);
+        REQUIRE_THROWS_AS(budget.Acquire(101), MemoryLimitException);
+        std::optional<MemoryReservation> first(std::in_place, &budget, 50);
+        REQUIRE(budget.GetUsed() == 50);
+        std::atomic<bool> acquired = false;
+        std::thread waiting([&] {
+            const MemoryReservation second(&budget, 60);
+            acquired = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE(!acquired);
+        first.reset();
+        waiting.join();
+        REQUIRE(acquired);
+        REQUIRE(budget.GetUsed() == 0);
+    }
+}
+
+TEST_CASE("BMP formats") {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "image_processor_format_test.bmp";
+    Image rgb(5, 7);
+    Image gray(5, 7, GRAYSCALE_CHANNELS);
+    for (size_t i = 0; i < 5; ++i) {
+        for (size_t j = 0; j < 7; ++j) {
+            for (size_t k = 0; k < RGB_CHANNELS; ++k) {
+                rgb.GetMutableRow(i)[j * RGB_CHANNELS + k] = static_cast<double>(i * 40 + j * 5 + k) / 255.0;
+            }
+            gray.GetMutableRow(i)[j] = static_cast<double>(i * 50 + j) / 255.0;
+        }
+    }
+    const auto check_round_trip = [&](const Image& image, std::optional<uint16_t> bit_count, const size_t file_size) {
+        WriteImage(image, path.string(), bit_count);
+        REQUIRE(std::filesystem::file_size(path) == file_size);
+        const Image result = ReadImage(path.string());
+        REQUIRE(result.GetShape() == ImageShape{5, 7, image.GetChannels(), false});
+        REQUIRE(result.GetPixels() == image.GetPixels());
+    };
+
+    SECTION("Grayscale images are written with 8 bits") {
+        check_round_trip(gray, std::nullopt, 54 + 256 * 4 + 5 * 8);
+        REQUIRE(ReadImageShape(path.string()) == ImageShape{5, 7, GRAYSCALE_CHANNELS, false});
+        Image mask = rgb;
+        CreateFilters({FilterInput("edge", {"0.01"})})[0]->Apply(mask);
+        WriteImage(mask, path.string());
+        REQUIRE(ReadImage(path.string()).GetPixels() == mask.GetPixels());
+    }
+
+    SECTION("24-bit and 32-bit images") {
+        check_round_trip(rgb, std::nullopt, 54 + 5 * 24);
+        check_round_trip(rgb, RGBX_BITS, 54 + 5 * 28);
+        WriteImage(gray, path.string(), RGB_BITS);
+        REQUIRE(ReadImage(path.string()).GetPixels() == gray.GetPixels());
+        REQUIRE_THROWS_AS(WriteImage(rgb, path.string(), PALETTE8_BITS), UsageException);
+        REQUIRE_THROWS_AS(WriteImage(rgb, path.string(), 16), UsageException);
+    }
+
+    SECTION("Masks and grayscale images compressed with RLE") {
+        Image mask = rgb;
+        CreateFilters({FilterInput("edge", {"0.01"})})[0]->Apply(mask);
+        for (const std::optional<uint16_t> bit_count : {std::optional<uint16_t>(), std::optional<uint16_t>(4)}) {
+            WriteImage(mask, path.string(), bit_count);
+            const Image result = ReadImage(path.string());
+            REQUIRE(result.GetChannels() == GRAYSCALE_CHANNELS);
+            REQUIRE(result.GetPixels() == mask.GetPixels());
+        }
+
+        // Every row of the grayscale image is written in absolute mode.
+        WriteImage(gray, path.string(), std::nullopt, true);
+        REQUIRE(ReadImage(path.string()).GetPixels() == gray.GetPixels());
+        REQUIRE_THROWS_AS(WriteImage(gray, path.string(), PALETTE4_BITS), UsageException);
+        REQUIRE_THROWS_AS(WriteImage(rgb, path.string(), std::nullopt, true), UsageException);
+
+        Image sparse(200, 300);
+        std::fill_n(sparse.GetMutableRow(100) + 150 * RGB_CHANNELS, RGB_CHANNELS, 1.0);
+        CreateFilters({FilterInput("edge", {"0.5"})})[0]->Apply(sparse);
+        WriteImage(sparse, path.string());
+        // Every row is two runs of black and the end of the line, uncompressed rows would take 300 bytes.
+        REQUIRE(std::filesystem::file_size(path) < 200 * 300 / 40);
+        REQUIRE(ReadImage(path.string()).GetPixels() == sparse.GetPixels());
+    }
+
+    SECTION("Large files are decoded by slices of rows") {
+        Image large(400, 1000);
+        for (size_t i = 0; i < 400; ++i) {
+            for (size_t k = 0; k < 1000 * RGB_CHANNELS; ++k) {
+                large.GetMutableRow(i)[k] = static_cast<double>((i * 7 + k * 13) % 256) / 255.0;
+            }
+        }
+        WriteImage(large, path.string());
+        REQUIRE(ReadImage(path.string()).GetPixels() == large.GetPixels());
+        std::ifstream stream(path, std::ios::binary);
+        REQUIRE(ReadImage(stream).GetPixels() == large.GetPixels());
+        stream.close();
+
+        // The same rows stored from bottom to top.
+        std::string data;
+        {
+            std::ifstream in(path, std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        data[22] = static_cast<char>(400 % 256);
+        data[23] = static_cast<char>(400 / 256);
+        data[24] = data[25] = '\0';
+        std::ofstream(path, std::ios::binary) << data;
+        std::vector<std::vector<Color>> flipped = large.GetPixels();
+        std::reverse(flipped.begin(), flipped.end());
+        REQUIRE(ReadImage(path.string()).GetPixels() == flipped);
+
+        std::ofstream(path, std::ios::binary | std::ios::app) << '\0';
+        REQUIRE_THROWS_AS(ReadImage(path.string()), CorruptedFileException);
+        std::filesystem::resize_file(path, data.size() - 1);
+        REQUIRE_THROWS_AS(ReadImage(path.string()), ReadException);
+    }
+
+    SECTION("Headers written by other programs") {
+        const auto bmp = [](const uint16_t bit_count, const uint32_t compression, const std::string& extra,
+                            const std::string& pixels) {
+            std::string header = "BM";
+            const auto put = [&header](const uint32_t value, const size_t size) {
+                for (size_t k = 0; k < size; ++k) {
+                    header += static_cast<char>((value >> (8 * k)) & 0xFF);
+                }
+            };
+            const size_t offset = 54 + extra.size();
+            put(offset + pixels.size(), 4);
+            put(0, 4);
+            put(offset, 4);
+            for (const uint32_t value : {40u, 2u, 1u}) {
+                put(value, 4);
+            }
+            put(1, 2);
+            put(bit_count, 2);
+            put(compression, 4);
+            put(compression == 1 || compression == 2 ? pixels.size() : 0, 4);
+            for (size_t k = 0; k < 4; ++k) {
+                put(0, 4);
+            }
+            return header + extra + pixels;
+        };
+
+        // Two palette colors and two pixels padded to 4 bytes.
+        std::istringstream palettized(bmp(8, 0, std::string("\x00\x00\xff\x00\xff\x00\x00\x00", 8) +
+                                                    std::string(254 * 4, '\0'),
+                                          std::string("\x01\x00\x00\x00", 4)));
+        const Image colors = ReadImage(palettized);
+        REQUIRE(colors.GetChannels() == RGB_CHANNELS);
+        REQUIRE(colors.GetPixel(0, 0) == Color(0, 0, 1));
+        REQUIRE(colors.GetPixel(0, 1) == Color(1, 0, 0));
+
+        const std::string masks("\x00\x00\xff\x00\x00\xff\x00\x00\xff\x00\x00\x00", 12);
+        std::istringstream bit_fields(bmp(32, 3, masks, std::string("\x00\x00\xff\x80\xff\x00\x00\x80", 8)));
+        const Image bgra = ReadImage(bit_fields);
+        REQUIRE(bgra.GetPixel(0, 0) == Color(1, 0, 0));
+        REQUIRE(bgra.GetPixel(0, 1) == Color(0, 0, 1));
+
+        // Delta over the first pixel, which stays red, a run of one blue pixel and the end of the bitmap.
+        const std::string palette = std::string("\x00\x00\xff\x00\xff\x00\x00\x00", 8);
+        std::istringstream rle8(bmp(8, 1, palette + std::string(254 * 4, '\0'), std::string("\0\2\1\0\1\1\0\1", 8)));
+        const Image rle8_colors = ReadImage(rle8);
+        REQUIRE(rle8_colors.GetPixel(0, 0) == Color(1, 0, 0));
+        REQUIRE(rle8_colors.GetPixel(0, 1) == Color(0, 0, 1));
+        // A run of two pixels alternating the blue and the red color.
+        std::istringstream rle4(bmp(4, 2, palette + std::string(14 * 4, '\0'), std::string("\2\x10\0\1", 4)));
+        const Image rle4_colors = ReadImage(rle4);
+        REQUIRE(rle4_colors.GetPixel(0, 0) == Color(0, 0, 1));
+        REQUIRE(rle4_colors.GetPixel(0, 1) == Color(1, 0, 0));
+        std::istringstream long_run(bmp(8, 1, palette + std::string(254 * 4, '\0'), std::string("\3\0\0\1", 4)));
+        REQUIRE_THROWS_AS(ReadImage(long_run), CorruptedFileException);
+        // A delta past the end of the row followed by a run.
+        std::istringstream long_delta(
+            bmp(8, 1, palette + std::string(254 * 4, '\0'), std::string("\0\2\x10\0\5\xff\0\1", 8)));
+        REQUIRE_THROWS_AS(ReadImage(long_delta), CorruptedFileException);
+        std::istringstream rle24(bmp(24, 1, "", std::string("\0\1", 2)));
+        REQUIRE_THROWS_AS(ReadImage(rle24), SupportException);
+
+        std::istringstream unusual_masks(bmp(32, 3, std::string(12, '\xff'), std::string(8, '\0')));
+        REQUIRE_THROWS_AS(ReadImage(unusual_masks), SupportException);
+        std::istringstream sixteen_bits(bmp(16, 0, "", std::string(4, '\0')));
+        REQUIRE_THROWS_AS(ReadImage(sixteen_bits), SupportException);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("PGM, PPM and raw images") {
+    Image rgb(2, 3);
+    for (size_t k = 0; k < 2 * 3 * RGB_CHANNELS; ++k) {
+        rgb.GetMutableRow(0)[k] = static_cast<double>(k * 10) / 255.0;
+    }
+    Image gray = rgb;
+    CreateFilters({FilterInput("gs", {})})[0]->Apply(gray);
+    const auto write = [](const Image& image, const ImageFormat format) {
+        std::ostringstream out;
+        WriteImage(image, out, format);
+        return out.str();
+    };
+
+    SECTION("Round trips") {
+        const std::string ppm = write(rgb, ImageFormat::Ppm);
+        REQUIRE(ppm.substr(0, 11) == "P6\n3 2\n255\n");
+        REQUIRE(ppm.size() == 11 + 2 * 3 * 3);
+        std::istringstream ppm_in(ppm);
+        REQUIRE(ReadImage(ppm_in).GetPixels() == rgb.GetPixels());
+
+        const std::string pgm = write(gray, ImageFormat::Pgm);
+        std::istringstream pgm_in(pgm);
+        const Image pgm_image = ReadImage(pgm_in);
+        REQUIRE(pgm_image.GetChannels() == GRAYSCALE_CHANNELS);
+        std::istringstream pgm_shape(pgm);
+        REQUIRE(ReadImageShape(pgm_shape) == ImageShape{2, 3, GRAYSCALE_CHANNELS, false});
+
+        std::istringstream raw(write(rgb, ImageFormat::Raw));
+        REQUIRE(ReadRawImage(raw, ImageShape{2, 3, RGB_CHANNELS, false}).GetPixels() == rgb.GetPixels());
+        std::istringstream short_raw(write(rgb, ImageFormat::Raw));
+        REQUIRE_THROWS_AS(ReadRawImage(short_raw, ImageShape{3, 3, RGB_CHANNELS, false}), ReadException);
+    }
+
+    SECTION("Headers written by other programs") {
+        // Comments, other whitespace and two-byte samples.
+        std::istringstream comments(std::string("P5 # gray\n2\t1\n# max\n1000\n\x03\xe8\x01\xf4", 29));
+        const Image wide = ReadImage(comments);
+        REQUIRE(wide.GetPixel(0, 0) == Color(1, 1, 1));
+        REQUIRE(wide.GetPixel(0, 1) == Color(0.5, 0.5, 0.5));
+
+        std::istringstream ascii("P2\n1 1\n255\n0\n");
+        REQUIRE_THROWS_AS(ReadImage(ascii), SupportException);
+        std::istringstream above_max(std::string("P5 1 1 100\n\xff", 12));
+        REQUIRE_THROWS_AS(ReadImage(above_max), CorruptedFileException);
+        std::istringstream extra(std::string("P5 1 1 255\n\0\0", 13));
+        REQUIRE_THROWS_AS(ReadImage(extra), CorruptedFileException);
+    }
+
+    SECTION("Verbose filters keep the standard output readable") {
+        std::ostringstream out;
+        std::ostringstream diagnostics;
+        std::streambuf* const cout_buffer = std::cout.rdbuf(out.rdbuf());
+        std::streambuf* const cerr_buffer = std::cerr.rdbuf(diagnostics.rdbuf());
+        Image image = rgb;
+        CreateFilters({FilterInput("fft-magnitude", {"1", "1"})})[0]->Apply(image);
+        WriteImage(image, STDIO_PATH);
+        std::cout.rdbuf(cout_buffer);
+        std::cerr.rdbuf(cerr_buffer);
+        REQUIRE(diagnostics.str().starts_with("maximal values: "));
+        REQUIRE(out.str() == write(image, ImageFormat::Bmp));
+        std::istringstream in(out.str());
+        REQUIRE(ReadImageShape(in) == ImageShape{2, 4, RGB_CHANNELS, false});
+    }
+
+    SECTION("Formats of written files") {
+        REQUIRE(GetFileFormat("a.PPM") == ImageFormat::Ppm);
+        REQUIRE(GetFileFormat("dir.pgm/a.raw") == ImageFormat::Raw);
+        REQUIRE(GetFileFormat(STDIO_PATH) == ImageFormat::Bmp);
+        REQUIRE(GetOutputFormat({{"format", "pgm"}}) == ImageFormat::Pgm);
+        REQUIRE_THROWS_AS(GetOutputFormat({{"format", "png"}}), UsageException);
+        REQUIRE(GetRawShape({{"raw-size", "640x480"}}) == ImageShape{480, 640, RGB_CHANNELS, false});
+        REQUIRE(GetRawShape({{"raw-size", "640x480x1"}}) == ImageShape{480, 640, GRAYSCALE_CHANNELS, false});
+        REQUIRE_THROWS_AS(GetRawShape({{"raw-size", "640"}}), UsageException);
+        REQUIRE_THROWS_AS(GetRawShape({{"raw-size", "640x480x2"}}), UsageException);
+
+        std::ostringstream out;
+        REQUIRE_THROWS_AS(WriteImage(rgb, out, ImageFormat::Pgm), UsageException);
+        REQUIRE_THROWS_AS(WriteImage(gray, out, ImageFormat::Ppm, PALETTE8_BITS), UsageException);
+        REQUIRE(out.str().empty());
+    }
+}
+
+TEST_CASE("Image headers") {
+    Image gray(3, 5, GRAYSCALE_CHANNELS);
+    std::ostringstream out;
+    WriteImage(gray, out, ImageFormat::Bmp, PALETTE8_BITS, true);
+    const std::string bmp = out.str();
+
+    SECTION("Headers are read without the pixels") {
+        std::istringstream in(bmp);
+        const ImageHeader header = ReadImageHeader(in);
+        REQUIRE(header.format == ImageFormat::Bmp);
+        REQUIRE(header.shape == ImageShape{3, 5, GRAYSCALE_CHANNELS, false});
+        REQUIRE(header.bit_count == PALETTE8_BITS);
+        REQUIRE(header.rle);
+
+        std::istringstream wide(std::string("P6 2 1 1000\n", 12) + std::string(12, '\0'));
+        const ImageHeader wide_header = ReadImageHeader(wide);
+        REQUIRE(wide_header.format == ImageFormat::Ppm);
+        REQUIRE(wide_header.bit_count == 48);
+        REQUIRE_FALSE(wide_header.rle);
+    }
+
+    SECTION("Size of the file is checked against the headers") {
+        std::istringstream truncated(bmp.substr(0, bmp.size() - 1));
+        REQUIRE_THROWS_AS(ReadImageHeader(truncated), ReadException);
+        std::istringstream extra(bmp + '\0');
+        REQUIRE_THROWS_AS(ReadImageHeader(extra), CorruptedFileException);
+        std::istringstream short_pgm(std::string("P5 2 2 255\n\0\0\0", 14));
+        REQUIRE_THROWS_AS(ReadImageHeader(short_pgm), ReadException);
+    }
+
+    SECTION("Reports of --info") {
+        const std::string path = (std::filesystem::temp_directory_path() / "image_headers_test.bmp").string();
+        WriteImage(gray, path, RGB_BITS);
+        const JsonValue report = InspectImage(path);
+        REQUIRE(WriteJson(report) == WriteJson(JsonValue::Object{{"path", path},
+                                                                 {"valid", true},
+                                                                 {"format", "bmp"},
+                                                                 {"width", 5.0},
+                                                                 {"height", 3.0},
+                                                                 {"channels", 3.0},
+                                                                 {"bits", 24.0},
+                                                                 {"compression", "none"}}));
+        std::filesystem::remove(path);
+        const JsonValue missing = InspectImage(path);
+        REQUIRE_FALSE(missing.Find("valid")->GetBool());
+        REQUIRE(missing.Find("error")->IsString());
+
+        char* argv[] = {(char*)"image_processor", (char*)"--validate", (char*)"a.bmp", (char*)"-"};
+        REQUIRE(Parse(4, argv).input_paths == std::vector<std::string>{"a.bmp", "-"});
+    }
+}
+
+TEST_CASE("Lookup tables") {
+    const std::string input = (std::filesystem::temp_directory_path() / "image_processor_lut_input.bmp").string();
+    const std::string output = (std::filesystem::temp_directory_path() / "image_processor_lut_output.bmp").string();
+    Image rgb(4, 5);
+    for (size_t k = 0; k < 4 * 5 * RGB_CHANNELS; ++k) {
+        rgb.GetMutableRow(0)[k] = static_cast<double>(k * 13 % 256) / 255.0;
+    }
+    Image gray = rgb;
+    CreateFilters({FilterInput("gs", {})})[0]->Apply(gray);
+    const auto read_bytes = [](const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+
+    SECTION("Chains of pointwise filters are composed") {
+        const auto neg = CreateFilters({FilterInput("neg", {})});
+        const auto luts = ComposeLuts(neg);
+        REQUIRE(luts.has_value());
+        REQUIRE(luts->size() == RGB_CHANNELS);
+        REQUIRE((*luts)[0][0] == 255);
+        REQUIRE((*luts)[2][255] == 0);
+        const auto twice = ComposeLuts(CreateFilters({FilterInput("neg", {}), FilterInput("neg", {})}));
+        // Values are rounded down only once, after both filters, so they may lose one step as in filtering doubles.
+        for (size_t value = 0; value < 256; ++value) {
+            REQUIRE((*twice)[1][value] <= value);
+            REQUIRE((*twice)[1][value] + size_t{1} >= value);
+        }
+        REQUIRE_FALSE(ComposeLuts(CreateFilters({FilterInput("neg", {}), FilterInput("blur", {"1"})})).has_value());
+        REQUIRE_FALSE(ComposeLuts(CreateFilters({FilterInput("gs", {})})).has_value());
+    }
+
+    SECTION("Files are written as by decoding and filtering") {
+        const auto filters = CreateFilters({FilterInput("neg", {})});
+        const std::vector<std::pair<const Image*, std::optional<uint16_t>>> files = {
+            {&rgb, std::nullopt}, {&rgb, RGBX_BITS}, {&gray, std::nullopt}, {&gray, RGB_BITS}};
+        for (const auto& [image, bit_count] : files) {
+            WriteImage(*image, input, bit_count);
+            REQUIRE(ApplyLutsToBmp(input, output, *ComposeLuts(filters)));
+            Image expected = ReadImage(input);
+            ApplyFilters(expected, filters);
+            std::ostringstream expected_bytes;
+            WriteImage(expected, expected_bytes);
+            REQUIRE(read_bytes(output) == expected_bytes.str());
+        }
+
+        WriteImage(gray, input, std::nullopt, true);
+        REQUIRE_FALSE(ApplyLutsToBmp(input, output, *ComposeLuts(filters)));
+        std::filesystem::remove(input);
+        std::filesystem::remove(output);
+    }
+}
+
+TEST_CASE("Spectrum files") {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "image_processor_test.spectrum";
+    Image image(5, 6);
+    for (size_t k = 0; k < 5 * 6 * RGB_CHANNELS; ++k) {
+        image.GetMutableRow(0)[k] = static_cast<double>(k % 7) / 7.0;
+    }
+    const ImageFrequencyDomainRepresentation spectrum = FFT(image);
+    WriteSpectrum(path.string(), spectrum, image.GetShape());
+    REQUIRE(std::filesystem::file_size(path) == 48 + 3 * 8 * 8 * 16);
+
+    SECTION("Mapped planes") {
+        const MappedSpectrum mapped(path.string());
+        REQUIRE(mapped.GetImageShape() == ImageShape{5, 6, RGB_CHANNELS, false});
+        REQUIRE(mapped.GetHeight() == 8);
+        REQUIRE(mapped.GetWidth() == 8);
+        REQUIRE(mapped.GetRow(2, 7)[3] == spectrum.GetElement(7, 3)[2]);
+        REQUIRE(mapped.GetRepresentation().GetElements() == spectrum.GetElements());
+    }
+
+    SECTION("Chains saving and starting from the spectrum") {
+        const std::vector<FilterInput> inputs = {FilterInput("neg", {}), FilterInput("fft-lowpass", {"0.3"}),
+                                                 FilterInput("crop", {"4", "4"})};
+        const std::vector<std::shared_ptr<BaseFilter>> filters = CreateFilters(inputs);
+        REQUIRE(FindFirstFFTFilter(filters) == 1);
+        Image expected = image;
+        ApplyFilters(expected, filters);
+
+        Image saved = image;
+        ApplyFilters(saved, filters, inputs, nullptr, SpectrumFiles{std::nullopt, path.string()});
+        REQUIRE(saved.GetPixels() == expected.GetPixels());
+
+        const std::vector<FilterInput> tail(inputs.begin() + 1, inputs.end());
+        Image loaded;
+        ApplyFilters(loaded, CreateFilters(tail), tail, nullptr, SpectrumFiles{path.string(), std::nullopt});
+        REQUIRE(loaded.GetPixels() == expected.GetPixels());
+        REQUIRE_THROWS_AS(ApplyFilters(loaded, filters, inputs, nullptr, SpectrumFiles{path.string(), std::nullopt}),
+                          UsageException);
+    }
+
+    SECTION("Damaged files") {
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 16);
+        REQUIRE_THROWS_AS(MappedSpectrum(path.string()), CorruptedFileException);
+        std::ofstream(path, std::ios::binary) << "BM and not a spectrum at all, but long enough for the header";
+        REQUIRE_THROWS_AS(MappedSpectrum(path.string()), CorruptedFileException);
+        REQUIRE_THROWS_AS(MappedSpectrum("/nonexistent/file.spectrum"), ReadException);
+
+        // The size of the planes wraps around to 0 in 64 bits.
+        SpectrumHeader huge;
+        huge.channels = GRAYSCALE_CHANNELS;
+        huge.height = huge.image_height = uint64_t{1} << 62;
+        huge.width = huge.image_width = 4;
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+        REQUIRE_THROWS_AS(MappedSpectrum(path.string()), CorruptedFileException);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Thread pool") {
+    ThreadPool pool(4);
+    REQUIRE(pool.GetThreadsCount() == 4);
+
+    SECTION("Every task is run exactly once") {
+        std::vector<std::atomic<int>> runs(1000);
+        pool.ParallelFor(runs.size(), [&runs](size_t i) { ++runs[i]; });
+        for (const auto& count : runs) {
+            REQUIRE(count == 1);
+        }
+    }
+
+    SECTION("Nested calls") {
+        std::atomic<int> runs = 0;
+        pool.ParallelFor(8, [&](size_t) { pool.ParallelFor(8, [&](size_t) { ++runs; }); });
+        REQUIRE(runs == 64);
+    }
+
+    SECTION("Exceptions are rethrown") {
+        REQUIRE_THROWS_AS(pool.ParallelFor(10,
+                                           [](size_t i) {
+                                               if (i == 7) {
+                                                   throw InternalException("test");
+                                               }
+                                           }),
+                          InternalException);
+    }
+}
+
+TEST_CASE("Bounded queue") {
+    SECTION("Capacity is respected") {
+        BoundedQueue<int> queue(2);
+        REQUIRE(queue.TryPush(1));
+        REQUIRE(queue.TryPush(2));
+        REQUIRE(!queue.TryPush(3));
+        REQUIRE(queue.GetSize() == 2);
+        REQUIRE(queue.TryPop() == 1);
+        REQUIRE(queue.TryPush(3));
+        REQUIRE(queue.TryPop() == 2);
+        REQUIRE(queue.TryPop() == 3);
+        REQUIRE(!queue.TryPop().has_value());
+    }
+
+    SECTION("Concurrent producers and consumers") {
+        constexpr int ProducersCount = 4;
+        constexpr int ValuesCount = 10000;
+        BoundedQueue<int> queue(16);
+        std::atomic<int64_t> sum = 0;
+        std::atomic<int> popped = 0;
+        std::vector<std::thread> threads;
+        for (int producer = 0; producer < ProducersCount; ++producer) {
+            threads.emplace_back([&queue] {
+                for (int value = 1; value <= ValuesCount; ++value) {
+                    while (!queue.TryPush(value)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+            threads.emplace_back([&] {
+                while (popped.load() < ProducersCount * ValuesCount) {
+                    if (const std::optional<int> value = queue.TryPop()) {
+                        sum += *value;
+                        ++popped;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(sum.load() == static_cast<int64_t>(ProducersCount) * ValuesCount * (ValuesCount + 1) / 2);
+    }
+
+    SECTION("Blocking queue keeps the order of a single producer") {
+        constexpr int ValuesCount = 1000;
+        BlockingQueue<std::optional<int>> queue(3);
+        std::thread producer([&queue] {
+            for (int value = 0; value < ValuesCount; ++value) {
+                queue.Push(value);
+            }
+            queue.Push(std::nullopt);
+        });
+        int expected = 0;
+        for (std::optional<int> value = queue.Pop(); value.has_value(); value = queue.Pop()) {
+            REQUIRE(*value == expected++);
+        }
+        producer.join();
+        REQUIRE(expected == ValuesCount);
+    }
+
+    SECTION("Blocking queue loses nothing with several producers and consumers") {
+        constexpr int ProducersCount = 2;
+        constexpr int ConsumersCount = 3;
+        constexpr int ValuesCount = 10000;
+        BlockingQueue<std::optional<int>> queue(2);
+        std::atomic<int64_t> sum = 0;
+        std::vector<std::thread> consumers;
+        for (int consumer = 0; consumer < ConsumersCount; ++consumer) {
+            consumers.emplace_back([&] {
+                for (std::optional<int> value = queue.Pop(); value.has_value(); value = queue.Pop()) {
+                    sum += *value;
+                }
+            });
+        }
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < ProducersCount; ++producer) {
+            producers.emplace_back([&queue] {
+                for (int value = 1; value <= ValuesCount; ++value) {
+                    queue.Push(value);
+                }
+            });
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+        for (int consumer = 0; consumer < ConsumersCount; ++consumer) {
+            queue.Push(std::nullopt);
+        }
+        for (std::thread& consumer : consumers) {
+            consumer.join();
+        }
+        REQUIRE(sum.load() == static_cast<int64_t>(ProducersCount) * ValuesCount * (ValuesCount + 1) / 2);
+        REQUIRE(queue.GetSize() == 0);
+    }
+}
+
+TEST_CASE("Server helpers") {
+    SECTION("Latency percentiles") {
+        LatencyHistogram histogram;
+        REQUIRE(histogram.GetPercentile(50) == 0.0);
+        for (int i = 0; i < 98; ++i) {
+            histogram.Record(1.0);
+        }
+        histogram.Record(100.0);
+        histogram.Record(100.0);
+        REQUIRE(histogram.GetCount() == 100);
+        REQUIRE(1.0 <= histogram.GetPercentile(50));
+        REQUIRE(histogram.GetPercentile(50) < 1.1);
+        REQUIRE(100.0 <= histogram.GetPercentile(99));
+        REQUIRE(histogram.GetPercentile(99) < 110.0);
+    }
+
+    SECTION("Base64") {
+        REQUIRE(DecodeBase64("TWFu") == "Man");
+        REQUIRE(DecodeBase64("TWE=") == "Ma");
+        REQUIRE(DecodeBase64("TQ==") == "M");
+        REQUIRE_THROWS_AS(DecodeBase64("T*=="), UsageException);
+    }
+
+    SECTION("Reading images from streams") {
+        std::istringstream not_bmp("PNG");
+        REQUIRE_THROWS_AS(ReadImage(not_bmp), CorruptedFileException);
+        std::istringstream truncated("BM");
+        REQUIRE_THROWS_AS(ReadImage(truncated), ReadException);
+    }
+}
+
+TEST_CASE("Server") {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "image_processor_server_test";
+    std::filesystem::create_directories(directory);
+    const std::string socket_path = (directory / "socket").string();
+
+    SECTION("Socket path") {
+        const std::string regular_file = (directory / "photo.bmp").string();
+        WriteImage(Image(2, 2), regular_file);
+        REQUIRE_THROWS_AS(Server(regular_file, {}, 1, 4), UsageException);
+        REQUIRE(std::filesystem::exists(regular_file));
+
+        {
+            const Server server(socket_path, {}, 1, 4);
+            REQUIRE_THROWS_AS(Server(socket_path, {}, 1, 4), UsageException);
+            REQUIRE(std::filesystem::is_socket(socket_path));
+        }
+        // A socket left by a stopped server is replaced.
+        const int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, socket_path.c_str());
+        REQUIRE(bind(stale, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+        close(stale);
+        REQUIRE_NOTHROW(Server(socket_path, {}, 1, 4));
+    }
+
+    SECTION("Processing jobs") {
+        const std::string input = (directory / "input.bmp").string();
+        const std::string output = (directory / "output.bmp").string();
+        Image image(4, 6);
+        image.GetMutableRow(1)[2] = 1.0;
+        WriteImage(image, input);
+        Server server(socket_path, {FilterInput("neg", {})}, 1, 4);
+        const JsonValue job = JsonValue::Object{{"input", input}, {"output", output}};
+
+        const JsonValue ok = server.ProcessJob(job);
+        REQUIRE(ok.Find("status")->GetString() == "ok");
+        REQUIRE(ok.Find("filters_ms")->IsNumber());
+        REQUIRE(ReadImage(output).GetPixel(3, 5) == Color(1, 1, 1));
+
+        const JsonValue bad_filters =
+            server.ProcessJob(JsonValue::Object{{"input", input}, {"output", output}, {"filters", "-blur abc"}});
+        REQUIRE(bad_filters.Find("status")->GetString() == "error");
+        REQUIRE(bad_filters.Find("message")->GetString().find("blur") != std::string::npos);
+
+        // Jobs cancelled or past their deadline while queued are not started.
+        std::filesystem::remove(output);
+        const CancellationToken cancelled;
+        cancelled.Cancel();
+        const CancellationToken expired = CreateCancellationToken(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        for (const CancellationToken* token : {&cancelled, &expired}) {
+            const CancellationScope scope(token);
+            REQUIRE(server.ProcessJob(job).Find("status")->GetString() == "cancelled");
+        }
+        REQUIRE_FALSE(std::filesystem::exists(output));
+
+        const JsonValue stats = server.GetStats();
+        REQUIRE(stats.Find("completed")->GetNumber() == 1);
+        REQUIRE(stats.Find("failed")->GetNumber() == 1);
+        REQUIRE(stats.Find("cancelled")->GetNumber() == 2);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Kernels") {
+    SECTION("Compile-time exponent matches std::exp") {
+        for (double x : {0.0, -0.1, -0.5, -1.0, -2.25, -4.5, 1.0, 3.7}) {
+            REQUIRE(ConstexprExp(x) == std::exp(x));
+        }
+    }
+
+    SECTION("Gaussian taps") {
+        static_assert(GAUSSIAN_TAPS<2>.size() == 3);
+        static_assert(GAUSSIAN_TAPS<3>.size() == 5);
+        static_assert(GAUSSIAN_TAPS<4>[0] == 1.0);
+        REQUIRE(GAUSSIAN_TAPS<4>[1] == std::exp(-1.0 / 8));
+    }
+
+    SECTION("Convolution skips zero taps") {
+        const std::vector<double> values = {1.0, 2.0, 3.0};
+        const std::array<const double*, 3> rows = {values.data(), values.data(), values.data()};
+        REQUIRE(Convolve<LAPLACIAN_KERNEL, double>(rows, {0, 1, 2}) == 0.0);
+        REQUIRE(Convolve<SHARPENING_KERNEL, double>(rows, {0, 1, 2}) == 2.0);
+        REQUIRE(Convolve<SHARPENING_KERNEL, double>(rows, {2, 0, 1}) == -2.0);
+        REQUIRE(Convolve<SOBEL_X_KERNEL, double>(rows, {0, 1, 2}) == 8.0);
+        REQUIRE(Convolve<SOBEL_Y_KERNEL, double>(rows, {0, 1, 2}) == 0.0);
+        REQUIRE(std::abs(Convolve<BOX_KERNEL<1>, double>(rows, {0, 1, 2}) - 2.0) < 1e-12);
+    }
+}
+
+TEST_CASE("Integral image") {
+    Image image(37, 23);
+    for (size_t k = 0; k < 37 * 23 * RGB_CHANNELS; ++k) {
+        image.GetMutableRow(0)[k] = static_cast<double>(k * 7919 % 256) / 255.0;
+    }
+    const auto brute_force = [&image](const int64_t top, const int64_t left, const int64_t height,
+                                      const int64_t width, const size_t channel) {
+        double sum = 0;
+        for (int64_t i = top; i < top + height; ++i) {
+            for (int64_t j = left; j < left + width; ++j) {
+                const double* row = image.GetRow(std::clamp<int64_t>(i, 0, 36));
+                sum += row[std::clamp<int64_t>(j, 0, 22) * RGB_CHANNELS + channel];
+            }
+        }
+        return sum;
+    };
+    // Several bands of rows are scanned with more than one thread.
+    for (const size_t threads : {1, 4}) {
+        SetThreadsCount(threads);
+        const IntegralImage table(image);
+        REQUIRE(table.GetChannels() == RGB_CHANNELS);
+        REQUIRE(std::abs(table.GetSum(Rect{0, 0, 37, 23}, 1) - brute_force(0, 0, 37, 23, 1)) < 1e-9);
+        REQUIRE(std::abs(table.GetSum(Rect{5, 3, 20, 1}, 2) - brute_force(5, 3, 20, 1, 2)) < 1e-9);
+        REQUIRE(table.GetSum(Rect{10, 10, 0, 5}, 0) == 0);
+
+        std::vector<double> sums(RGB_CHANNELS);
+        for (const auto& [top, left, height, width] : std::vector<std::array<int64_t, 4>>{
+                 {3, 4, 5, 6}, {-4, -2, 9, 9}, {30, 20, 11, 11}, {-50, 10, 3, 3}, {-10, -10, 60, 50}}) {
+            table.GetClampedSums(top, left, height, width, sums.data());
+            for (size_t c = 0; c < RGB_CHANNELS; ++c) {
+                REQUIRE(std::abs(sums[c] - brute_force(top, left, height, width, c)) < 1e-9);
+            }
+        }
+    }
+    SetThreadsCount(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+TEST_CASE("Box filters") {
+    Image image(30, 40);
+    for (size_t k = 0; k < 30 * 40 * RGB_CHANNELS; ++k) {
+        image.GetMutableRow(0)[k] = static_cast<double>(k * 31 % 256) / 255.0;
+    }
+
+    SECTION("Box filter is the mean of the clamped window") {
+        Image box = image;
+        CreateFilters({FilterInput("box", {"3"})})[0]->Apply(box);
+        for (int64_t i = 0; i < 30; ++i) {
+            for (int64_t j = 0; j < 40; ++j) {
+                for (size_t c = 0; c < RGB_CHANNELS; ++c) {
+                    double sum = 0;
+                    for (int64_t mi = i - 3; mi <= i + 3; ++mi) {
+                        const double* row = image.GetRow(std::clamp<int64_t>(mi, 0, 29));
+                        for (int64_t mj = j - 3; mj <= j + 3; ++mj) {
+                            sum += row[std::clamp<int64_t>(mj, 0, 39) * RGB_CHANNELS + c];
+                        }
+                    }
+                    REQUIRE(std::abs(box.GetRow(i)[j * RGB_CHANNELS + c] - sum / 49) < 1e-9);
+                }
+            }
+        }
+    }
+
+    SECTION("Local mean leaves out pixels outside of the image") {
+        Image mean = image;
+        CreateFilters({FilterInput("localmean", {"50"})})[0]->Apply(mean);
+        // The window of every pixel covers the whole image.
+        double total = 0;
+        for (size_t k = 0; k < 30 * 40 * RGB_CHANNELS; k += RGB_CHANNELS) {
+            total += image.GetRow(0)[k];
+        }
+        REQUIRE(std::abs(mean.GetPixel(0, 0).r - total / (30 * 40)) < 1e-9);
+        REQUIRE(std::abs(mean.GetPixel(29, 39).r - total / (30 * 40)) < 1e-9);
+
+        Image unchanged = image;
+        CreateFilters({FilterInput("localmean", {"0"})})[0]->Apply(unchanged);
+        REQUIRE(unchanged.GetPixels() == image.GetPixels());
+    }
+
+    SECTION("Halo and memory") {
+        const auto filter = CreateFilters({FilterInput("box", {"50"})})[0];
+        REQUIRE(filter->GetHalo() == 50);
+        const FilterMemory memory = filter->EstimateMemory(ImageShape{30, 40, RGB_CHANNELS, false});
+        REQUIRE(memory.peak_bytes == 31 * 41 * 3 * 8 + 30 * 40 * 3 * 8);
+    }
+
+    SECTION("Factory") {
+        BoxFactory factory(REPLICATE_BORDER);
+        REQUIRE_THROWS_AS(factory.Create({}), UsageException);
+        REQUIRE_THROWS_AS(factory.Create({"1", "2"}), UsageException);
+        REQUIRE_THROWS_AS(factory.Create({"-1"}), UsageException);
+        REQUIRE_THROWS_AS(factory.Create({"1.5"}), UsageException);
+        REQUIRE_NOTHROW(factory.Create({"100"}));
+    }
+}
+
+TEST_CASE("Median filter") {
+    // Wide enough to be split into several strips.
+    Image image(23, 150);
+    for (size_t k = 0; k < 23 * 150 * RGB_CHANNELS; ++k) {
+        image.GetMutableRow(0)[k] = static_cast<double>(k * 7919 % 256) / 255.0;
+    }
+    const auto brute_force = [&image](const int64_t radius, const int64_t i, const int64_t j, const size_t channel) {
+        std::vector<double> values;
+        for (int64_t mi = i - radius; mi <= i + radius; ++mi) {
+            for (int64_t mj = j - radius; mj <= j + radius; ++mj) {
+                const double* row = image.GetRow(std::clamp<int64_t>(mi, 0, 22));
+                values.push_back(row[std::clamp<int64_t>(mj, 0, 149) * RGB_CHANNELS + channel]);
+            }
+        }
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    };
+
+    SECTION("Medians of sorting and of histograms") {
+        for (const std::string radius : {"1", "2", "3", "7"}) {
+            Image median = image;
+            CreateFilters({FilterInput("median", {radius})})[0]->Apply(median);
+            for (int64_t i = 0; i < 23; ++i) {
+                for (int64_t j = 0; j < 150; ++j) {
+                    for (size_t c = 0; c < RGB_CHANNELS; ++c) {
+                        REQUIRE(median.GetRow(i)[j * RGB_CHANNELS + c] == brute_force(std::stoi(radius), i, j, c));
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Salt and pepper noise is removed") {
+        Image noisy(20, 20, GRAYSCALE_CHANNELS);
+        std::fill_n(noisy.GetMutableRow(0), 20 * 20, 128 / 255.0);
+        noisy.GetMutableRow(3)[4] = 1;
+        noisy.GetMutableRow(10)[10] = 0;
+        noisy.GetMutableRow(19)[0] = 1;
+        for (const std::string radius : {"1", "4"}) {
+            Image median = noisy;
+            CreateFilters({FilterInput("median", {radius})})[0]->Apply(median);
+            const double* values = median.GetRow(0);
+            REQUIRE(std::all_of(values, values + 20 * 20, [](double x) { return x == 128 / 255.0; }));
+        }
+    }
+
+    SECTION("Factory and strips") {
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("median", {})}), UsageException);
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("median", {"-1"})}), UsageException);
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("median", {"1001"})}), UsageException);
+        REQUIRE(CreateFilters({FilterInput("median", {"5"})})[0]->GetHalo() == 5);
+        const std::vector<Rect> strips = SplitIntoStrips(10, 150, 1);
+        REQUIRE(strips.size() == 3);
+        REQUIRE(strips[2] == Rect{0, 128, 10, 22});
+    }
+}
+
+TEST_CASE("Resize filter") {
+    SECTION("Weights are normalized and cover the input") {
+        for (const ResampleMode mode : {BOX_RESAMPLE, BILINEAR_RESAMPLE, BICUBIC_RESAMPLE, LANCZOS_RESAMPLE}) {
+            for (const auto& [input_size, output_size] : {std::pair<size_t, size_t>{100, 37}, {37, 100}, {8, 2}}) {
+                const ResampleWeights weights = GetResampleWeights(input_size, output_size, mode);
+                REQUIRE(weights.first.size() == output_size);
+                for (size_t k = 0; k < output_size; ++k) {
+                    REQUIRE(weights.counts[k] <= weights.taps);
+                    REQUIRE(weights.first[k] + weights.counts[k] <= input_size);
+                    double sum = 0;
+                    for (size_t t = 0; t < weights.counts[k]; ++t) {
+                        sum += weights.weights[k * weights.taps + t];
+                    }
+                    REQUIRE(std::abs(sum - 1) < 1e-12);
+                }
+            }
+        }
+        const ResampleWeights box = GetResampleWeights(8, 2, BOX_RESAMPLE);
+        REQUIRE(box.first == std::vector<size_t>{0, 4});
+        REQUIRE(box.counts == std::vector<size_t>{4, 4});
+        REQUIRE(box.weights[0] == 0.25);
+    }
+
+    SECTION("Box resampling by integer factors averages blocks") {
+        Image image(12, 20);
+        for (size_t k = 0; k < 12 * 20 * RGB_CHANNELS; ++k) {
+            image.GetMutableRow(0)[k] = static_cast<double>(k * 7919 % 256) / 255.0;
+        }
+        Image resized = image;
+        CreateFilters({FilterInput("resize", {"3", "5", "box"})})[0]->Apply(resized);
+        REQUIRE(resized.GetShape() == ImageShape{3, 5, RGB_CHANNELS, false});
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 5; ++j) {
+                for (size_t c = 0; c < RGB_CHANNELS; ++c) {
+                    double sum = 0;
+                    for (size_t mi = 4 * i; mi < 4 * i + 4; ++mi) {
+                        for (size_t mj = 4 * j; mj < 4 * j + 4; ++mj) {
+                            sum += image.GetRow(mi)[mj * RGB_CHANNELS + c];
+                        }
+                    }
+                    REQUIRE(std::abs(resized.GetRow(i)[j * RGB_CHANNELS + c] - sum / 16) < 1e-12);
+                }
+            }
+        }
+    }
+
+    SECTION("Constant images stay constant") {
+        for (const size_t channels : {GRAYSCALE_CHANNELS, RGB_CHANNELS}) {
+            Image image(31, 17, channels);
+            std::fill_n(image.GetMutableRow(0), 31 * 17 * channels, 0.3);
+            for (const std::string mode : {"box", "bilinear", "bicubic", "lanczos"}) {
+                for (const auto& [height, width] : {std::pair<std::string, std::string>{"10", "40"}, {"64", "5"}}) {
+                    Image resized = image;
+                    CreateFilters({FilterInput("resize", {height, width, mode})})[0]->Apply(resized);
+                    REQUIRE(resized.GetHeight() == std::stoul(height));
+                    REQUIRE(resized.GetWidth() == std::stoul(width));
+                    const double* values = resized.GetRow(0);
+                    const size_t values_count = resized.GetHeight() * resized.GetWidth() * resized.GetChannels();
+                    REQUIRE(std::all_of(values, values + values_count,
+                                        [](double x) { return std::abs(x - 0.3) < 1e-12; }));
+                }
+            }
+        }
+    }
+
+    SECTION("Factory and memory") {
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("resize", {"10"})}), UsageException);
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("resize", {"0", "10"})}), UsageException);
+        REQUIRE_THROWS_AS(CreateFilters({FilterInput("resize", {"10", "10", "nearest"})}), UsageException);
+        const auto filter = CreateFilters({FilterInput("resize", {"50", "40"})})[0];
+        REQUIRE_FALSE(filter->GetHalo().has_value());
+        const FilterMemory memory = filter->EstimateMemory(ImageShape{200, 100, RGB_CHANNELS, false});
+        REQUIRE(memory.output == ImageShape{50, 40, RGB_CHANNELS, false});
+        REQUIRE(memory.peak_bytes > *memory.output_bytes);
+        REQUIRE(CreateFilters({FilterInput("resize", {"50", "50", "box"})})[0]
+                    ->EstimateMemory(ImageShape{200, 100, RGB_CHANNELS, true})
+                    .output == ImageShape{50, 50, GRAYSCALE_CHANNELS, false});
+    }
+}
+
 TEST_CASE("Image") {
     SECTION("Correct pixels with normalization, out of bound indexes") {
         size_t height = 3, width = 2;
@@ -89,6 +1454,59 @@ TEST_CASE("Image") {
 
         REQUIRE_THROWS_AS(Image(pixels), InternalException);
     }
+
+    SECTION("Crop") {
+        Image image({{{0.1, 0.1, 0.1}, {0.2, 0.2, 0.2}, {0.3, 0.3, 0.3}},
+                     {{0.4, 0.4, 0.4}, {0.5, 0.5, 0.5}, {0.6, 0.6, 0.6}}});
+        Image copy = image;
+        image.Crop(Rect{1, 1, 1, 2});
+
+        REQUIRE(image.GetHeight() == 1);
+        REQUIRE(image.GetWidth() == 2);
+        REQUIRE(image.GetPixel(0, 0) == Color(0.5, 0.5, 0.5));
+        REQUIRE(image.GetPixel(0, 1) == Color(0.6, 0.6, 0.6));
+        REQUIRE(copy.GetPixel(1, 0) == Color(0.4, 0.4, 0.4));
+        REQUIRE_THROWS_AS(image.GetPixel(1, 0), InternalException);
+        REQUIRE_THROWS_AS(image.Crop(Rect{0, 1, 1, 2}), InternalException);
+    }
+
+    SECTION("Mask") {
+        Image image;
+        REQUIRE_THROWS_AS(image.SetMask(2, 70, std::vector<uint64_t>(2)), InternalException);
+
+        std::vector<uint64_t> mask(4);
+        mask[0] = 1;
+        mask[3] = static_cast<uint64_t>(1) << 5;
+        image.SetMask(2, 70, std::move(mask));
+
+        REQUIRE(image.IsMask());
+        REQUIRE(image.GetPixel(0, 0) == Color(1.0, 1.0, 1.0));
+        REQUIRE(image.GetPixel(0, 1) == Color(0.0, 0.0, 0.0));
+        REQUIRE(image.GetPixel(1, 69) == Color(1.0, 1.0, 1.0));
+        REQUIRE(image.GetPixels()[1][69] == Color(1.0, 1.0, 1.0));
+
+        image.ExpandMask();
+        REQUIRE(!image.IsMask());
+        REQUIRE(image.GetPixel(1, 69) == Color(1.0, 1.0, 1.0));
+        REQUIRE(image.GetPixel(1, 68) == Color(0.0, 0.0, 0.0));
+        REQUIRE(image.GetChannels() == GRAYSCALE_CHANNELS);
+    }
+
+    SECTION("Grayscale") {
+        REQUIRE_THROWS_AS(Image(2, 2, 2), InternalException);
+
+        Image image({{{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}}, {{0.0, 0.0, 1.0}, {0.5, 0.5, 0.5}}});
+        REQUIRE(image.GetChannels() == RGB_CHANNELS);
+        GrayscaleFilter().Apply(image);
+        REQUIRE(image.GetChannels() == GRAYSCALE_CHANNELS);
+        REQUIRE(image.GetRow(0)[1] == 0.587);
+        REQUIRE(image.GetPixel(0, 1) == Color(0.587, 0.587, 0.587));
+
+        NegativeFilter().Apply(image);
+        image.Crop(Rect{1, 1, 1, 1});
+        REQUIRE(image.GetChannels() == GRAYSCALE_CHANNELS);
+        REQUIRE(image.GetPixel(0, 0) == Color(0.5, 0.5, 0.5));
+    }
 }
 
 TEST_CASE("Crop factory") {
@@ -296,6 +1714,33 @@ TEST_CASE("Gaussian blur factory") {
         REQUIRE_THROWS_AS(factory.Create({"-2.01asdf"}), UsageException);
         REQUIRE_THROWS_AS(factory.Create({"10l"}), UsageException);
     }
+
+    SECTION("Borders of non-square images") {
+        // The same edge along the long side of a tall and of a wide image, the results must be transposed.
+        Image tall(30, 3);
+        Image wide(3, 30);
+        for (size_t i = 10; i < 30; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                std::fill_n(tall.GetMutableRow(i) + j * RGB_CHANNELS, RGB_CHANNELS, 1.0);
+                std::fill_n(wide.GetMutableRow(j) + i * RGB_CHANNELS, RGB_CHANNELS, 1.0);
+            }
+        }
+        for (const std::string sigma : {"1", "5"}) {
+            Image tall_blurred = tall;
+            Image wide_blurred = wide;
+            factory.Create({sigma})->Apply(tall_blurred);
+            factory.Create({sigma})->Apply(wide_blurred);
+            for (size_t i = 0; i < 30; ++i) {
+                for (size_t j = 0; j < 3; ++j) {
+                    REQUIRE(std::abs(tall_blurred.GetPixel(i, j).r - wide_blurred.GetPixel(j, i).r) < 1e-12);
+                }
+            }
+        }
+        Image blurred = tall;
+        factory.Create({"1"})->Apply(blurred);
+        // Rows below the image are taken from the last row, so the bottom is as bright as the middle of the white part.
+        REQUIRE(std::abs(blurred.GetPixel(29, 1).r - blurred.GetPixel(20, 1).r) < 1e-12);
+    }
 }
 
 TEST_CASE("Grayscale factory") {
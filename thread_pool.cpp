@@ -0,0 +1,177 @@
+#include "thread_pool.h"
+
+#include "cancellation.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+std::unique_ptr<ThreadPool> global_pool;
+std::mutex global_pool_mutex;
+}  // namespace
+
+ThreadPool::ThreadPool(const size_t threads_count) {
+    if (threads_count == 0) {
+        throw InternalException("thread pool must have at least one thread");
+    }
+    for (size_t i = 0; i + 1 < threads_count; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i + 1 < threads_count; ++i) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadsCount() const {
+    return workers_.size() + 1;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    const size_t index =
+        current_pool == this ? current_worker : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard lock(wake_mutex_);
+        pending_.fetch_add(1);
+    }
+    {
+        std::lock_guard lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask() {
+    if (pending_.load() == 0) {
+        return false;
+    }
+    const bool is_worker = current_pool == this;
+    const size_t first = is_worker ? current_worker : next_queue_.load(std::memory_order_relaxed) % queues_.size();
+    for (size_t shift = 0; shift < queues_.size(); ++shift) {
+        const size_t index = (first + shift) % queues_.size();
+        std::function<void()> task;
+        {
+            std::lock_guard lock(queues_[index]->mutex);
+            std::deque<std::function<void()>>& tasks = queues_[index]->tasks;
+            if (tasks.empty()) {
+                continue;
+            }
+            // Own tasks are taken from the back while they are hot in cache, stolen ones from the front.
+            if (is_worker && shift == 0) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            } else {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+        }
+        pending_.fetch_sub(1);
+        task();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(const size_t index) {
+    current_pool = this;
+    current_worker = index;
+    while (true) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        std::unique_lock lock(wake_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_.load() > 0; });
+        if (stopping_ && pending_.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(const size_t count, const std::function<void(size_t)>& task) {
+    if (workers_.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    // Tasks work for the same job as the caller, so they are cancelled together with it.
+    const CancellationToken* token = GetCurrentCancellationToken();
+    struct State {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = 0;
+        std::exception_ptr exception;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = count;
+    for (size_t i = 0; i < count; ++i) {
+        Submit([state, &task, i, token] {
+            std::exception_ptr exception;
+            try {
+                const CancellationScope scope(token);
+                task(i);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            std::lock_guard lock(state->mutex);
+            if (exception && !state->exception) {
+                state->exception = exception;
+            }
+            if (--state->remaining == 0) {
+                state->done.notify_all();
+            }
+        });
+    }
+
+    // While waiting, the calling thread helps with any pending work, so that nested calls from workers cannot
+    // deadlock the pool.
+    while (true) {
+        {
+            std::unique_lock lock(state->mutex);
+            if (state->remaining == 0) {
+                break;
+            }
+        }
+        if (RunPendingTask()) {
+            continue;
+        }
+        std::unique_lock lock(state->mutex);
+        constexpr std::chrono::milliseconds IdleWait(1);
+        state->done.wait_for(lock, IdleWait, [&state] { return state->remaining == 0; });
+    }
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+ThreadPool& GetThreadPool() {
+    std::lock_guard lock(global_pool_mutex);
+    if (!global_pool) {
+        global_pool = std::make_unique<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    return *global_pool;
+}
+
+void SetThreadsCount(const size_t threads_count) {
+    std::lock_guard lock(global_pool_mutex);
+    global_pool = std::make_unique<ThreadPool>(threads_count);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker has its own queue and takes tasks from other queues when its own is empty.
+// The thread calling ParallelFor takes part in the work too, so a pool of n threads starts n - 1 workers.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t GetThreadsCount() const;
+
+    void Submit(std::function<void()> task);
+
+    // Runs task(0), ..., task(count - 1) and waits until all of them finish. The first thrown exception is rethrown.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool RunPendingTask();
+    void WorkerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_ = 0;
+    std::atomic<size_t> next_queue_ = 0;
+    bool stopping_ = false;
+};
+
+ThreadPool& GetThreadPool();
+
+void SetThreadsCount(size_t threads_count);
\ No newline at end of file